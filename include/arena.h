@@ -0,0 +1,118 @@
+#pragma once
+
+#include "expression.h"
+
+#include <cstddef>
+#include <mutex>
+
+namespace calculus {
+
+constexpr size_t kDefaultArenaBlockSize = 64 * 1024;
+
+/* Bump allocator for expression nodes. Memory is released wholesale by Reset(),
+ * which requires every node allocated from the arena to be destroyed already.
+ * Allocate() and Deallocate() may be called concurrently, since nodes handed to
+ * a ThreadPool can be released by a worker thread; Reset() may not. */
+class Arena {
+public:
+    explicit Arena(size_t block_size = kDefaultArenaBlockSize);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment);
+    void Deallocate(void* ptr, size_t size);
+    void Reset();
+
+    size_t GetBytesAllocated() const {
+        return bytes_allocated_;
+    }
+
+    size_t GetNodesAllocated() const {
+        return nodes_allocated_;
+    }
+
+    size_t GetLiveNodes() const {
+        return live_nodes_;
+    }
+
+private:
+    void NextBlock();
+
+    std::mutex mutex_;
+
+    size_t block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<std::unique_ptr<char[]>> large_blocks_;
+    size_t current_block_ = 0;
+    char* current_ = nullptr;
+    char* end_ = nullptr;
+
+    size_t bytes_allocated_ = 0;
+    size_t nodes_allocated_ = 0;
+    size_t live_nodes_ = 0;
+};
+
+template <class T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena* arena) : arena_(arena) {
+    }
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.GetArena()) {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        arena_->Deallocate(ptr, n * sizeof(T));
+    }
+
+    Arena* GetArena() const {
+        return arena_;
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena_ == other.GetArena();
+    }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena_ != other.GetArena();
+    }
+
+private:
+    Arena* arena_;
+};
+
+/* Routes node allocations of the current thread to `arena` while alive */
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena* arena);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena* previous_;
+};
+
+Arena* GetCurrentArena();
+
+template <class T, class... Args>
+std::shared_ptr<T> Allocate(Args&&... args) {
+    Arena* arena = GetCurrentArena();
+    if (arena == nullptr) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+}
+
+}  /* namespace calculus */
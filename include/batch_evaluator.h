@@ -0,0 +1,66 @@
+#pragma once
+
+#include "bytecode.h"
+#include "gradient_tape.h"
+#include "thread_pool.h"
+
+namespace calculus {
+
+/* Rows per scheduled chunk: large enough to amortize scheduling, small enough for the
+ * chunk's columns to stay in a core's cache */
+constexpr size_t kDefaultBatchChunkRows = 16 * kBatchBlockSize;
+
+/* Evaluates one program over large column tables, splitting them into chunks that run on
+ * a ThreadPool. Each thread keeps one register file that grows to the largest program it
+ * has run, so once the threads are warm evaluating a table allocates nothing per chunk. */
+class BatchEvaluator {
+public:
+    /* Without a pool the table is evaluated on the calling thread */
+    explicit BatchEvaluator(BytecodeProgram program, ThreadPool* pool = GetCurrentThreadPool(),
+                            size_t chunk_rows = kDefaultBatchChunkRows);
+
+    /* Same contract as BytecodeProgram::Compile() */
+    explicit BatchEvaluator(const ExpressionPtr& expr, ThreadPool* pool = GetCurrentThreadPool(),
+                            size_t chunk_rows = kDefaultBatchChunkRows);
+
+    /* `variables` and `result` follow BytecodeProgram::EvaluateBatch(); `result` must hold
+     * `count` values and is written by the chunks directly */
+    void Evaluate(const double* const* variables, size_t count, double* result) const;
+
+    /* Values and derivatives along `direction` (kVariableCount values) for every row, each
+     * output holding `count` values. Runs the dual-number interpreter row by row. */
+    void EvaluateDual(const double* const* variables, const double* direction, size_t count, double* values,
+                      double* derivatives) const;
+
+    /* Values and full gradients for every row by reverse sweeps over the program's tape,
+     * `gradient` follows GradientTape::EvaluateBatch() */
+    void EvaluateGradient(const double* const* variables, size_t count, double* values,
+                          double* const* gradient) const;
+
+    const BytecodeProgram& GetProgram() const {
+        return program_;
+    }
+
+    size_t GetChunkRows() const {
+        return chunk_rows_;
+    }
+
+private:
+    void EvaluateChunk(const double* const* variables, size_t begin, size_t size, double* result) const;
+    void EvaluateDualChunk(const double* const* variables, const double* direction, size_t begin, size_t size,
+                           double* values, double* derivatives) const;
+
+    void EvaluateGradientChunk(const double* const* variables, size_t begin, size_t size, double* values,
+                               double* const* gradient) const;
+
+    template <class Body>
+    void ForEachChunk(size_t count, const Body& body) const;
+
+    BytecodeProgram program_;
+    GradientTape tape_;
+    ThreadPool* pool_;
+    size_t chunk_rows_;
+    SimdLevel level_;
+};
+
+}  /* namespace calculus */
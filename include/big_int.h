@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace calculus {
+
+/* Arbitrary precision signed integer: a sign and the magnitude in base 2 ^ 32, least
+ * significant limb first, without leading zero limbs (zero has none). Division truncates
+ * toward zero like the built-in one and throws RuntimeError on a zero divisor. */
+class BigInt {
+public:
+    BigInt() = default;
+    BigInt(int64_t value);
+
+    /* The integral part of a finite `value` */
+    static BigInt FromDouble(double value);
+
+    bool IsZero() const {
+        return limbs_.empty();
+    }
+
+    bool IsNegative() const {
+        return negative_;
+    }
+
+    size_t BitLength() const;
+    bool FitsInt64() const;
+    int64_t ToInt64() const;
+    /* The nearest double, infinite if out of range */
+    double ToDouble() const;
+    std::string ToString() const;
+    size_t Hash() const;
+
+    BigInt operator-() const;
+    BigInt Abs() const;
+
+    BigInt& operator+=(const BigInt& other);
+    BigInt& operator-=(const BigInt& other);
+    BigInt& operator*=(const BigInt& other);
+    BigInt& operator/=(const BigInt& other);
+    BigInt& operator%=(const BigInt& other);
+    BigInt& operator<<=(size_t bits);
+
+    friend BigInt operator+(BigInt lhs, const BigInt& rhs) {
+        return lhs += rhs;
+    }
+
+    friend BigInt operator-(BigInt lhs, const BigInt& rhs) {
+        return lhs -= rhs;
+    }
+
+    friend BigInt operator*(BigInt lhs, const BigInt& rhs) {
+        return lhs *= rhs;
+    }
+
+    friend BigInt operator/(BigInt lhs, const BigInt& rhs) {
+        return lhs /= rhs;
+    }
+
+    friend BigInt operator%(BigInt lhs, const BigInt& rhs) {
+        return lhs %= rhs;
+    }
+
+    static void DivMod(const BigInt& lhs, const BigInt& rhs, BigInt* quotient, BigInt* remainder);
+    /* Non-negative, zero only for two zeros */
+    static BigInt Gcd(BigInt lhs, BigInt rhs);
+    static int Compare(const BigInt& lhs, const BigInt& rhs);
+
+    friend bool operator==(const BigInt& lhs, const BigInt& rhs) {
+        return lhs.negative_ == rhs.negative_ && lhs.limbs_ == rhs.limbs_;
+    }
+
+    friend bool operator!=(const BigInt& lhs, const BigInt& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator<(const BigInt& lhs, const BigInt& rhs) {
+        return Compare(lhs, rhs) < 0;
+    }
+
+    friend bool operator>(const BigInt& lhs, const BigInt& rhs) {
+        return Compare(lhs, rhs) > 0;
+    }
+
+    friend bool operator<=(const BigInt& lhs, const BigInt& rhs) {
+        return Compare(lhs, rhs) <= 0;
+    }
+
+    friend bool operator>=(const BigInt& lhs, const BigInt& rhs) {
+        return Compare(lhs, rhs) >= 0;
+    }
+
+private:
+    using Limbs = std::vector<uint32_t>;
+
+    static int CompareMagnitudes(const Limbs& lhs, const Limbs& rhs);
+    /* lhs += rhs and lhs -= rhs on magnitudes, the latter for lhs >= rhs */
+    static void AddMagnitude(Limbs* lhs, const Limbs& rhs);
+    static void SubtractMagnitude(Limbs* lhs, const Limbs& rhs);
+    static void DivModMagnitudes(const Limbs& lhs, const Limbs& rhs, Limbs* quotient, Limbs* remainder);
+    /* Adds a magnitude with the given sign */
+    void Add(const Limbs& magnitude, bool negative);
+    void Trim();
+
+    bool negative_ = false;
+    Limbs limbs_;
+};
+
+}  /* namespace calculus */
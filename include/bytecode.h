@@ -0,0 +1,116 @@
+#pragma once
+
+#include "expression.h"
+#include "dual.h"
+
+#include <ostream>
+
+namespace calculus {
+
+/* Variables are the lowercase letters, variable `c` lives at index c - 'a' */
+constexpr size_t kVariableCount = 26;
+
+enum class OpCode : uint8_t {
+    kLoadConstant,
+    kLoadVariable,
+    kAdd,
+    kSub,
+    kMul,
+    kDiv,
+    kNeg,
+    kPow,
+    kSqrt,
+    kSin,
+    kCos,
+    kLog,
+    kExp,
+};
+
+constexpr size_t kOpCodeCount = static_cast<size_t>(OpCode::kExp) + 1;
+
+/* Rows are evaluated in blocks of this size, each register holding one value per row */
+constexpr size_t kBatchBlockSize = 256;
+
+enum class SimdLevel : uint8_t {
+    kScalar,
+    kAvx2,
+    kAvx512,
+};
+
+/* The widest instruction set both compiled in and supported by the CPU */
+SimdLevel GetSimdLevel();
+
+/* dst = lhs <op> rhs. For loads lhs is an index into the constant table or the variable
+ * array, unary operations only read lhs. */
+struct Instruction {
+    OpCode op;
+    uint32_t dst;
+    uint32_t lhs;
+    uint32_t rhs;
+};
+
+/* Straight-line register program computing an expression. Instructions are in topological
+ * order, common subexpressions are computed once and registers are reused after the last
+ * read of their value. */
+class BytecodeProgram {
+public:
+    /* Throws RuntimeError for nodes without a numeric value: derivatives and substitutions
+     * left unsimplified, calls of unknown functions, bare functions */
+    static BytecodeProgram Compile(const ExpressionPtr& expr);
+
+    /* `variables` holds kVariableCount values, `registers` at least GetRegisterCount() */
+    double Evaluate(const double* variables, double* registers) const;
+    double Evaluate(const double* variables) const;
+
+    /* Value and derivative along `direction` (kVariableCount values, like `variables`) in
+     * one run of the program over dual numbers */
+    Dual EvaluateDual(const double* variables, const double* direction, Dual* registers) const;
+    Dual EvaluateDual(const double* variables, const double* direction) const;
+
+    /* Evaluates `count` rows given as columns: variables[c] points to the values of variable
+     * 'a' + c and may be nullptr for variables the program does not read. Measured against
+     * glibc, the vector kernels are off by at most 1 ulp for sin, cos, exp and log and 2 ulp
+     * for pow; lanes outside their ranges (|x| > 1e5 for sin and cos, exponents above 16 in
+     * magnitude for pow) take the libm functions. */
+    void EvaluateBatch(const double* const* variables, size_t count, double* result) const;
+    void EvaluateBatch(const double* const* variables, size_t count, double* result, SimdLevel level) const;
+
+    /* As above with caller-provided scratch space of GetBatchScratchSize() doubles */
+    void EvaluateBatch(const double* const* variables, size_t count, double* result, SimdLevel level,
+                       double* registers) const;
+
+    size_t GetBatchScratchSize() const {
+        return register_count_ * kBatchBlockSize;
+    }
+
+    void Print(std::ostream& out) const;
+
+    const std::vector<Instruction>& GetInstructions() const {
+        return code_;
+    }
+
+    const std::vector<double>& GetConstants() const {
+        return constants_;
+    }
+
+    size_t GetRegisterCount() const {
+        return register_count_;
+    }
+
+    uint32_t GetResultRegister() const {
+        return result_;
+    }
+
+private:
+    template <class Number>
+    Number Execute(const Number* variables, Number* registers) const;
+
+    std::vector<Instruction> code_;
+    std::vector<double> constants_;
+    size_t register_count_ = 0;
+    uint32_t result_ = 0;
+
+    friend class BytecodeCompiler;
+};
+
+}  /* namespace calculus */
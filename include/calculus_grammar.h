@@ -14,6 +14,7 @@
 #include "variable.h"
 #include "constant.h"
 #include "function.h"
+#include "intern_table.h"
 
 DEFGRAMMAR(Calculus)
     DEFBASICNODE()
@@ -49,7 +50,7 @@ DEFGRAMMAR(Calculus)
 
         DEFRULE(Expression)
             virtual calculus::ExpressionPtr BuildExpression() override {
-                auto result = std::make_shared<calculus::Sum>();
+                auto result = calculus::Allocate<calculus::Sum>();
                 result->ReserveSize((children_.size() + 1) / 2);
 
                 *result += children_[0]->BuildExpression();
@@ -74,7 +75,7 @@ DEFGRAMMAR(Calculus)
 
         DEFRULE(Term)
             virtual calculus::ExpressionPtr BuildExpression() override {
-                auto result = std::make_shared<calculus::Product>();
+                auto result = calculus::Allocate<calculus::Product>();
                 result->ReserveSize((children_.size() + 1) / 2);
 
                 *result *= children_[0]->BuildExpression();
@@ -111,11 +112,11 @@ DEFGRAMMAR(Calculus)
                         case kDiffOpType:
                         {
                             if (op->GetChildren().empty()) {
-                                result = std::make_shared<calculus::DifferentiateOp>(result, calculus::kDefaultDerivativeVariable);
+                                result = calculus::Make<calculus::DifferentiateOp>(result, calculus::kDefaultDerivativeVariable);
                             } else {
                                 const std::string& name = dynamic_cast<const IdentifierNode*>(op->GetChildren()[0].get())->GetStr();
                                 if (name.size() == 1 && std::islower(name[0])) {
-                                    result = std::make_shared<calculus::DifferentiateOp>(result, name[0]);
+                                    result = calculus::Make<calculus::DifferentiateOp>(result, name[0]);
                                 } else {
                                     throw SyntaxError("Bad variable name");
                                 }
@@ -129,21 +130,29 @@ DEFGRAMMAR(Calculus)
                             for (const auto& arg : op->GetChildren()[0]->GetChildren()) {
                                 args.push_back(arg->BuildExpression());
                             }
-                            result = std::make_shared<calculus::CallOp>(result, std::move(args));
+                            result = calculus::Make<calculus::CallOp>(result, std::move(args));
                             break;
                         }
                         case kPowerOpType:
                         {
-                            result = std::make_shared<calculus::PowerOp>(result, op->GetChildren()[0]->BuildExpression());
+                            result = calculus::Make<calculus::PowerOp>(result, op->GetChildren()[0]->BuildExpression());
                             break;
                         }
                         case kSubstOpType:
                         {
-                            const std::string& name = dynamic_cast<const IdentifierNode*>(op->GetChildren()[0].get())->GetStr();
-                            if (name.size() != 1 || !std::islower(name[0])) {
-                                throw SyntaxError("Bad variable name");
+                            const auto& children = op->GetChildren();
+                            calculus::Bindings bindings;
+                            for (size_t i = 0; i + 1 < children.size(); i += 2) {
+                                const std::string& name = dynamic_cast<const IdentifierNode*>(children[i].get())->GetStr();
+                                if (name.size() != 1 || !std::islower(name[0])) {
+                                    throw SyntaxError("Bad variable name");
+                                }
+                                if (bindings.Find(name[0]) != nullptr) {
+                                    throw SyntaxError("Variable " + name + " is substituted twice");
+                                }
+                                bindings.Bind(name[0], children[i + 1]->BuildExpression());
                             }
-                            result = std::make_shared<calculus::SubstOp>(result, name[0], op->GetChildren()[1]->BuildExpression());
+                            result = calculus::Make<calculus::SubstOp>(result, std::move(bindings));
                             break;
                         }
                         default:
@@ -153,7 +162,7 @@ DEFGRAMMAR(Calculus)
 
                 /* We now have only one type of prefix operators, so ... */
                 if (atom_pos % 2 == 1) {
-                    result = std::make_shared<calculus::NegateOp>(result);
+                    result = calculus::Make<calculus::NegateOp>(result);
                 }
 
                 return result;
@@ -247,6 +256,12 @@ DEFGRAMMAR(Calculus)
             EXPECT(name, TOKEN(Identifier));
             TOKEN(Assign);
             EXPECT(value, RULE(Expression));
+            ASTERISK({
+                TOKEN(Comma);
+                EXPECT(next_name, TOKEN(Identifier));
+                TOKEN(Assign);
+                EXPECT(next_value, RULE(Expression));
+            });
             TOKEN(RightBracket);
         ENDRULE(SubstOp)
 
@@ -286,11 +301,11 @@ DEFGRAMMAR(Calculus)
         DEFTOKEN(Identifier, "[[:alpha:]][[:alnum:]_]*")
             virtual calculus::ExpressionPtr BuildExpression() override {
                 if (str_.size() == 1 && std::islower(str_[0])) {
-                    return std::make_shared<calculus::Variable>(str_[0]);
+                    return calculus::Make<calculus::Variable>(str_[0]);
                 } else if (str_ == "pi") {
                     return calculus::kConstantPi;
                 } else {
-                    return std::make_shared<calculus::Function>(str_);
+                    return calculus::Make<calculus::Function>(str_);
                 }
             }
             TOKEN_PRINT
@@ -313,7 +328,7 @@ DEFGRAMMAR(Calculus)
 
         DEFTOKEN(Number, "([0-9]+(\\.[0-9]*)?|[0-9]*\\.[0-9]+)([eE][-\\+]?[0-9]+)?")
             virtual calculus::ExpressionPtr BuildExpression() override {
-                return std::make_shared<calculus::Constant>(std::stod(str_));
+                return calculus::Make<calculus::Constant>(calculus::Number::Parse(str_));
             }
             TOKEN_PRINT
         ENDTOKEN()
@@ -6,25 +6,49 @@ namespace calculus {
 
 class CallOp : public Expression {
 public:
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
+    static constexpr ExpressionKind kKind = ExpressionKind::kCallOp;
+
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
 
-    explicit CallOp(const ExpressionPtr& func) : func_(func) {
+    /* A call is a value even if its callee is a function */
+    explicit CallOp(const ExpressionPtr& func) : Expression(kKind), func_(func) {
+        hash_ = ComputeHash();
+        AddChild(func_);
+        free_variables_ = (free_variables_ & ~kFunctionValuedMask) | kNonPolynomialMask;
     }
 
     template <class Vector>
-    CallOp(const ExpressionPtr& func, Vector&& args) : func_(func), args_(std::forward<Vector>(args)) {
+    CallOp(const ExpressionPtr& func, Vector&& args) : Expression(kKind), func_(func), args_(std::forward<Vector>(args)) {
+        hash_ = ComputeHash();
+        AddChild(func_);
+        free_variables_ = (free_variables_ & ~kFunctionValuedMask) | kNonPolynomialMask;
+        for (const auto& arg : args_) {
+            AddChild(arg);
+        }
     }
 
     void ReserveSize(int size);
     void AddArgument(ExpressionPtr& arg);
 
+    const ExpressionPtr& GetFunction() const {
+        return func_;
+    }
+
+    const std::vector<ExpressionPtr>& GetArguments() const {
+        return args_;
+    }
+
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     ExpressionPtr func_;
     std::vector<ExpressionPtr> args_;
 };
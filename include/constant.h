@@ -1,27 +1,41 @@
 #pragma once
 
 #include "expression.h"
+#include "number.h"
 
 namespace calculus {
 
 class Constant : public Expression {
 public:
-    explicit Constant(double value) : value_(value) {
+    static constexpr ExpressionKind kKind = ExpressionKind::kConstant;
+
+    explicit Constant(const Number& number) : Expression(kKind), number_(number), value_(number.ToDouble()) {
+        hash_ = ComputeHash();
     }
 
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
 
+    const Number& GetNumber() const {
+        return number_;
+    }
+
+    /* The number as a double, for evaluation and heuristics */
     double GetValue() const {
         return value_;
     }
 
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
+    Number number_;
     double value_;
 };
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "expression.h"
+#include "lru_cache.h"
+
+namespace calculus {
+
+constexpr size_t kDefaultDerivativeCacheCapacity = 1 << 16;
+
+struct DerivativeKey {
+    ExpressionPtr expr;
+    char var_name;
+};
+
+struct DerivativeKeyHash {
+    size_t operator()(const DerivativeKey& key) const {
+        return key.expr->GetHash() * 31 + key.var_name;
+    }
+};
+
+struct DerivativeKeyEqual {
+    bool operator()(const DerivativeKey& lhs, const DerivativeKey& rhs) const {
+        return lhs.var_name == rhs.var_name && lhs.expr->DeepCompare(rhs.expr);
+    }
+};
+
+/* Maps (expression, variable) to the result of TakeDerivative(). Like SimplifyCache,
+ * it keeps its entries alive until cleared and may be used from several threads at once. */
+class DerivativeCache : public SharedLruCache<DerivativeKey, ExpressionPtr, DerivativeKeyHash, DerivativeKeyEqual> {
+public:
+    explicit DerivativeCache(size_t capacity = kDefaultDerivativeCacheCapacity) : SharedLruCache(capacity) {
+    }
+};
+
+/* Makes TakeDerivative() on the current thread consult `cache` while alive */
+class DerivativeCacheScope {
+public:
+    explicit DerivativeCacheScope(DerivativeCache* cache);
+    ~DerivativeCacheScope();
+
+    DerivativeCacheScope(const DerivativeCacheScope&) = delete;
+    DerivativeCacheScope& operator=(const DerivativeCacheScope&) = delete;
+
+private:
+    DerivativeCache* previous_;
+};
+
+DerivativeCache* GetCurrentDerivativeCache();
+
+}  /* namespace calculus */
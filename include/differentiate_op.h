@@ -6,18 +6,35 @@ namespace calculus {
 
 class DifferentiateOp : public Expression {
 public:
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
+    static constexpr ExpressionKind kKind = ExpressionKind::kDifferentiateOp;
+
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
 
-    DifferentiateOp(const ExpressionPtr& expr, char var_name) : expr_(expr), var_name_(var_name) {
+    DifferentiateOp(const ExpressionPtr& expr, char var_name) : Expression(kKind), expr_(expr), var_name_(var_name) {
+        hash_ = ComputeHash();
+        AddChild(expr_);
+        free_variables_ |= kNonPolynomialMask;
+    }
+
+    const ExpressionPtr& GetInnerExpr() const {
+        return expr_;
     }
 
+    char GetVariable() const {
+        return var_name_;
+    }
+
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     ExpressionPtr expr_;
     char var_name_;
 };
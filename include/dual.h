@@ -0,0 +1,77 @@
+#pragma once
+
+#include "expression.h"
+
+#include <cmath>
+
+namespace calculus {
+
+/* value + derivative * eps with eps^2 = 0: arithmetic on duals carries the derivative
+ * along a direction through the computation */
+struct Dual {
+    double value = 0;
+    double derivative = 0;
+
+    Dual() = default;
+
+    Dual(double value, double derivative = 0) : value(value), derivative(derivative) {
+    }
+};
+
+inline Dual operator+(const Dual& lhs, const Dual& rhs) {
+    return {lhs.value + rhs.value, lhs.derivative + rhs.derivative};
+}
+
+inline Dual operator-(const Dual& lhs, const Dual& rhs) {
+    return {lhs.value - rhs.value, lhs.derivative - rhs.derivative};
+}
+
+inline Dual operator-(const Dual& x) {
+    return {-x.value, -x.derivative};
+}
+
+inline Dual operator*(const Dual& lhs, const Dual& rhs) {
+    return {lhs.value * rhs.value, lhs.derivative * rhs.value + lhs.value * rhs.derivative};
+}
+
+inline Dual operator/(const Dual& lhs, const Dual& rhs) {
+    return {lhs.value / rhs.value, (lhs.derivative * rhs.value - lhs.value * rhs.derivative) / (rhs.value * rhs.value)};
+}
+
+inline Dual Sqrt(const Dual& x) {
+    double value = std::sqrt(x.value);
+    return {value, x.derivative / (2 * value)};
+}
+
+inline Dual Sin(const Dual& x) {
+    return {std::sin(x.value), std::cos(x.value) * x.derivative};
+}
+
+inline Dual Cos(const Dual& x) {
+    return {std::cos(x.value), -std::sin(x.value) * x.derivative};
+}
+
+inline Dual Log(const Dual& x) {
+    return {std::log(x.value), x.derivative / x.value};
+}
+
+inline Dual Exp(const Dual& x) {
+    double value = std::exp(x.value);
+    return {value, value * x.derivative};
+}
+
+/* An exponent with no derivative takes the power rule, which stays defined for negative bases */
+inline Dual Pow(const Dual& base, const Dual& exp) {
+    double value = std::pow(base.value, exp.value);
+    if (exp.derivative == 0) {
+        return {value, exp.value * std::pow(base.value, exp.value - 1) * base.derivative};
+    }
+    return {value, value * (exp.derivative * std::log(base.value) + exp.value * base.derivative / base.value)};
+}
+
+/* Value and directional derivative of `expr` at `variables` along `direction`, both holding
+ * one value per lowercase letter, computed in a single walk over the expression. Derivative
+ * and substitution nodes are evaluated in place; calls of unknown functions throw RuntimeError. */
+Dual EvaluateDual(const ExpressionPtr& expr, const double* variables, const double* direction);
+
+}  /* namespace calculus */
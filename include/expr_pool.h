@@ -0,0 +1,115 @@
+#pragma once
+
+#include "expression.h"
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace calculus {
+
+using NodeIndex = uint32_t;
+
+constexpr NodeIndex kInvalidNodeIndex = UINT32_MAX;
+
+/* Node layout by kind:
+ *   Constant         first = index into the constant table
+ *   Variable         variable
+ *   Function         first = index into the name table
+ *   Sum, Product     [first, first + second) = slice of the operand buffer
+ *   PowerOp          first = base, second = exponent
+ *   NegateOp         first = inner expression
+ *   CallOp           [first, first + second) = function followed by the arguments
+ *   DifferentiateOp  first = inner expression, variable
+ *   SubstOp          [first, first + second) = target followed by (variable, value) pairs
+ *                    sorted by variable */
+struct PoolNode {
+    ExpressionKind kind;
+    char variable;
+    uint32_t first;
+    uint32_t second;
+};
+
+struct PoolOperand {
+    NodeIndex index;
+    bool inverse;
+};
+
+/* Hash-consed expression DAG stored in flat arrays. Children always precede their parents,
+ * so a pass in index order visits nodes in topological order. Nodes are never modified:
+ * every rewrite appends new nodes and returns the index of the result. */
+class ExprPool {
+public:
+    NodeIndex AddConstant(double value);
+    NodeIndex AddVariable(char name);
+    NodeIndex AddFunction(const std::string& name);
+    NodeIndex AddSum(const std::vector<PoolOperand>& summands);
+    NodeIndex AddProduct(const std::vector<PoolOperand>& multipliers);
+    NodeIndex AddPower(NodeIndex base, NodeIndex exp);
+    NodeIndex AddNegate(NodeIndex expr);
+    NodeIndex AddCall(NodeIndex func, const std::vector<NodeIndex>& args);
+    NodeIndex AddDerivative(NodeIndex expr, char var_name);
+    NodeIndex AddSubstitution(NodeIndex target, char var_name, NodeIndex value);
+    NodeIndex AddSubstitution(NodeIndex target, std::vector<std::pair<char, NodeIndex>> bindings);
+
+    NodeIndex FromExpression(const ExpressionPtr& expr);
+    ExpressionPtr ToExpression(NodeIndex root) const;
+
+    NodeIndex Simplify(NodeIndex root);
+    NodeIndex TakeDerivative(NodeIndex root, char var_name);
+    NodeIndex Substitute(NodeIndex root, char var_name, NodeIndex value);
+    /* All bindings are applied at once, values are not substituted into */
+    NodeIndex Substitute(NodeIndex root, const std::vector<std::pair<char, NodeIndex>>& bindings);
+    void Print(std::ostream& out, NodeIndex root, int cur_priority_level = -1) const;
+
+    const PoolNode& GetNode(NodeIndex index) const {
+        return nodes_[index];
+    }
+
+    PoolOperand GetOperand(NodeIndex node, uint32_t i) const {
+        uint32_t packed = operands_[nodes_[node].first + i];
+        return {packed & ~kInverseBit, (packed & kInverseBit) != 0};
+    }
+
+    double GetConstant(NodeIndex node) const {
+        return constants_[nodes_[node].first];
+    }
+
+    const std::string& GetFunctionName(NodeIndex node) const {
+        return names_[nodes_[node].first];
+    }
+
+    size_t GetNodeCount() const {
+        return nodes_.size();
+    }
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr uint32_t kInverseBit = 1u << 31;
+
+    NodeIndex AddNode(const PoolNode& node, const std::vector<uint32_t>& slice = {});
+    NodeIndex AddAssociative(ExpressionKind kind, const std::vector<PoolOperand>& operands);
+    bool IsConstant(NodeIndex index) const;
+    bool IsConstant(NodeIndex index, double value) const;
+
+    NodeIndex SimplifyNode(NodeIndex index);
+    NodeIndex SimplifySum(NodeIndex index);
+    NodeIndex SimplifyProduct(NodeIndex index);
+    NodeIndex SimplifyPower(NodeIndex index);
+    NodeIndex SimplifyCall(NodeIndex index);
+    NodeIndex Call(NodeIndex func, const std::vector<NodeIndex>& args);
+    void FlattenOperands(NodeIndex index, bool global_inverse, std::vector<PoolOperand>* result) const;
+    NodeIndex FunctionDerivative(NodeIndex func);
+
+    std::vector<PoolNode> nodes_;
+    std::vector<uint32_t> operands_;
+    std::vector<double> constants_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> name_indices_;
+    std::unordered_multimap<size_t, NodeIndex> node_indices_;
+    std::vector<NodeIndex> simplified_;
+};
+
+}  /* namespace calculus */
@@ -1,13 +1,34 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <stdexcept>
+#include <string>
 
 namespace calculus {
 
 constexpr char kDefaultDerivativeVariable = 'x';
 constexpr double kDoubleTolerance = 1e-12;
+constexpr size_t kMaxExpressionWeight = SIZE_MAX / 2;
+
+/* Free-variable masks hold bit c - 'a' for every lowercase variable c a node depends on.
+ * The extra bit marks function-valued subtrees, e.g. `sin` or `f'_x` on their own, which
+ * TakeDerivative() differentiates as functions rather than by a variable. */
+constexpr uint32_t kFunctionValuedMask = uint32_t(1) << 26;
+
+/* Set on subtrees that are not polynomials with numeric coefficients: calls, functions,
+ * unevaluated derivatives and substitutions, division by a non-constant and powers whose
+ * exponent is not a non-negative integer constant */
+constexpr uint32_t kNonPolynomialMask = uint32_t(1) << 27;
+
+/* Zero for names outside 'a'..'z', which are never assumed absent */
+constexpr uint32_t VariableMask(char name) {
+    return name >= 'a' && name <= 'z' ? uint32_t(1) << (name - 'a') : 0;
+}
 
 constexpr int kSumPriorityLevel = 0;
 constexpr int kProdPriorityLevel = 10;
@@ -20,21 +41,156 @@ public:
     }
 };
 
+enum class ExpressionKind : uint8_t {
+    kConstant,
+    kVariable,
+    kFunction,
+    kSum,
+    kProduct,
+    kPowerOp,
+    kNegateOp,
+    kCallOp,
+    kDifferentiateOp,
+    kSubstOp,
+};
+
+class Bindings;
+
 class Expression : public std::enable_shared_from_this<Expression> {
 public:
     using ExpressionPtr = std::shared_ptr<Expression>;
-    virtual ~Expression() = default;
-    virtual ExpressionPtr Simplify() = 0;
-    virtual ExpressionPtr TakeDerivative(char var_name) = 0;
+
+    explicit Expression(ExpressionKind kind) : kind_(kind) {
+    }
+
+    virtual ~Expression();
+
+    /* Returns the node itself if it is known to be in normal form, otherwise consults
+     * the current SimplifyCache, if any, before calling DoSimplify() */
+    ExpressionPtr Simplify();
+
+    /* Zero if the node cannot depend on the variable, otherwise consults the current
+     * DerivativeCache, if any, before calling DoTakeDerivative() */
+    ExpressionPtr TakeDerivative(char var_name);
+
+    /* Replaces every bound variable by its value in one pass. Subtrees none of the bound
+     * variables is free in are returned as they are, not copied. */
+    ExpressionPtr Substitute(const Bindings& bindings);
+    ExpressionPtr Substitute(char var_name, const ExpressionPtr& value);
+
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) = 0;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) = 0;
     virtual void Print(std::ostream& out, int cur_priority_level = -1) const = 0;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const = 0;
     virtual bool DeepCompare(const ExpressionPtr& other) const = 0;
+
+    ExpressionKind GetKind() const {
+        return kind_;
+    }
+
+    size_t GetHash() const {
+        return hash_;
+    }
+
+    bool IsInterned() const {
+        return interned_;
+    }
+
+    /* True once Simplify() has been observed to leave the node unchanged */
+    bool IsNormalForm() const {
+        return normal_form_.load(std::memory_order_relaxed);
+    }
+
+    /* Number of nodes in the expression tree, with shared subtrees counted once per use */
+    size_t GetWeight() const {
+        return weight_;
+    }
+
+    uint32_t GetFreeVariables() const {
+        return free_variables_;
+    }
+
+    bool IsPolynomial() const {
+        return (free_variables_ & kNonPolynomialMask) == 0;
+    }
+
+    /* False only if the derivative by the variable is known to vanish */
+    bool MayDependOn(char var_name) const {
+        uint32_t mask = VariableMask(var_name);
+        return mask == 0 || (free_variables_ & (mask | kFunctionValuedMask)) != 0;
+    }
+
+protected:
+    virtual ExpressionPtr DoSimplify() = 0;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) = 0;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) = 0;
+
+    void AddChild(const ExpressionPtr& child) {
+        weight_ = std::min(weight_ + child->weight_, kMaxExpressionWeight);
+        free_variables_ |= child->free_variables_;
+    }
+
+    size_t hash_ = 0;
+    size_t weight_ = 1;
+    uint32_t free_variables_ = 0;
+
+private:
+    void MarkIfNormalForm(const ExpressionPtr& simplified);
+
+    ExpressionKind kind_;
+    bool interned_ = false;
+    std::atomic<bool> normal_form_{false};
+
+    friend ExpressionPtr Intern(ExpressionPtr expr);
 };
 
 using ExpressionPtr = std::shared_ptr<Expression>;
 
+struct ExpressionHash {
+    size_t operator()(const ExpressionPtr& expr) const {
+        return expr->GetHash();
+    }
+};
+
+struct ExpressionEqual {
+    bool operator()(const ExpressionPtr& lhs, const ExpressionPtr& rhs) const {
+        return lhs->DeepCompare(rhs);
+    }
+};
+
+struct Binding {
+    char var_name;
+    ExpressionPtr value;
+};
+
+/* Values for lowercase variables, substituted simultaneously: [x = y, y = x] swaps the two.
+ * Entries are kept sorted by variable. */
+class Bindings {
+public:
+    Bindings() = default;
+
+    Bindings(char var_name, const ExpressionPtr& value) {
+        Bind(var_name, value);
+    }
+
+    /* Replaces an earlier value of the variable, throws RuntimeError for other names */
+    void Bind(char var_name, const ExpressionPtr& value);
+
+    /* nullptr if the variable is not bound */
+    const ExpressionPtr* Find(char var_name) const;
+
+    uint32_t GetMask() const {
+        return mask_;
+    }
+
+    const std::vector<Binding>& GetEntries() const {
+        return entries_;
+    }
+
+private:
+    std::vector<Binding> entries_;
+    uint32_t mask_ = 0;
+};
+
 struct AssociativeOperand {
     ExpressionPtr expr;
     bool inverse;
@@ -46,6 +202,17 @@ struct AssociativeOperand {
     AssociativeOperand() = default;
 };
 
-double Ratio(const ExpressionPtr& lhs, const ExpressionPtr& rhs);
+class Number;
+
+/* Sets *ratio to the constant lhs / rhs and returns true if lhs is rhs times a constant */
+bool Ratio(const ExpressionPtr& lhs, const ExpressionPtr& rhs, Number* ratio);
+
+/* Total order used for the operands of simplified sums and products: constants go last,
+ * the rest is ordered by kind, then by name or value for leaves and by hash otherwise.
+ * Returns a negative number, zero or a positive number, zero for equal expressions. */
+int CompareExpressions(const ExpressionPtr& lhs, const ExpressionPtr& rhs);
+
+/* Operands without the inverse flag first, each group in the order above */
+bool CanonicalOperandLess(const AssociativeOperand& lhs, const AssociativeOperand& rhs);
 
 }  /* namespace calculus */
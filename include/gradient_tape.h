@@ -0,0 +1,56 @@
+#pragma once
+
+#include "bytecode.h"
+
+namespace calculus {
+
+/* dst = lhs <op> rhs with every operation writing its own slot, so the values of one forward
+ * run stay available to the backward sweep */
+struct TapeEntry {
+    OpCode op;
+    bool active;    /* depends on some variable, i.e. has a nonzero adjoint in general */
+    uint32_t lhs;
+    uint32_t rhs;
+};
+
+/* Reverse-mode differentiation of a compiled expression: one forward run records every
+ * intermediate value, one backward sweep then accumulates the derivatives with respect to
+ * all variables at once. */
+class GradientTape {
+public:
+    explicit GradientTape(const BytecodeProgram& program);
+
+    /* Same contract as BytecodeProgram::Compile() */
+    static GradientTape Compile(const ExpressionPtr& expr);
+
+    /* Returns the value at `variables` and writes the partial derivatives by each of the
+     * kVariableCount variables to `gradient`, zero for the ones the expression does not read.
+     * `scratch` holds at least GetScratchSize() values. */
+    double Evaluate(const double* variables, double* gradient, double* scratch) const;
+    double Evaluate(const double* variables, double* gradient) const;
+
+    /* `variables` and `values` follow BytecodeProgram::EvaluateBatch(). gradient[c] receives
+     * `count` derivatives by variable 'a' + c, or is nullptr if those are not wanted. */
+    void EvaluateBatch(const double* const* variables, size_t count, double* values, double* const* gradient) const;
+    void EvaluateBatch(const double* const* variables, size_t count, double* values, double* const* gradient,
+                       SimdLevel level, double* scratch) const;
+
+    size_t GetScratchSize() const {
+        return 2 * entries_.size();
+    }
+
+    size_t GetBatchScratchSize() const {
+        return (2 * entries_.size() + 1) * kBatchBlockSize;
+    }
+
+    const std::vector<TapeEntry>& GetEntries() const {
+        return entries_;
+    }
+
+private:
+    std::vector<TapeEntry> entries_;
+    std::vector<double> constants_;
+    uint32_t result_ = 0;
+};
+
+}  /* namespace calculus */
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "expression.h"
+#include "arena.h"
+
+namespace calculus {
+
+/* Returns the canonical instance structurally equal to `expr`, registering `expr` if there is none yet.
+ * Interned nodes must never be modified afterwards. */
+ExpressionPtr Intern(ExpressionPtr expr);
+
+size_t GetInternTableSize();
+
+template <class T, class... Args>
+ExpressionPtr Make(Args&&... args) {
+    return Intern(Allocate<T>(std::forward<Args>(args)...));
+}
+
+}  /* namespace calculus */
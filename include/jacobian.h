@@ -0,0 +1,59 @@
+#pragma once
+
+#include "expression.h"
+
+#include <string>
+
+namespace calculus {
+
+/* Row-major matrix of simplified expressions. Entries known to vanish from the variable
+ * dependencies alone hold the constant 0 and are flagged as structural zeros. */
+class ExpressionMatrix {
+public:
+    ExpressionMatrix(size_t rows, size_t columns);
+
+    const ExpressionPtr& At(size_t row, size_t column) const {
+        return entries_[row * columns_ + column];
+    }
+
+    bool IsStructuralZero(size_t row, size_t column) const {
+        return structural_zeros_[row * columns_ + column];
+    }
+
+    void Set(size_t row, size_t column, const ExpressionPtr& expr);
+
+    size_t GetRows() const {
+        return rows_;
+    }
+
+    size_t GetColumns() const {
+        return columns_;
+    }
+
+private:
+    size_t rows_;
+    size_t columns_;
+    std::vector<ExpressionPtr> entries_;
+    std::vector<bool> structural_zeros_;
+};
+
+/* The functions below take the variables to differentiate by as a string of lowercase
+ * letters, e.g. "xyz", and throw RuntimeError for anything else. All entries are derived
+ * from one simplified form of the input under shared simplify and derivative caches (the
+ * current ones if set), so common subterms are computed once and shared between entries. */
+
+/* Partial derivatives of `expr`, one per variable */
+std::vector<ExpressionPtr> Gradient(const ExpressionPtr& expr, const std::string& variables);
+
+/* Row i holds the gradient of exprs[i] */
+ExpressionMatrix Jacobian(const std::vector<ExpressionPtr>& exprs, const std::string& variables);
+
+/* Symmetric, each mixed partial derivative is derived once */
+ExpressionMatrix Hessian(const ExpressionPtr& expr, const std::string& variables);
+
+/* The Hessian times `direction` (one expression per variable, not depending on them) as the
+ * gradient of the directional derivative, without deriving the Hessian itself */
+std::vector<ExpressionPtr> HessianVectorProduct(const ExpressionPtr& expr, const std::string& variables,
+                                                const std::vector<ExpressionPtr>& direction);
+
+}  /* namespace calculus */
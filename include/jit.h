@@ -0,0 +1,70 @@
+#pragma once
+
+#include "bytecode.h"
+#include "lru_cache.h"
+
+#include <mutex>
+
+namespace calculus {
+
+constexpr size_t kDefaultJitCacheCapacity = 256;
+
+/* Native x86-64 code for a bytecode program. Where no code can be generated, e.g. on other
+ * architectures or when executable memory is refused, Evaluate() runs the bytecode
+ * interpreter instead. */
+class JitFunction {
+public:
+    explicit JitFunction(BytecodeProgram program);
+    ~JitFunction();
+
+    JitFunction(const JitFunction&) = delete;
+    JitFunction& operator=(const JitFunction&) = delete;
+
+    /* Same contract as BytecodeProgram::Compile() */
+    static std::shared_ptr<JitFunction> Compile(const ExpressionPtr& expr);
+
+    /* `variables` holds kVariableCount values */
+    double Evaluate(const double* variables) const {
+        return native_ != nullptr ? native_(variables) : program_.Evaluate(variables);
+    }
+
+    bool IsNative() const {
+        return native_ != nullptr;
+    }
+
+    size_t GetCodeSize() const {
+        return code_size_;
+    }
+
+    const BytecodeProgram& GetProgram() const {
+        return program_;
+    }
+
+private:
+    using NativeFunction = double (*)(const double* variables);
+
+    BytecodeProgram program_;
+    void* code_ = nullptr;
+    size_t code_size_ = 0;
+    NativeFunction native_ = nullptr;
+};
+
+/* Compiled functions by expression, shared between threads. Entries keep their expressions
+ * alive, so clear the cache before resetting the arena they were allocated from. */
+class JitCache {
+public:
+    explicit JitCache(size_t capacity = kDefaultJitCacheCapacity) : functions_(capacity) {
+    }
+
+    std::shared_ptr<JitFunction> GetOrCompile(const ExpressionPtr& expr);
+    void Clear();
+
+    size_t GetHits();
+    size_t GetMisses();
+
+private:
+    std::mutex mutex_;
+    LruCache<ExpressionPtr, std::shared_ptr<JitFunction>, ExpressionHash, ExpressionEqual> functions_;
+};
+
+}  /* namespace calculus */
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace calculus {
+
+/* Bounded map that evicts the least recently used entry once it is full */
+template <class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity) : capacity_(capacity) {
+    }
+
+    const Value* Find(const Key& key) {
+        auto iter = index_.find(key);
+        if (iter == index_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, iter->second);
+        return &iter->second->second;
+    }
+
+    void Insert(const Key& key, const Value& value) {
+        if (capacity_ == 0) {
+            return;
+        }
+        auto iter = index_.find(key);
+        if (iter != index_.end()) {
+            iter->second->second = value;
+            entries_.splice(entries_.begin(), entries_, iter->second);
+            return;
+        }
+        if (entries_.size() == capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+        entries_.emplace_front(key, value);
+        index_.emplace(key, entries_.begin());
+    }
+
+    void Clear() {
+        index_.clear();
+        entries_.clear();
+    }
+
+    size_t GetSize() const {
+        return entries_.size();
+    }
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    size_t GetHits() const {
+        return hits_;
+    }
+
+    size_t GetMisses() const {
+        return misses_;
+    }
+
+private:
+    using Entry = std::pair<Key, Value>;
+
+    size_t capacity_;
+    std::list<Entry> entries_;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash, Equal> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+/* LruCache behind a mutex, for caches that tasks of a ThreadPool share. Find() copies the
+ * value out, since another thread may evict the entry as soon as the lock is released. */
+template <class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+class SharedLruCache {
+public:
+    explicit SharedLruCache(size_t capacity) : cache_(capacity) {
+    }
+
+    bool Find(const Key& key, Value* value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Value* found = cache_.Find(key);
+        if (found == nullptr) {
+            return false;
+        }
+        *value = *found;
+        return true;
+    }
+
+    void Insert(const Key& key, const Value& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_.Insert(key, value);
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_.Clear();
+    }
+
+    size_t GetSize() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.GetSize();
+    }
+
+    size_t GetCapacity() const {
+        return cache_.GetCapacity();
+    }
+
+    size_t GetHits() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.GetHits();
+    }
+
+    size_t GetMisses() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.GetMisses();
+    }
+
+private:
+    std::mutex mutex_;
+    LruCache<Key, Value, Hash, Equal> cache_;
+};
+
+}  /* namespace calculus */
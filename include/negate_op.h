@@ -6,22 +6,30 @@ namespace calculus {
 
 class NegateOp : public Expression {
 public:
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
+    static constexpr ExpressionKind kKind = ExpressionKind::kNegateOp;
+
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
 
-    explicit NegateOp(const ExpressionPtr& expr) : expr_(expr) {
+    explicit NegateOp(const ExpressionPtr& expr) : Expression(kKind), expr_(expr) {
+        hash_ = ComputeHash();
+        AddChild(expr_);
     }
 
     const ExpressionPtr& GetInnerExpr() const {
         return expr_;
     }
 
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     ExpressionPtr expr_;
 };
 
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "expression.h"
+
+#include <functional>
+
+namespace calculus {
+
+constexpr int kDefaultMaxNormalizePasses = 100;
+
+struct NormalizeResult {
+    ExpressionPtr expr;
+    int passes = 0;
+    bool converged = false;
+    bool oscillating = false;
+};
+
+using NormalizeCallback = std::function<void(const ExpressionPtr& expr, int pass)>;
+
+/* Applies Simplify() until the expression stops changing, an earlier form reappears or
+ * `max_passes` passes are done. `on_pass` is called with the expression before every pass. */
+NormalizeResult Normalize(const ExpressionPtr& expr, int max_passes = kDefaultMaxNormalizePasses,
+                          const NormalizeCallback& on_pass = nullptr);
+
+}  /* namespace calculus */
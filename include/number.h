@@ -0,0 +1,142 @@
+#pragma once
+
+#include "big_int.h"
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+namespace calculus {
+
+// Exact powers with larger results are taken as doubles
+constexpr size_t kMaxExactPowerBits = 1 << 16;
+
+/* Exact rational number, or a double for values not known to be rational: results of
+ * transcendental functions and irrational powers, and whatever is computed from one.
+ * Rationals are kept reduced with a positive denominator, inline as two int64 while both
+ * fit and as two BigInt otherwise, so every value has one representation and numbers
+ * compare and hash exactly. A double never equals a rational, it is ordered after the
+ * rational of the same value. All NaNs are one value, equal to itself and ordered last.
+ * Division by zero throws RuntimeError. */
+class Number {
+public:
+    Number() = default;
+
+    Number(int value) : numerator_(value) {
+    }
+
+    Number(int64_t value);
+
+    // Doubles are taken with Real() only, so that they are not truncated by accident
+    Number(double) = delete;
+
+    static Number Fraction(const BigInt& numerator, const BigInt& denominator);
+    static Number Real(double value);
+    /* The exact value of a decimal literal such as "12", "0.25" or "1.5e-3" */
+    static Number Parse(const std::string& text);
+
+    bool IsRational() const {
+        return kind_ != Kind::kReal;
+    }
+
+    bool IsInteger() const;
+    bool IsZero() const;
+    int Sign() const;
+    double ToDouble() const;
+    /* False unless the number is an integer that fits int64 */
+    bool ToInt64(int64_t* value) const;
+    /* For rationals only */
+    BigInt GetNumerator() const;
+    BigInt GetDenominator() const;
+
+    Number operator-() const;
+    Number Abs() const;
+
+    Number& operator+=(const Number& other);
+    Number& operator-=(const Number& other);
+    Number& operator*=(const Number& other);
+    Number& operator/=(const Number& other);
+
+    friend Number operator+(Number lhs, const Number& rhs) {
+        return lhs += rhs;
+    }
+
+    friend Number operator-(Number lhs, const Number& rhs) {
+        return lhs -= rhs;
+    }
+
+    friend Number operator*(Number lhs, const Number& rhs) {
+        return lhs *= rhs;
+    }
+
+    friend Number operator/(Number lhs, const Number& rhs) {
+        return lhs /= rhs;
+    }
+
+    /* Exact for a rational base and an integral exponent as long as the result takes at most
+     * kMaxExactPowerBits, a double otherwise */
+    Number Pow(const Number& exp) const;
+
+    static int Compare(const Number& lhs, const Number& rhs);
+
+    friend bool operator==(const Number& lhs, const Number& rhs) {
+        return Compare(lhs, rhs) == 0;
+    }
+
+    friend bool operator!=(const Number& lhs, const Number& rhs) {
+        return Compare(lhs, rhs) != 0;
+    }
+
+    friend bool operator<(const Number& lhs, const Number& rhs) {
+        return Compare(lhs, rhs) < 0;
+    }
+
+    friend bool operator>(const Number& lhs, const Number& rhs) {
+        return Compare(lhs, rhs) > 0;
+    }
+
+    friend bool operator<=(const Number& lhs, const Number& rhs) {
+        return Compare(lhs, rhs) <= 0;
+    }
+
+    friend bool operator>=(const Number& lhs, const Number& rhs) {
+        return Compare(lhs, rhs) >= 0;
+    }
+
+    size_t Hash() const;
+
+    /* Integers and fractions with an exact decimal form, i.e. whose denominator divides a
+     * power of ten, are printed as decimals with all their digits, other fractions as "p / q"
+     * (\frac in TeX) and doubles with the stream's settings. Callers parenthesize negative
+     * numbers and fractions where needed. */
+    bool IsPrintedAsFraction() const;
+    void Print(std::ostream& out) const;
+    void TexDump(std::ostream& out) const;
+
+private:
+    enum class Kind : uint8_t {
+        kSmall,
+        kBig,
+        kReal,
+    };
+
+    struct Big {
+        BigInt numerator;
+        BigInt denominator;
+    };
+
+    /* Reduced rationals, inline when they fit */
+    static Number FromSmall(int64_t numerator, int64_t denominator);
+    static Number FromBig(BigInt numerator, BigInt denominator);
+    Big ToBig() const;
+    /* The decimal digits of a fraction printed as a decimal */
+    std::string ToDecimal() const;
+
+    Kind kind_ = Kind::kSmall;
+    int64_t numerator_ = 0;
+    int64_t denominator_ = 1;
+    double real_ = 0;
+    std::shared_ptr<const Big> big_;
+};
+
+}  /* namespace calculus */
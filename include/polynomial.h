@@ -0,0 +1,105 @@
+#pragma once
+
+#include "expression.h"
+#include "number.h"
+
+#include <string>
+#include <vector>
+
+namespace calculus {
+
+constexpr size_t kMaxPolynomialVariables = 8;
+constexpr unsigned kPolynomialExponentBits = 8;
+constexpr unsigned kMaxPolynomialDegree = (1u << kPolynomialExponentBits) - 1;
+
+/* Sparse polynomial with Number coefficients in at most kMaxPolynomialVariables lowercase
+ * variables. A monomial is packed into one word, kPolynomialExponentBits per variable in the
+ * order of GetVariables(), so multiplying two monomials is adding their words. Terms are
+ * kept sorted by monomial and never hold a zero coefficient. Operations whose result would
+ * need more variables or a degree above kMaxPolynomialDegree throw RuntimeError. */
+class Polynomial {
+public:
+    using Monomial = uint64_t;
+
+    struct Term {
+        Monomial monomial;
+        Number coefficient;
+    };
+
+    Polynomial() = default;
+    explicit Polynomial(const Number& value);
+
+    static Polynomial FromVariable(char name);
+
+    /* Converts a Sum/Product/PowerOp/NegateOp tree over constants and variables, returning
+     * false if `expr` is no such polynomial, does not fit the limits above, or some step
+     * would take more than `max_terms` terms */
+    static bool FromExpression(const ExpressionPtr& expr, size_t max_terms, Polynomial* result);
+
+    /* Splits polynomial multipliers of a product into the product of the plain ones and the
+     * product of the inverse ones, both over all their variables, under the same limits */
+    static bool FromRationalFunction(const std::vector<AssociativeOperand>& multipliers, size_t max_terms,
+                                     Polynomial* numerator, Polynomial* denominator);
+
+    /* A greatest common divisor of two nonzero polynomials with rational coefficients, as an
+     * integral polynomial with a positive leading coefficient. This is the heuristic GCD on
+     * both scaled to integral coefficients: it evaluates them at a large integer, takes the
+     * integral gcd of the values and reads the divisor back from its digits in that base.
+     * Returns false for floating point coefficients and when the heuristic gives up. */
+    static bool Gcd(const Polynomial& lhs, const Polynomial& rhs, Polynomial* result);
+
+    /* The exact quotient by `divisor`, false if there is none or either operand has
+     * coefficients Gcd() does not take */
+    bool Divide(const Polynomial& divisor, Polynomial* quotient) const;
+
+    /* The expanded form: terms by descending total degree, ties broken by the exponents in
+     * the order of GetVariables(), and the factors of a term in that order with the
+     * coefficient last, e.g. x ^ 2 * y + x * y ^ 2 * 3 - x + 1 */
+    ExpressionPtr ToExpression() const;
+
+    Polynomial& operator+=(const Polynomial& other);
+    Polynomial& operator-=(const Polynomial& other);
+    Polynomial operator*(const Polynomial& other) const;
+    Polynomial& operator*=(const Number& factor);
+    Polynomial Pow(unsigned exp) const;
+
+    bool IsZero() const {
+        return terms_.empty();
+    }
+
+    bool IsConstant() const {
+        return terms_.empty() || (terms_.size() == 1 && terms_[0].monomial == 0);
+    }
+
+    /* The exponent of every variable, kPolynomialExponentBits each */
+    unsigned GetExponent(Monomial monomial, size_t variable) const {
+        return (monomial >> (variable * kPolynomialExponentBits)) & kMaxPolynomialDegree;
+    }
+
+    unsigned GetDegree(size_t variable) const;
+
+    const std::vector<Term>& GetTerms() const {
+        return terms_;
+    }
+
+    const std::string& GetVariables() const {
+        return variables_;
+    }
+
+private:
+    /* The same polynomial over `variables`, a sorted superset of variables_ */
+    Polynomial Extend(const std::string& variables) const;
+    /* Brings both operands to the union of their variables */
+    static void Unify(Polynomial* lhs, Polynomial* rhs);
+    static bool Build(const ExpressionPtr& expr, const std::string& variables, size_t max_terms, Polynomial* result);
+    void AddScaled(const Polynomial& other, const Number& factor);
+    /* Whether multiplying by `times` copies of `factor` keeps every degree in range */
+    bool FitsProduct(const Polynomial& factor, uint64_t times) const;
+    /* The term order of ToExpression() */
+    bool PrintsBefore(Monomial lhs, Monomial rhs) const;
+
+    std::string variables_;
+    std::vector<Term> terms_;
+};
+
+}  /* namespace calculus */
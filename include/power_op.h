@@ -6,15 +6,20 @@ namespace calculus {
 
 class PowerOp : public Expression {
 public:
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
+    static constexpr ExpressionKind kKind = ExpressionKind::kPowerOp;
+
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
 
-    explicit PowerOp(const ExpressionPtr& base, const ExpressionPtr& exp) : base_(base), exp_(exp) {
+    explicit PowerOp(const ExpressionPtr& base, const ExpressionPtr& exp) : Expression(kKind), base_(base), exp_(exp) {
+        hash_ = ComputeHash();
+        AddChild(base_);
+        AddChild(exp_);
+        if (!IsNaturalExponent(exp_)) {
+            free_variables_ |= kNonPolynomialMask;
+        }
     }
 
     const ExpressionPtr& GetBase() const {
@@ -25,7 +30,15 @@ public:
         return exp_;
     }
 
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+    static bool IsNaturalExponent(const ExpressionPtr& exp);
+
     ExpressionPtr base_;
     ExpressionPtr exp_;
 };
@@ -6,16 +6,24 @@ namespace calculus {
 
 class Product : public Expression {
 public:
-    Product() = default;
+    static constexpr ExpressionKind kKind = ExpressionKind::kProduct;
+
+    Product() : Expression(kKind) {
+        hash_ = ComputeHash();
+    }
 
     template <class Vector>
-    explicit Product(Vector&& multipliers) : multipliers_(std::forward<Vector>(multipliers)) {
+    explicit Product(Vector&& multipliers) : Expression(kKind), multipliers_(std::forward<Vector>(multipliers)) {
+        hash_ = ComputeHash();
+        for (const auto& multiplier : multipliers_) {
+            AddChild(multiplier.expr);
+            if (multiplier.inverse && multiplier.expr->GetKind() != ExpressionKind::kConstant) {
+                free_variables_ |= kNonPolynomialMask;
+            }
+        }
     }
 
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
@@ -28,7 +36,14 @@ public:
         return multipliers_;
     }
 
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     std::vector<AssociativeOperand> multipliers_;
 };
 
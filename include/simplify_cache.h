@@ -0,0 +1,35 @@
+#pragma once
+
+#include "expression.h"
+#include "lru_cache.h"
+
+namespace calculus {
+
+constexpr size_t kDefaultSimplifyCacheCapacity = 1 << 16;
+
+/* Maps an expression to the result of its Simplify(). Interned keys are matched by identity,
+ * others structurally. Entries keep both expressions alive, so clear the cache before
+ * resetting the arena they were allocated from. Tasks that ThreadPool::ParallelFor() runs for
+ * a thread share its cache, hence the lock. */
+class SimplifyCache : public SharedLruCache<ExpressionPtr, ExpressionPtr, ExpressionHash, ExpressionEqual> {
+public:
+    explicit SimplifyCache(size_t capacity = kDefaultSimplifyCacheCapacity) : SharedLruCache(capacity) {
+    }
+};
+
+/* Makes Simplify() on the current thread consult `cache` while alive */
+class SimplifyCacheScope {
+public:
+    explicit SimplifyCacheScope(SimplifyCache* cache);
+    ~SimplifyCacheScope();
+
+    SimplifyCacheScope(const SimplifyCacheScope&) = delete;
+    SimplifyCacheScope& operator=(const SimplifyCacheScope&) = delete;
+
+private:
+    SimplifyCache* previous_;
+};
+
+SimplifyCache* GetCurrentSimplifyCache();
+
+}  /* namespace calculus */
@@ -6,22 +6,52 @@ namespace calculus {
 	
 class SubstOp : public Expression {
 public:
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
+    static constexpr ExpressionKind kKind = ExpressionKind::kSubstOp;
+
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
 
-    explicit SubstOp(const ExpressionPtr& target, char var_name, const ExpressionPtr& value)
-        : target_(target), var_name_(var_name), value_(value) {
+    SubstOp(const ExpressionPtr& target, char var_name, const ExpressionPtr& value)
+        : SubstOp(target, Bindings(var_name, value)) {
+    }
+
+    SubstOp(const ExpressionPtr& target, Bindings bindings)
+        : Expression(kKind), target_(target), bindings_(std::move(bindings)) {
+        hash_ = ComputeHash();
+        AddChild(target_);
+        for (const auto& entry : bindings_.GetEntries()) {
+            AddChild(entry.value);
+        }
+        /* The bound variables are no longer free, and a value only matters if its variable occurs */
+        uint32_t target_variables = target_->GetFreeVariables();
+        free_variables_ = (target_variables & ~bindings_.GetMask()) | kNonPolynomialMask;
+        for (const auto& entry : bindings_.GetEntries()) {
+            if ((target_variables & VariableMask(entry.var_name)) != 0) {
+                free_variables_ |= entry.value->GetFreeVariables();
+            }
+        }
+    }
+
+    const ExpressionPtr& GetTarget() const {
+        return target_;
     }
 
+    const Bindings& GetBindings() const {
+        return bindings_;
+    }
+
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     ExpressionPtr target_;
-    char var_name_;
-    ExpressionPtr value_;
+    Bindings bindings_;
 };
 
 }  /* namespace calculus */
\ No newline at end of file
@@ -6,16 +6,21 @@ namespace calculus {
 
 class Sum : public Expression {
 public:
-    Sum() = default;
+    static constexpr ExpressionKind kKind = ExpressionKind::kSum;
+
+    Sum() : Expression(kKind) {
+        hash_ = ComputeHash();
+    }
 
     template <class Vector>
-    explicit Sum(Vector&& summands) : summands_(std::forward<Vector>(summands)) {
+    explicit Sum(Vector&& summands) : Expression(kKind), summands_(std::forward<Vector>(summands)) {
+        hash_ = ComputeHash();
+        for (const auto& summand : summands_) {
+            AddChild(summand.expr);
+        }
     }
 
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
@@ -28,7 +33,14 @@ public:
         return summands_;
     }
 
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     std::vector<AssociativeOperand> summands_;
 };
 
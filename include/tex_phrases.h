@@ -37,5 +37,8 @@ static constexpr char kTexError[] = R"(
     Упс, что-то пошло не так...
 )";
 
+static constexpr char kTexOscillating[] = R"(
+    Упрощение зациклилось, поэтому ответ может быть не самым простым. Шагов сделано: )";
+
 static constexpr char kTexMathBegin[] = "\\begin{dmath*}";
 static constexpr char kTexMathEnd[] = "\\end{dmath*}";
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace calculus {
+
+/* Fixed set of worker threads with a task deque each. A thread pushes and pops tasks at the
+ * back of its own deque, idle threads steal from the front of the others. Threads outside
+ * the pool push to a shared deque that workers steal from as well. */
+class ThreadPool {
+public:
+    /* The thread calling ParallelFor() works too, so by default one core is left for it */
+    explicit ThreadPool(size_t thread_count = GetDefaultThreadCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* Calls body(i) for every i in [0, count) and returns once all calls are done. The calling
+     * thread runs tasks while waiting, so ParallelFor may be nested inside a task. The first
+     * exception thrown by `body` is rethrown after the remaining calls have finished. Every
+     * call runs with the caller's arena, simplify cache and derivative cache installed. */
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    size_t GetThreadCount() const {
+        return threads_.size();
+    }
+
+    static size_t GetDefaultThreadCount();
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    size_t GetHomeQueue() const;
+    void Push(size_t home, Task task);
+    bool RunOne(size_t home);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    std::atomic<ptrdiff_t> pending_tasks_{0};
+    bool stopping_ = false;
+};
+
+/* Makes the current thread offer work to `pool` while alive. Worker threads of a pool
+ * always use their own pool. */
+class ThreadPoolScope {
+public:
+    explicit ThreadPoolScope(ThreadPool* pool);
+    ~ThreadPoolScope();
+
+    ThreadPoolScope(const ThreadPoolScope&) = delete;
+    ThreadPoolScope& operator=(const ThreadPoolScope&) = delete;
+
+private:
+    ThreadPool* previous_;
+};
+
+ThreadPool* GetCurrentThreadPool();
+
+}  /* namespace calculus */
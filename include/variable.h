@@ -6,13 +6,14 @@ namespace calculus {
 
 class Variable : public Expression {
 public:
-    explicit Variable(char name) : name_(name) {
+    static constexpr ExpressionKind kKind = ExpressionKind::kVariable;
+
+    explicit Variable(char name) : Expression(kKind), name_(name) {
+        hash_ = ComputeHash();
+        free_variables_ = VariableMask(name);
     }
 
-    virtual ExpressionPtr Simplify() override;
-    virtual ExpressionPtr TakeDerivative(char var_name) override;
     virtual ExpressionPtr Call(const std::vector<ExpressionPtr>& args) override;
-    virtual ExpressionPtr Substitute(char var_name, const ExpressionPtr& value) override;
     virtual void Print(std::ostream& out, int cur_priority_level) const override;
     virtual void TexDump(std::ostream& out, int cur_priority_level = -1) const override;
     virtual bool DeepCompare(const ExpressionPtr& other) const override;
@@ -21,7 +22,14 @@ public:
         return name_;
     }
 
+protected:
+    virtual ExpressionPtr DoSimplify() override;
+    virtual ExpressionPtr DoTakeDerivative(char var_name) override;
+    virtual ExpressionPtr DoSubstitute(const Bindings& bindings) override;
+
 private:
+    size_t ComputeHash() const;
+
     char name_;
 };
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "expression.h"
+#include "constant.h"
+#include "variable.h"
+#include "function.h"
+#include "sum.h"
+#include "product.h"
+#include "power_op.h"
+#include "negate_op.h"
+#include "call_op.h"
+#include "differentiate_op.h"
+#include "subst_op.h"
+
+namespace calculus {
+
+/* Calls `visitor` with `expr` downcast to its concrete type; every overload must return the same type */
+template <class Visitor>
+decltype(auto) Visit(const Expression& expr, Visitor&& visitor) {
+    switch (expr.GetKind()) {
+        case ExpressionKind::kConstant:
+            return visitor(static_cast<const Constant&>(expr));
+        case ExpressionKind::kVariable:
+            return visitor(static_cast<const Variable&>(expr));
+        case ExpressionKind::kFunction:
+            return visitor(static_cast<const Function&>(expr));
+        case ExpressionKind::kSum:
+            return visitor(static_cast<const Sum&>(expr));
+        case ExpressionKind::kProduct:
+            return visitor(static_cast<const Product&>(expr));
+        case ExpressionKind::kPowerOp:
+            return visitor(static_cast<const PowerOp&>(expr));
+        case ExpressionKind::kNegateOp:
+            return visitor(static_cast<const NegateOp&>(expr));
+        case ExpressionKind::kCallOp:
+            return visitor(static_cast<const CallOp&>(expr));
+        case ExpressionKind::kDifferentiateOp:
+            return visitor(static_cast<const DifferentiateOp&>(expr));
+        case ExpressionKind::kSubstOp:
+            return visitor(static_cast<const SubstOp&>(expr));
+    }
+    throw RuntimeError("Unknown expression kind");
+}
+
+template <class Visitor>
+decltype(auto) Visit(const ExpressionPtr& expr, Visitor&& visitor) {
+    return Visit(*expr, std::forward<Visitor>(visitor));
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,87 @@
+#include <arena.h>
+
+#include <cstdint>
+#include <string>
+
+namespace calculus {
+
+static thread_local Arena* current_arena = nullptr;
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {
+}
+
+static char* AlignUp(char* ptr, size_t alignment) {
+    return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(ptr) + alignment - 1) & ~(alignment - 1));
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++nodes_allocated_;
+    ++live_nodes_;
+
+    /* Requests that do not fit in a regular block get a block of their own, so the rest of
+     * the current block stays in use */
+    if (size + alignment > block_size_) {
+        large_blocks_.emplace_back(new char[size + alignment]);
+        bytes_allocated_ += size + alignment;
+        return AlignUp(large_blocks_.back().get(), alignment);
+    }
+
+    char* aligned = AlignUp(current_, alignment);
+    if (current_ == nullptr || aligned + size > end_) {
+        NextBlock();
+        aligned = AlignUp(current_, alignment);
+    }
+    bytes_allocated_ += aligned + size - current_;
+    current_ = aligned + size;
+    return aligned;
+}
+
+void Arena::Deallocate(void* ptr, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --live_nodes_;
+    /* Give back the most recent allocation, e.g. a node that turned out to be interned already.
+     * A large block may happen to end where the current block starts, hence the second test. */
+    char* begin = static_cast<char*>(ptr);
+    if (begin + size == current_ && begin >= blocks_[current_block_].get()) {
+        current_ = begin;
+    }
+}
+
+void Arena::Reset() {
+    if (live_nodes_ != 0) {
+        throw RuntimeError("Cannot reset an arena with " + std::to_string(live_nodes_) + " live nodes");
+    }
+
+    large_blocks_.clear();
+    current_block_ = 0;
+    current_ = blocks_.empty() ? nullptr : blocks_[0].get();
+    end_ = blocks_.empty() ? nullptr : current_ + block_size_;
+    bytes_allocated_ = 0;
+    nodes_allocated_ = 0;
+}
+
+void Arena::NextBlock() {
+    if (current_ != nullptr && current_block_ + 1 < blocks_.size()) {
+        ++current_block_;
+    } else if (current_ != nullptr || blocks_.empty()) {
+        blocks_.emplace_back(new char[block_size_]);
+        current_block_ = blocks_.size() - 1;
+    }
+    current_ = blocks_[current_block_].get();
+    end_ = current_ + block_size_;
+}
+
+ArenaScope::ArenaScope(Arena* arena) : previous_(current_arena) {
+    current_arena = arena;
+}
+
+ArenaScope::~ArenaScope() {
+    current_arena = previous_;
+}
+
+Arena* GetCurrentArena() {
+    return current_arena;
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,71 @@
+#include "batch_kernels.h"
+
+#if defined(__x86_64__) && defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+#include "simd_math.h"
+
+namespace calculus {
+namespace {
+
+struct Avx2 {
+    using Vec = __m256d;
+    using Int = __m256i;
+    using Mask = __m256d;
+
+    static constexpr size_t kWidth = 4;
+
+    static Vec Load(const double* ptr) { return _mm256_loadu_pd(ptr); }
+    static void Store(double* ptr, Vec x) { _mm256_storeu_pd(ptr, x); }
+    static Vec Set(double x) { return _mm256_set1_pd(x); }
+
+    static Vec Add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+    static Vec Fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_pd(a, b, c); }
+    static Vec Sqrt(Vec x) { return _mm256_sqrt_pd(x); }
+    static Vec Round(Vec x) { return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+    static Int ToInt(Vec x) { return _mm256_castpd_si256(x); }
+    static Vec ToVec(Int x) { return _mm256_castsi256_pd(x); }
+    static Int SetInt(uint64_t x) { return _mm256_set1_epi64x(static_cast<long long>(x)); }
+    static Int And(Int a, Int b) { return _mm256_and_si256(a, b); }
+    static Int Or(Int a, Int b) { return _mm256_or_si256(a, b); }
+    static Int Xor(Int a, Int b) { return _mm256_xor_si256(a, b); }
+    static Int AddInt(Int a, Int b) { return _mm256_add_epi64(a, b); }
+    template <int kShift> static Int ShiftLeft(Int x) { return _mm256_slli_epi64(x, kShift); }
+    template <int kShift> static Int ShiftRight(Int x) { return _mm256_srli_epi64(x, kShift); }
+
+    static Mask Less(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Mask LessEqual(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static Mask Greater(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static Mask GreaterEqual(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static Mask MaskAnd(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+    /* blendv and movemask only look at the sign bit of each lane */
+    static Mask LowBitMask(Int x) { return _mm256_castsi256_pd(_mm256_slli_epi64(x, 63)); }
+    static Vec Select(Mask mask, Vec a, Vec b) { return _mm256_blendv_pd(b, a, mask); }
+    static unsigned MaskBits(Mask mask) { return static_cast<unsigned>(_mm256_movemask_pd(mask)); }
+};
+
+}  /* namespace */
+
+const BatchKernels* GetAvx2BatchKernels() {
+    static const BatchKernels kernels = MakeBatchKernels<Avx2>();
+    return &kernels;
+}
+
+}  /* namespace calculus */
+
+#else
+
+namespace calculus {
+
+const BatchKernels* GetAvx2BatchKernels() {
+    return nullptr;
+}
+
+}  /* namespace calculus */
+
+#endif
@@ -0,0 +1,77 @@
+#include "batch_kernels.h"
+
+#if defined(__x86_64__) && defined(__AVX512F__)
+
+/* GCC 12 warns about the deliberately undefined pass-through operand inside its own intrinsics */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include <immintrin.h>
+
+#include "simd_math.h"
+
+namespace calculus {
+namespace {
+
+/* Only AVX-512F instructions are used, so every AVX-512 capable CPU qualifies */
+struct Avx512 {
+    using Vec = __m512d;
+    using Int = __m512i;
+    using Mask = __mmask8;
+
+    static constexpr size_t kWidth = 8;
+
+    static Vec Load(const double* ptr) { return _mm512_loadu_pd(ptr); }
+    static void Store(double* ptr, Vec x) { _mm512_storeu_pd(ptr, x); }
+    static Vec Set(double x) { return _mm512_set1_pd(x); }
+
+    static Vec Add(Vec a, Vec b) { return _mm512_add_pd(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm512_sub_pd(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm512_mul_pd(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm512_div_pd(a, b); }
+    static Vec Fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_pd(a, b, c); }
+    static Vec Sqrt(Vec x) { return _mm512_sqrt_pd(x); }
+    static Vec Round(Vec x) { return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+    static Int ToInt(Vec x) { return _mm512_castpd_si512(x); }
+    static Vec ToVec(Int x) { return _mm512_castsi512_pd(x); }
+    static Int SetInt(uint64_t x) { return _mm512_set1_epi64(static_cast<long long>(x)); }
+    static Int And(Int a, Int b) { return _mm512_and_si512(a, b); }
+    static Int Or(Int a, Int b) { return _mm512_or_si512(a, b); }
+    static Int Xor(Int a, Int b) { return _mm512_xor_si512(a, b); }
+    static Int AddInt(Int a, Int b) { return _mm512_add_epi64(a, b); }
+    template <int kShift> static Int ShiftLeft(Int x) { return _mm512_slli_epi64(x, kShift); }
+    template <int kShift> static Int ShiftRight(Int x) { return _mm512_srli_epi64(x, kShift); }
+
+    static Mask Less(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static Mask LessEqual(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+    static Mask Greater(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static Mask GreaterEqual(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+    static Mask MaskAnd(Mask a, Mask b) { return a & b; }
+    static Mask LowBitMask(Int x) { return _mm512_test_epi64_mask(x, _mm512_set1_epi64(1)); }
+    static Vec Select(Mask mask, Vec a, Vec b) { return _mm512_mask_blend_pd(mask, b, a); }
+    static unsigned MaskBits(Mask mask) { return mask; }
+};
+
+}  /* namespace */
+
+const BatchKernels* GetAvx512BatchKernels() {
+    static const BatchKernels kernels = MakeBatchKernels<Avx512>();
+    return &kernels;
+}
+
+}  /* namespace calculus */
+
+#else
+
+namespace calculus {
+
+const BatchKernels* GetAvx512BatchKernels() {
+    return nullptr;
+}
+
+}  /* namespace calculus */
+
+#endif
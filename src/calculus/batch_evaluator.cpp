@@ -0,0 +1,111 @@
+#include <batch_evaluator.h>
+
+#include <algorithm>
+
+namespace calculus {
+
+BatchEvaluator::BatchEvaluator(BytecodeProgram program, ThreadPool* pool, size_t chunk_rows)
+    : program_(std::move(program)), tape_(program_), pool_(pool), chunk_rows_(std::max(chunk_rows, kBatchBlockSize)),
+      level_(GetSimdLevel()) {
+}
+
+BatchEvaluator::BatchEvaluator(const ExpressionPtr& expr, ThreadPool* pool, size_t chunk_rows)
+    : BatchEvaluator(BytecodeProgram::Compile(expr), pool, chunk_rows) {
+}
+
+template <class Body>
+void BatchEvaluator::ForEachChunk(size_t count, const Body& body) const {
+    size_t chunks = (count + chunk_rows_ - 1) / chunk_rows_;
+    if (pool_ == nullptr || chunks <= 1) {
+        body(0, count);
+        return;
+    }
+
+    pool_->ParallelFor(chunks, [&](size_t chunk) {
+        size_t begin = chunk * chunk_rows_;
+        body(begin, std::min(chunk_rows_, count - begin));
+    });
+}
+
+void BatchEvaluator::Evaluate(const double* const* variables, size_t count, double* result) const {
+    ForEachChunk(count, [&](size_t begin, size_t size) {
+        EvaluateChunk(variables, begin, size, result);
+    });
+}
+
+void BatchEvaluator::EvaluateDual(const double* const* variables, const double* direction, size_t count,
+                                  double* values, double* derivatives) const {
+    for (const auto& instruction : program_.GetInstructions()) {
+        if (instruction.op == OpCode::kLoadVariable && variables[instruction.lhs] == nullptr) {
+            throw RuntimeError(std::string("No values given for variable ") + static_cast<char>('a' + instruction.lhs));
+        }
+    }
+    ForEachChunk(count, [&](size_t begin, size_t size) {
+        EvaluateDualChunk(variables, direction, begin, size, values, derivatives);
+    });
+}
+
+void BatchEvaluator::EvaluateGradient(const double* const* variables, size_t count, double* values,
+                                      double* const* gradient) const {
+    ForEachChunk(count, [&](size_t begin, size_t size) {
+        EvaluateGradientChunk(variables, begin, size, values, gradient);
+    });
+}
+
+void BatchEvaluator::EvaluateChunk(const double* const* variables, size_t begin, size_t size, double* result) const {
+    /* Chunks never nest on a thread, so one register file per thread suffices */
+    static thread_local std::vector<double> registers;
+    if (registers.size() < program_.GetBatchScratchSize()) {
+        registers.resize(program_.GetBatchScratchSize());
+    }
+
+    const double* columns[kVariableCount];
+    for (size_t i = 0; i < kVariableCount; ++i) {
+        columns[i] = variables[i] != nullptr ? variables[i] + begin : nullptr;
+    }
+    program_.EvaluateBatch(columns, size, result + begin, level_, registers.data());
+}
+
+void BatchEvaluator::EvaluateDualChunk(const double* const* variables, const double* direction, size_t begin,
+                                       size_t size, double* values, double* derivatives) const {
+    static thread_local std::vector<Dual> registers;
+    if (registers.size() < program_.GetRegisterCount()) {
+        registers.resize(program_.GetRegisterCount());
+    }
+
+    size_t columns[kVariableCount];
+    size_t column_count = 0;
+    for (size_t c = 0; c < kVariableCount; ++c) {
+        if (variables[c] != nullptr) {
+            columns[column_count++] = c;
+        }
+    }
+
+    double row[kVariableCount] = {};
+    for (size_t i = begin; i < begin + size; ++i) {
+        for (size_t j = 0; j < column_count; ++j) {
+            row[columns[j]] = variables[columns[j]][i];
+        }
+        Dual result = program_.EvaluateDual(row, direction, registers.data());
+        values[i] = result.value;
+        derivatives[i] = result.derivative;
+    }
+}
+
+void BatchEvaluator::EvaluateGradientChunk(const double* const* variables, size_t begin, size_t size,
+                                           double* values, double* const* gradient) const {
+    static thread_local std::vector<double> scratch;
+    if (scratch.size() < tape_.GetBatchScratchSize()) {
+        scratch.resize(tape_.GetBatchScratchSize());
+    }
+
+    const double* columns[kVariableCount];
+    double* gradient_columns[kVariableCount];
+    for (size_t i = 0; i < kVariableCount; ++i) {
+        columns[i] = variables[i] != nullptr ? variables[i] + begin : nullptr;
+        gradient_columns[i] = gradient[i] != nullptr ? gradient[i] + begin : nullptr;
+    }
+    tape_.EvaluateBatch(columns, size, values + begin, gradient_columns, level_, scratch.data());
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <bytecode.h>
+
+namespace calculus {
+
+/* dst[i] = lhs[i] <op> rhs[i] for i in [0, count); unary kernels ignore `rhs`.
+ * `dst` may alias `lhs` or `rhs`. */
+using BatchKernel = void (*)(const double* lhs, const double* rhs, double* dst, size_t count);
+
+/* Indexed by OpCode, loads have no kernel */
+struct BatchKernels {
+    BatchKernel ops[kOpCodeCount];
+};
+
+/* The vector variants are nullptr when the build does not target x86-64 */
+const BatchKernels* GetScalarBatchKernels();
+const BatchKernels* GetAvx2BatchKernels();
+const BatchKernels* GetAvx512BatchKernels();
+
+/* Kernels for `level`, throws RuntimeError if the CPU does not support it */
+const BatchKernels* GetBatchKernels(SimdLevel level);
+
+}  /* namespace calculus */
@@ -0,0 +1,58 @@
+#include "batch_kernels.h"
+
+#include <cmath>
+
+namespace calculus {
+
+#define SCALAR_BINARY_KERNEL(name, expr)                                                    \
+    static void name(const double* lhs, const double* rhs, double* dst, size_t count) {    \
+        for (size_t i = 0; i < count; ++i) {                                                \
+            double a = lhs[i];                                                              \
+            double b = rhs[i];                                                              \
+            dst[i] = (expr);                                                                \
+        }                                                                                   \
+    }
+
+#define SCALAR_UNARY_KERNEL(name, expr)                                                     \
+    static void name(const double* lhs, const double*, double* dst, size_t count) {        \
+        for (size_t i = 0; i < count; ++i) {                                                \
+            double a = lhs[i];                                                              \
+            dst[i] = (expr);                                                                \
+        }                                                                                   \
+    }
+
+SCALAR_BINARY_KERNEL(ScalarAdd, a + b)
+SCALAR_BINARY_KERNEL(ScalarSub, a - b)
+SCALAR_BINARY_KERNEL(ScalarMul, a * b)
+SCALAR_BINARY_KERNEL(ScalarDiv, a / b)
+SCALAR_BINARY_KERNEL(ScalarPow, std::pow(a, b))
+SCALAR_UNARY_KERNEL(ScalarNeg, -a)
+SCALAR_UNARY_KERNEL(ScalarSqrt, std::sqrt(a))
+SCALAR_UNARY_KERNEL(ScalarSin, std::sin(a))
+SCALAR_UNARY_KERNEL(ScalarCos, std::cos(a))
+SCALAR_UNARY_KERNEL(ScalarLog, std::log(a))
+SCALAR_UNARY_KERNEL(ScalarExp, std::exp(a))
+
+#undef SCALAR_BINARY_KERNEL
+#undef SCALAR_UNARY_KERNEL
+
+const BatchKernels* GetScalarBatchKernels() {
+    static const BatchKernels kernels = [] {
+        BatchKernels result = {};
+        result.ops[static_cast<size_t>(OpCode::kAdd)] = ScalarAdd;
+        result.ops[static_cast<size_t>(OpCode::kSub)] = ScalarSub;
+        result.ops[static_cast<size_t>(OpCode::kMul)] = ScalarMul;
+        result.ops[static_cast<size_t>(OpCode::kDiv)] = ScalarDiv;
+        result.ops[static_cast<size_t>(OpCode::kNeg)] = ScalarNeg;
+        result.ops[static_cast<size_t>(OpCode::kPow)] = ScalarPow;
+        result.ops[static_cast<size_t>(OpCode::kSqrt)] = ScalarSqrt;
+        result.ops[static_cast<size_t>(OpCode::kSin)] = ScalarSin;
+        result.ops[static_cast<size_t>(OpCode::kCos)] = ScalarCos;
+        result.ops[static_cast<size_t>(OpCode::kLog)] = ScalarLog;
+        result.ops[static_cast<size_t>(OpCode::kExp)] = ScalarExp;
+        return result;
+    }();
+    return &kernels;
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,350 @@
+#include <big_int.h>
+#include "calculus_internal.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace calculus {
+
+constexpr uint64_t kLimbBase = uint64_t(1) << 32;
+
+BigInt::BigInt(int64_t value) : negative_(value < 0) {
+    // Negating through uint64_t keeps INT64_MIN defined
+    uint64_t magnitude = negative_ ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    while (magnitude != 0) {
+        limbs_.push_back(static_cast<uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+BigInt BigInt::FromDouble(double value) {
+    if (std::fabs(value) < 9.2e18) {
+        return BigInt(static_cast<int64_t>(value));
+    }
+    int exp;
+    double mantissa = std::frexp(std::fabs(value), &exp);
+    BigInt result(static_cast<int64_t>(std::ldexp(mantissa, 53)));
+    result <<= exp - 53;
+    result.negative_ = value < 0;
+    return result;
+}
+
+size_t BigInt::BitLength() const {
+    if (limbs_.empty()) {
+        return 0;
+    }
+    return limbs_.size() * 32 - __builtin_clz(limbs_.back());
+}
+
+bool BigInt::FitsInt64() const {
+    size_t bits = BitLength();
+    return bits < 64 || (bits == 64 && negative_ && limbs_[0] == 0 && limbs_[1] == 0x80000000u);
+}
+
+int64_t BigInt::ToInt64() const {
+    uint64_t magnitude = 0;
+    for (size_t i = limbs_.size(); i-- > 0;) {
+        magnitude = (magnitude << 32) | limbs_[i];
+    }
+    return negative_ ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+}
+
+double BigInt::ToDouble() const {
+    double result = 0;
+    for (size_t i = limbs_.size(); i-- > 0;) {
+        result = result * kLimbBase + limbs_[i];
+    }
+    return negative_ ? -result : result;
+}
+
+std::string BigInt::ToString() const {
+    if (limbs_.empty()) {
+        return "0";
+    }
+    // Nine decimal digits at a time, least significant group first
+    std::vector<uint32_t> groups;
+    Limbs rest = limbs_;
+    while (!rest.empty()) {
+        uint64_t remainder = 0;
+        for (size_t i = rest.size(); i-- > 0;) {
+            uint64_t current = (remainder << 32) | rest[i];
+            rest[i] = static_cast<uint32_t>(current / 1000000000);
+            remainder = current % 1000000000;
+        }
+        while (!rest.empty() && rest.back() == 0) {
+            rest.pop_back();
+        }
+        groups.push_back(static_cast<uint32_t>(remainder));
+    }
+    std::string result = negative_ ? "-" : "";
+    result += std::to_string(groups.back());
+    for (size_t i = groups.size() - 1; i-- > 0;) {
+        std::string group = std::to_string(groups[i]);
+        result.append(9 - group.size(), '0');
+        result += group;
+    }
+    return result;
+}
+
+size_t BigInt::Hash() const {
+    size_t hash = HashCombine(0, negative_);
+    for (uint32_t limb : limbs_) {
+        hash = HashCombine(hash, limb);
+    }
+    return hash;
+}
+
+BigInt BigInt::operator-() const {
+    BigInt result = *this;
+    result.negative_ = !result.negative_ && !result.limbs_.empty();
+    return result;
+}
+
+BigInt BigInt::Abs() const {
+    BigInt result = *this;
+    result.negative_ = false;
+    return result;
+}
+
+void BigInt::Trim() {
+    while (!limbs_.empty() && limbs_.back() == 0) {
+        limbs_.pop_back();
+    }
+    if (limbs_.empty()) {
+        negative_ = false;
+    }
+}
+
+int BigInt::CompareMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return lhs.size() < rhs.size() ? -1 : 1;
+    }
+    for (size_t i = lhs.size(); i-- > 0;) {
+        if (lhs[i] != rhs[i]) {
+            return lhs[i] < rhs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+int BigInt::Compare(const BigInt& lhs, const BigInt& rhs) {
+    if (lhs.negative_ != rhs.negative_) {
+        return lhs.negative_ ? -1 : 1;
+    }
+    int result = CompareMagnitudes(lhs.limbs_, rhs.limbs_);
+    return lhs.negative_ ? -result : result;
+}
+
+void BigInt::AddMagnitude(Limbs* lhs, const Limbs& rhs) {
+    if (lhs->size() < rhs.size()) {
+        lhs->resize(rhs.size(), 0);
+    }
+    uint64_t carry = 0;
+    for (size_t i = 0; i < lhs->size() && (carry != 0 || i < rhs.size()); ++i) {
+        uint64_t sum = carry + (*lhs)[i] + (i < rhs.size() ? rhs[i] : 0);
+        (*lhs)[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    if (carry != 0) {
+        lhs->push_back(static_cast<uint32_t>(carry));
+    }
+}
+
+void BigInt::SubtractMagnitude(Limbs* lhs, const Limbs& rhs) {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < lhs->size() && (borrow != 0 || i < rhs.size()); ++i) {
+        int64_t difference = static_cast<int64_t>((*lhs)[i]) - (i < rhs.size() ? rhs[i] : 0) - borrow;
+        borrow = difference < 0;
+        (*lhs)[i] = static_cast<uint32_t>(difference + (borrow ? kLimbBase : 0));
+    }
+}
+
+void BigInt::Add(const Limbs& magnitude, bool negative) {
+    if (negative_ == negative) {
+        AddMagnitude(&limbs_, magnitude);
+    } else if (CompareMagnitudes(limbs_, magnitude) >= 0) {
+        SubtractMagnitude(&limbs_, magnitude);
+    } else {
+        Limbs result = magnitude;
+        SubtractMagnitude(&result, limbs_);
+        limbs_ = std::move(result);
+        negative_ = negative;
+    }
+    Trim();
+}
+
+BigInt& BigInt::operator+=(const BigInt& other) {
+    Add(other.limbs_, other.negative_);
+    return *this;
+}
+
+BigInt& BigInt::operator-=(const BigInt& other) {
+    Add(other.limbs_, !other.negative_ && !other.limbs_.empty());
+    return *this;
+}
+
+BigInt& BigInt::operator*=(const BigInt& other) {
+    if (limbs_.empty() || other.limbs_.empty()) {
+        *this = BigInt();
+        return *this;
+    }
+    Limbs result(limbs_.size() + other.limbs_.size(), 0);
+    for (size_t i = 0; i < limbs_.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < other.limbs_.size(); ++j) {
+            uint64_t current = static_cast<uint64_t>(limbs_[i]) * other.limbs_[j] + result[i + j] + carry;
+            result[i + j] = static_cast<uint32_t>(current);
+            carry = current >> 32;
+        }
+        result[i + other.limbs_.size()] = static_cast<uint32_t>(carry);
+    }
+    limbs_ = std::move(result);
+    negative_ = negative_ != other.negative_;
+    Trim();
+    return *this;
+}
+
+/* Knuth's algorithm D: the divisor is normalized so that its top limb has the high bit set,
+ * then every quotient limb is estimated from the top two limbs and corrected at most twice */
+void BigInt::DivModMagnitudes(const Limbs& lhs, const Limbs& rhs, Limbs* quotient, Limbs* remainder) {
+    if (CompareMagnitudes(lhs, rhs) < 0) {
+        quotient->clear();
+        *remainder = lhs;
+        return;
+    }
+    if (rhs.size() == 1) {
+        quotient->assign(lhs.size(), 0);
+        uint64_t rest = 0;
+        for (size_t i = lhs.size(); i-- > 0;) {
+            uint64_t current = (rest << 32) | lhs[i];
+            (*quotient)[i] = static_cast<uint32_t>(current / rhs[0]);
+            rest = current % rhs[0];
+        }
+        remainder->clear();
+        if (rest != 0) {
+            remainder->push_back(static_cast<uint32_t>(rest));
+        }
+    } else {
+        size_t n = rhs.size();
+        size_t m = lhs.size() - n;
+        int shift = __builtin_clz(rhs.back());
+        Limbs divisor(n);
+        Limbs dividend(lhs.size() + 1);
+        for (size_t i = n; i-- > 0;) {
+            divisor[i] = (rhs[i] << shift) | (shift != 0 && i > 0 ? rhs[i - 1] >> (32 - shift) : 0);
+        }
+        dividend[lhs.size()] = shift != 0 ? lhs.back() >> (32 - shift) : 0;
+        for (size_t i = lhs.size(); i-- > 0;) {
+            dividend[i] = (lhs[i] << shift) | (shift != 0 && i > 0 ? lhs[i - 1] >> (32 - shift) : 0);
+        }
+
+        quotient->assign(m + 1, 0);
+        for (size_t j = m + 1; j-- > 0;) {
+            uint64_t top = (static_cast<uint64_t>(dividend[j + n]) << 32) | dividend[j + n - 1];
+            uint64_t estimate = top / divisor[n - 1];
+            uint64_t rest = top % divisor[n - 1];
+            while (estimate >= kLimbBase || estimate * divisor[n - 2] > ((rest << 32) | dividend[j + n - 2])) {
+                --estimate;
+                rest += divisor[n - 1];
+                if (rest >= kLimbBase) {
+                    break;
+                }
+            }
+
+            int64_t borrow = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t product = estimate * divisor[i];
+                int64_t difference = static_cast<int64_t>(dividend[i + j]) - borrow -
+                                     static_cast<int64_t>(product & 0xffffffffu);
+                dividend[i + j] = static_cast<uint32_t>(difference);
+                borrow = static_cast<int64_t>(product >> 32) - (difference >> 32);
+            }
+            int64_t difference = static_cast<int64_t>(dividend[j + n]) - borrow;
+            dividend[j + n] = static_cast<uint32_t>(difference);
+
+            if (difference < 0) {
+                // The estimate was one too large: add the divisor back
+                --estimate;
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint64_t sum = static_cast<uint64_t>(dividend[i + j]) + divisor[i] + carry;
+                    dividend[i + j] = static_cast<uint32_t>(sum);
+                    carry = sum >> 32;
+                }
+                dividend[j + n] += static_cast<uint32_t>(carry);
+            }
+            (*quotient)[j] = static_cast<uint32_t>(estimate);
+        }
+
+        remainder->assign(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            (*remainder)[i] = (dividend[i] >> shift) | (shift != 0 ? dividend[i + 1] << (32 - shift) : 0);
+        }
+    }
+    while (!quotient->empty() && quotient->back() == 0) {
+        quotient->pop_back();
+    }
+    while (!remainder->empty() && remainder->back() == 0) {
+        remainder->pop_back();
+    }
+}
+
+void BigInt::DivMod(const BigInt& lhs, const BigInt& rhs, BigInt* quotient, BigInt* remainder) {
+    if (rhs.limbs_.empty()) {
+        throw RuntimeError("Division by zero");
+    }
+    BigInt result_quotient, result_remainder;
+    DivModMagnitudes(lhs.limbs_, rhs.limbs_, &result_quotient.limbs_, &result_remainder.limbs_);
+    result_quotient.negative_ = lhs.negative_ != rhs.negative_;
+    result_remainder.negative_ = lhs.negative_;
+    result_quotient.Trim();
+    result_remainder.Trim();
+    if (quotient != nullptr) {
+        *quotient = std::move(result_quotient);
+    }
+    if (remainder != nullptr) {
+        *remainder = std::move(result_remainder);
+    }
+}
+
+BigInt& BigInt::operator/=(const BigInt& other) {
+    DivMod(*this, other, this, nullptr);
+    return *this;
+}
+
+BigInt& BigInt::operator%=(const BigInt& other) {
+    DivMod(*this, other, nullptr, this);
+    return *this;
+}
+
+BigInt& BigInt::operator<<=(size_t bits) {
+    if (limbs_.empty()) {
+        return *this;
+    }
+    limbs_.insert(limbs_.begin(), bits / 32, 0);
+    unsigned shift = bits % 32;
+    if (shift != 0) {
+        uint32_t carry = 0;
+        for (auto& limb : limbs_) {
+            uint32_t next = limb >> (32 - shift);
+            limb = (limb << shift) | carry;
+            carry = next;
+        }
+        if (carry != 0) {
+            limbs_.push_back(carry);
+        }
+    }
+    return *this;
+}
+
+BigInt BigInt::Gcd(BigInt lhs, BigInt rhs) {
+    lhs.negative_ = false;
+    rhs.negative_ = false;
+    while (!rhs.IsZero()) {
+        lhs %= rhs;
+        std::swap(lhs, rhs);
+    }
+    return lhs;
+}
+
+}  /* namespace calculus */
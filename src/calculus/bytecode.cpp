@@ -0,0 +1,488 @@
+#include <bytecode.h>
+#include <constant.h>
+#include <variable.h>
+#include <function.h>
+#include <sum.h>
+#include <product.h>
+#include <power_op.h>
+#include <negate_op.h>
+#include <call_op.h>
+#include <visit.h>
+#include "calculus_internal.h"
+#include "batch_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace calculus {
+
+static constexpr uint32_t kNoValue = UINT32_MAX;
+static constexpr size_t kStackRegisterCount = 64;
+/* Integer powers up to this are multiplied out. The rounding errors add up with every
+ * multiplication: cubes and inverse cubes stay within 2 ulp of pow(), x^8 is 5 ulp off. */
+static constexpr double kMaxMultipliedPower = 3;
+
+static const std::unordered_map<std::string, OpCode> kFunctionOpCodes = {
+    {"sin", OpCode::kSin},
+    {"cos", OpCode::kCos},
+    {"log", OpCode::kLog},
+    {"exp", OpCode::kExp},
+};
+
+static bool IsUnary(OpCode op) {
+    return op == OpCode::kNeg || op == OpCode::kSqrt || op == OpCode::kSin || op == OpCode::kCos || op == OpCode::kLog ||
+           op == OpCode::kExp;
+}
+
+static bool IsLoad(OpCode op) {
+    return op == OpCode::kLoadConstant || op == OpCode::kLoadVariable;
+}
+
+/* Lowers an expression to instructions over an unbounded set of values, each defined once,
+ * then maps the values onto registers */
+class BytecodeCompiler {
+public:
+    BytecodeProgram Compile(const ExpressionPtr& expr) {
+        uint32_t result = Emit(expr);
+        AllocateRegisters(result);
+        return std::move(program_);
+    }
+
+    uint32_t operator()(const Constant& expr) {
+        return EmitConstant(expr.GetValue());
+    }
+
+    uint32_t operator()(const Variable& expr) {
+        char name = expr.GetName();
+        if (name < 'a' || name > 'z') {
+            throw RuntimeError(std::string("Cannot compile variable ") + name);
+        }
+        uint32_t& value = variables_[name - 'a'];
+        if (value == kNoValue) {
+            value = EmitInstruction(OpCode::kLoadVariable, name - 'a');
+        }
+        return value;
+    }
+
+    uint32_t operator()(const Function& expr) {
+        throw RuntimeError("Cannot compile function " + expr.GetName() + " without arguments");
+    }
+
+    uint32_t operator()(const Sum& expr) {
+        uint32_t result = kNoValue;
+        for (const auto& summand : expr.GetOperands()) {
+            uint32_t value = Emit(summand.expr);
+            if (result == kNoValue) {
+                result = summand.inverse ? EmitInstruction(OpCode::kNeg, value) : value;
+            } else {
+                result = EmitInstruction(summand.inverse ? OpCode::kSub : OpCode::kAdd, result, value);
+            }
+        }
+        return result == kNoValue ? EmitConstant(0) : result;
+    }
+
+    uint32_t operator()(const Product& expr) {
+        uint32_t result = kNoValue;
+        for (const auto& multiplier : expr.GetOperands()) {
+            uint32_t value = Emit(multiplier.expr);
+            if (result == kNoValue) {
+                result = multiplier.inverse ? EmitInstruction(OpCode::kDiv, EmitConstant(1), value) : value;
+            } else {
+                result = EmitInstruction(multiplier.inverse ? OpCode::kDiv : OpCode::kMul, result, value);
+            }
+        }
+        return result == kNoValue ? EmitConstant(1) : result;
+    }
+
+    /* Constant exponents of small integers and of 1/2 avoid pow(): the vector kernels compute
+     * it through exp and log, which is slower and less accurate than a few multiplications or
+     * a square root. Only the square roots of -0 and -inf differ from pow(). */
+    uint32_t operator()(const PowerOp& expr) {
+        uint32_t base = Emit(expr.GetBase());
+        if (Is<Constant>(expr.GetExp())) {
+            double exp = As<Constant>(expr.GetExp())->GetValue();
+            if (exp == 0.5) {
+                return EmitInstruction(OpCode::kSqrt, base);
+            }
+            if (exp == -0.5) {
+                return EmitInstruction(OpCode::kDiv, EmitConstant(1), EmitInstruction(OpCode::kSqrt, base));
+            }
+            if (exp == std::trunc(exp) && std::fabs(exp) <= kMaxMultipliedPower) {
+                return EmitIntegerPower(base, static_cast<int>(exp));
+            }
+        }
+        uint32_t exp = Emit(expr.GetExp());
+        return EmitInstruction(OpCode::kPow, base, exp);
+    }
+
+    uint32_t operator()(const NegateOp& expr) {
+        return EmitInstruction(OpCode::kNeg, Emit(expr.GetInnerExpr()));
+    }
+
+    uint32_t operator()(const CallOp& expr) {
+        const auto& func = expr.GetFunction();
+        const auto& args = expr.GetArguments();
+        if (!Is<Function>(func)) {
+            /* Sums, products etc. of functions distribute over the call */
+            auto called = func->Call(args);
+            if (Is<CallOp>(called) && !Is<Function>(As<CallOp>(called)->GetFunction())) {
+                throw RuntimeError("Cannot compile a call of a non-function expression");
+            }
+            return Emit(called);
+        }
+
+        const auto& name = As<Function>(func)->GetName();
+        if (args.size() != 1) {
+            throw RuntimeError("Argument count mismatch: expected 1, got " + std::to_string(args.size()));
+        }
+        if (name == "id") {
+            return Emit(args[0]);
+        }
+        auto iter = kFunctionOpCodes.find(name);
+        if (iter == kFunctionOpCodes.end()) {
+            throw RuntimeError("Cannot compile a call of unknown function " + name);
+        }
+        return EmitInstruction(iter->second, Emit(args[0]));
+    }
+
+    uint32_t operator()(const DifferentiateOp&) {
+        throw RuntimeError("Cannot compile a derivative, simplify the expression first");
+    }
+
+    uint32_t operator()(const SubstOp&) {
+        throw RuntimeError("Cannot compile a substitution, simplify the expression first");
+    }
+
+private:
+    uint32_t Emit(const ExpressionPtr& expr) {
+        auto iter = values_.find(expr);
+        if (iter != values_.end()) {
+            return iter->second;
+        }
+        uint32_t value = Visit(expr, *this);
+        values_.emplace(expr, value);
+        return value;
+    }
+
+    /* Binary exponentiation, a negative power divides one by the positive one */
+    uint32_t EmitIntegerPower(uint32_t base, int exp) {
+        uint32_t result = kNoValue;
+        uint32_t square = base;
+        for (int rest = std::abs(exp); rest != 0; rest >>= 1) {
+            if (rest & 1) {
+                result = result == kNoValue ? square : EmitInstruction(OpCode::kMul, result, square);
+            }
+            if (rest > 1) {
+                square = EmitInstruction(OpCode::kMul, square, square);
+            }
+        }
+        if (result == kNoValue) {
+            return EmitConstant(1);
+        }
+        return exp < 0 ? EmitInstruction(OpCode::kDiv, EmitConstant(1), result) : result;
+    }
+
+    uint32_t EmitConstant(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto iter = constants_.find(bits);
+        if (iter != constants_.end()) {
+            return iter->second;
+        }
+        program_.constants_.push_back(value);
+        uint32_t result = EmitInstruction(OpCode::kLoadConstant, program_.constants_.size() - 1);
+        constants_.emplace(bits, result);
+        return result;
+    }
+
+    uint32_t EmitInstruction(OpCode op, uint32_t lhs, uint32_t rhs = 0) {
+        uint32_t value = program_.code_.size();
+        program_.code_.push_back({op, value, lhs, rhs});
+        return value;
+    }
+
+    /* Linear scan over the straight-line code: a register is released right after the last
+     * instruction reading its value, so that instruction may already write its result there */
+    void AllocateRegisters(uint32_t result) {
+        auto& code = program_.code_;
+        std::vector<uint32_t> last_use(code.size(), 0);
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            if (IsLoad(code[i].op)) {
+                continue;
+            }
+            last_use[code[i].lhs] = i;
+            if (!IsUnary(code[i].op)) {
+                last_use[code[i].rhs] = i;
+            }
+        }
+        last_use[result] = code.size();
+
+        std::vector<uint32_t> registers(code.size(), kNoValue);
+        std::vector<uint32_t> free_registers;
+        uint32_t register_count = 0;
+
+        auto release = [&](uint32_t value, uint32_t i) {
+            if (last_use[value] == i) {
+                free_registers.push_back(registers[value]);
+            }
+        };
+
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            auto& instruction = code[i];
+            if (!IsLoad(instruction.op)) {
+                uint32_t lhs = instruction.lhs;
+                uint32_t rhs = instruction.rhs;
+                instruction.lhs = registers[lhs];
+                release(lhs, i);
+                if (!IsUnary(instruction.op)) {
+                    instruction.rhs = registers[rhs];
+                    if (rhs != lhs) {
+                        release(rhs, i);
+                    }
+                }
+            }
+
+            if (free_registers.empty()) {
+                registers[i] = register_count++;
+            } else {
+                registers[i] = free_registers.back();
+                free_registers.pop_back();
+            }
+            instruction.dst = registers[i];
+        }
+
+        program_.register_count_ = register_count;
+        program_.result_ = registers[result];
+    }
+
+    BytecodeProgram program_;
+    std::unordered_map<ExpressionPtr, uint32_t, ExpressionHash, ExpressionEqual> values_;
+    std::unordered_map<uint64_t, uint32_t> constants_;
+    uint32_t variables_[kVariableCount] = {
+        kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue,
+        kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue,
+        kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue,
+    };
+};
+
+BytecodeProgram BytecodeProgram::Compile(const ExpressionPtr& expr) {
+    return BytecodeCompiler().Compile(expr);
+}
+
+static double Pow(double base, double exp) {
+    return std::pow(base, exp);
+}
+
+static double Sqrt(double x) {
+    return std::sqrt(x);
+}
+
+static double Sin(double x) {
+    return std::sin(x);
+}
+
+static double Cos(double x) {
+    return std::cos(x);
+}
+
+static double Log(double x) {
+    return std::log(x);
+}
+
+static double Exp(double x) {
+    return std::exp(x);
+}
+
+/* One interpreter for plain values and dual numbers, the math functions resolve by overload */
+template <class Number>
+Number BytecodeProgram::Execute(const Number* variables, Number* registers) const {
+    Number* r = registers;
+    for (const auto& instruction : code_) {
+        switch (instruction.op) {
+            case OpCode::kLoadConstant:
+                r[instruction.dst] = constants_[instruction.lhs];
+                break;
+            case OpCode::kLoadVariable:
+                r[instruction.dst] = variables[instruction.lhs];
+                break;
+            case OpCode::kAdd:
+                r[instruction.dst] = r[instruction.lhs] + r[instruction.rhs];
+                break;
+            case OpCode::kSub:
+                r[instruction.dst] = r[instruction.lhs] - r[instruction.rhs];
+                break;
+            case OpCode::kMul:
+                r[instruction.dst] = r[instruction.lhs] * r[instruction.rhs];
+                break;
+            case OpCode::kDiv:
+                r[instruction.dst] = r[instruction.lhs] / r[instruction.rhs];
+                break;
+            case OpCode::kNeg:
+                r[instruction.dst] = -r[instruction.lhs];
+                break;
+            case OpCode::kPow:
+                r[instruction.dst] = Pow(r[instruction.lhs], r[instruction.rhs]);
+                break;
+            case OpCode::kSqrt:
+                r[instruction.dst] = Sqrt(r[instruction.lhs]);
+                break;
+            case OpCode::kSin:
+                r[instruction.dst] = Sin(r[instruction.lhs]);
+                break;
+            case OpCode::kCos:
+                r[instruction.dst] = Cos(r[instruction.lhs]);
+                break;
+            case OpCode::kLog:
+                r[instruction.dst] = Log(r[instruction.lhs]);
+                break;
+            case OpCode::kExp:
+                r[instruction.dst] = Exp(r[instruction.lhs]);
+                break;
+        }
+    }
+    return r[result_];
+}
+
+double BytecodeProgram::Evaluate(const double* variables, double* registers) const {
+    return Execute(variables, registers);
+}
+
+double BytecodeProgram::Evaluate(const double* variables) const {
+    if (register_count_ <= kStackRegisterCount) {
+        double registers[kStackRegisterCount];
+        return Evaluate(variables, registers);
+    }
+    std::vector<double> registers(register_count_);
+    return Evaluate(variables, registers.data());
+}
+
+Dual BytecodeProgram::EvaluateDual(const double* variables, const double* direction, Dual* registers) const {
+    Dual bindings[kVariableCount];
+    for (size_t i = 0; i < kVariableCount; ++i) {
+        bindings[i] = Dual(variables[i], direction[i]);
+    }
+    return Execute(bindings, registers);
+}
+
+Dual BytecodeProgram::EvaluateDual(const double* variables, const double* direction) const {
+    if (register_count_ <= kStackRegisterCount) {
+        Dual registers[kStackRegisterCount];
+        return EvaluateDual(variables, direction, registers);
+    }
+    std::vector<Dual> registers(register_count_);
+    return EvaluateDual(variables, direction, registers.data());
+}
+
+SimdLevel GetSimdLevel() {
+    static const SimdLevel level = [] {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+        if (GetAvx512BatchKernels() != nullptr && __builtin_cpu_supports("avx512f")) {
+            return SimdLevel::kAvx512;
+        }
+        if (GetAvx2BatchKernels() != nullptr && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return SimdLevel::kAvx2;
+        }
+#endif
+        return SimdLevel::kScalar;
+    }();
+    return level;
+}
+
+const BatchKernels* GetBatchKernels(SimdLevel level) {
+    if (level > GetSimdLevel()) {
+        throw RuntimeError("The requested instruction set is not supported");
+    }
+    switch (level) {
+        case SimdLevel::kAvx512:
+            return GetAvx512BatchKernels();
+        case SimdLevel::kAvx2:
+            return GetAvx2BatchKernels();
+        case SimdLevel::kScalar:
+            break;
+    }
+    return GetScalarBatchKernels();
+}
+
+void BytecodeProgram::EvaluateBatch(const double* const* variables, size_t count, double* result) const {
+    EvaluateBatch(variables, count, result, GetSimdLevel());
+}
+
+void BytecodeProgram::EvaluateBatch(const double* const* variables, size_t count, double* result,
+                                    SimdLevel level) const {
+    std::vector<double> registers(GetBatchScratchSize());
+    EvaluateBatch(variables, count, result, level, registers.data());
+}
+
+void BytecodeProgram::EvaluateBatch(const double* const* variables, size_t count, double* result,
+                                    SimdLevel level, double* registers) const {
+    const BatchKernels* kernels = GetBatchKernels(level);
+    for (const auto& instruction : code_) {
+        if (instruction.op == OpCode::kLoadVariable && variables[instruction.lhs] == nullptr) {
+            throw RuntimeError(std::string("No values given for variable ") + static_cast<char>('a' + instruction.lhs));
+        }
+    }
+
+    auto reg = [registers](uint32_t index) {
+        return registers + index * kBatchBlockSize;
+    };
+
+    for (size_t begin = 0; begin < count; begin += kBatchBlockSize) {
+        size_t size = std::min(kBatchBlockSize, count - begin);
+        for (const auto& instruction : code_) {
+            switch (instruction.op) {
+                case OpCode::kLoadConstant:
+                    std::fill_n(reg(instruction.dst), size, constants_[instruction.lhs]);
+                    break;
+                case OpCode::kLoadVariable:
+                    std::copy_n(variables[instruction.lhs] + begin, size, reg(instruction.dst));
+                    break;
+                default:
+                    kernels->ops[static_cast<size_t>(instruction.op)](
+                        reg(instruction.lhs), reg(instruction.rhs), reg(instruction.dst), size);
+                    break;
+            }
+        }
+        std::copy_n(reg(result_), size, result + begin);
+    }
+}
+
+static const char* OpCodeName(OpCode op) {
+    switch (op) {
+        case OpCode::kLoadConstant: return "const";
+        case OpCode::kLoadVariable: return "var";
+        case OpCode::kAdd: return "add";
+        case OpCode::kSub: return "sub";
+        case OpCode::kMul: return "mul";
+        case OpCode::kDiv: return "div";
+        case OpCode::kNeg: return "neg";
+        case OpCode::kPow: return "pow";
+        case OpCode::kSqrt: return "sqrt";
+        case OpCode::kSin: return "sin";
+        case OpCode::kCos: return "cos";
+        case OpCode::kLog: return "log";
+        case OpCode::kExp: return "exp";
+    }
+    return "?";
+}
+
+void BytecodeProgram::Print(std::ostream& out) const {
+    for (const auto& instruction : code_) {
+        out << 'r' << instruction.dst << " = " << OpCodeName(instruction.op) << ' ';
+        if (instruction.op == OpCode::kLoadConstant) {
+            out << constants_[instruction.lhs];
+        } else if (instruction.op == OpCode::kLoadVariable) {
+            out << static_cast<char>('a' + instruction.lhs);
+        } else if (IsUnary(instruction.op)) {
+            out << 'r' << instruction.lhs;
+        } else {
+            out << 'r' << instruction.lhs << ", r" << instruction.rhs;
+        }
+        out << '\n';
+    }
+    out << "ret r" << result_ << '\n';
+}
+
+}  /* namespace calculus */
@@ -2,30 +2,72 @@
 
 #include <ostream>
 #include <constant.h>
+#include <intern_table.h>
+#include <thread_pool.h>
 
 #define COMPARE_CHECK_TRIVIAL                                                   \
-    auto ptr = dynamic_cast<const std::decay_t<decltype(*this)>*>(other.get()); \
-    if (ptr == nullptr) {                                                       \
+    if (other.get() == this) {                                                  \
+        return true;                                                            \
+    }                                                                           \
+    if (other->GetKind() != kKind || other->GetHash() != hash_ ||              \
+            (IsInterned() && other->IsInterned())) {                            \
         return false;                                                           \
     }                                                                           \
-    if (ptr == this) {                                                          \
-        return true;                                                            \
-    }
+    auto ptr = static_cast<const std::decay_t<decltype(*this)>*>(other.get());
 
 namespace calculus {
 
+constexpr int kSmallIntegerBound = 256;
+// Integers up to this magnitude are exact doubles
+constexpr double kMaxExactDouble = 9007199254740992.0;
+
+/* An associative node simplifies its operands on the current thread pool if it has
+ * at least this many operands or its subtree is at least this heavy */
+constexpr size_t kParallelSimplifyMinOperands = 64;
+constexpr size_t kParallelSimplifyMinWeight = 4096;
+
+/* Polynomial subtrees are expanded unless some step takes more terms than this or the
+ * weight of the subtree, whichever is larger */
+constexpr size_t kPolynomialTermBudget = 256;
+
+/* Product derivatives split the factors in halves down to blocks of at most this many,
+ * which take the product rule as a flat sum */
+constexpr size_t kMaxFlatProductRuleFactors = 8;
+
 static inline bool IsZero(double x) {
     return std::fabs(x) < kDoubleTolerance;
 }
 
-template <class T>
-static inline const T* As(const ExpressionPtr& ptr) {
-    return dynamic_cast<const T*>(ptr.get());
+// Rationals are exact, doubles are compared within the tolerance
+static inline bool IsZero(const Number& number) {
+    return number.IsRational() ? number.IsZero() : IsZero(number.ToDouble());
+}
+
+static inline size_t HashCombine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+static inline size_t HashSeed(ExpressionKind kind) {
+    return HashCombine(0, static_cast<size_t>(kind));
+}
+
+static inline size_t HashOperand(const AssociativeOperand& operand) {
+    return HashCombine(operand.expr->GetHash(), operand.inverse ? 1 : 0);
 }
 
+void ForgetInterned(const Expression* expr);
+
+/* Interned constants for the integers in [-kSmallIntegerBound, kSmallIntegerBound] */
+const ExpressionPtr& SmallIntegerConstant(int value);
+
 template <class T>
 static inline bool Is(const ExpressionPtr& ptr) {
-    return As<T>(ptr) != nullptr;
+    return ptr->GetKind() == T::kKind;
+}
+
+template <class T>
+static inline const T* As(const ExpressionPtr& ptr) {
+    return Is<T>(ptr) ? static_cast<const T*>(ptr.get()) : nullptr;
 }
 
 template <class T>
@@ -41,6 +83,20 @@ static inline void AssociativeOpAlign(const std::vector<AssociativeOperand>& ope
     }
 }
 
+/* Calls body(i) for every i in [0, count), in parallel for nodes above the thresholds */
+template <class Body>
+static inline void ForEachOperand(size_t count, size_t weight, Body&& body) {
+    ThreadPool* pool = GetCurrentThreadPool();
+    if (pool != nullptr && pool->GetThreadCount() > 0 && count > 1 &&
+            (count >= kParallelSimplifyMinOperands || weight >= kParallelSimplifyMinWeight)) {
+        pool->ParallelFor(count, body);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        body(i);
+    }
+}
+
 static inline void MoveConstantsToEnd(std::vector<AssociativeOperand>* operands_ptr, int* last_nonconstant_ptr) {
     auto& operands = *operands_ptr;
     int& last_nonconstant = *last_nonconstant_ptr;
@@ -56,17 +112,92 @@ static inline void MoveConstantsToEnd(std::vector<AssociativeOperand>* operands_
     }
 }
 
-static inline ExpressionPtr BuildConstant(double x) {
-    if (IsZero(x)) {
-        return kConstantZero;
+static inline ExpressionPtr BuildConstant(int64_t value) {
+    if (std::abs(value) <= kSmallIntegerBound) {
+        return SmallIntegerConstant(static_cast<int>(value));
     }
-    if (IsZero(x - 1)) {
-        return kConstantOne;
+    return Make<Constant>(Number(value));
+}
+
+/* For floating point results: values within the tolerance of an integer or pi are taken as those */
+static inline ExpressionPtr BuildConstant(double x) {
+    double rounded = std::round(x);
+    if (IsZero(x - rounded) && std::fabs(rounded) <= kMaxExactDouble) {
+        return BuildConstant(static_cast<int64_t>(rounded));
     }
     if (IsZero(x - M_PI)) {
         return kConstantPi;
     }
-    return std::make_shared<Constant>(x);
+    return Make<Constant>(Number::Real(x));
 }
 
+static inline ExpressionPtr BuildConstant(const Number& number) {
+    if (!number.IsRational()) {
+        return BuildConstant(number.ToDouble());
+    }
+    int64_t value;
+    if (number.ToInt64(&value)) {
+        return BuildConstant(value);
+    }
+    return Make<Constant>(number);
+}
+
+static inline bool IsConstantEqual(const ExpressionPtr& expr, int value) {
+    return Is<Constant>(expr) && As<Constant>(expr)->GetNumber() == Number(value);
+}
+
+/* The expanded form of a polynomial subtree, or nullptr if it does not fit the polynomial
+ * kernel (see polynomial.h) or is heavier than the subtree */
+ExpressionPtr SimplifyPolynomial(const ExpressionPtr& expr);
+
+/* A product with the polynomial gcd of its polynomial multipliers and its inverse polynomial
+ * multipliers cancelled. Powers of bases the gcd is made of just lose an exponent, otherwise
+ * both sides are multiplied out. nullptr if that gcd is a constant or the result would be
+ * heavier than the product. */
+ExpressionPtr CancelRationalFunction(const ExpressionPtr& expr);
+
+/* A sum of polynomial fractions over one common denominator, made of the factors of the
+ * summands' denominators, with the gcd then cancelled as above. nullptr if some summand is
+ * no such fraction, none has a denominator, or the result would not be lighter than the sum. */
+ExpressionPtr CombineRationalFunctions(const ExpressionPtr& expr);
+
+/* A summand as coefficient * monomial, where the monomial is either the summand itself or
+ * the non-constant factors of a product */
+struct Term {
+    Number coefficient;
+    const ExpressionPtr* expr;
+    const AssociativeOperand* factors;
+    size_t count;
+
+    size_t GetSize() const {
+        return expr != nullptr ? 1 : count;
+    }
+
+    const ExpressionPtr& GetFactor(size_t i) const {
+        return expr != nullptr ? *expr : factors[i].expr;
+    }
+
+    bool IsInverse(size_t i) const {
+        return expr == nullptr && factors[i].inverse;
+    }
+};
+
+Term SplitTerm(const AssociativeOperand& summand);
+
+/* Lexicographic over the factors, zero iff the monomials are the same */
+int CompareMonomials(const Term& lhs, const Term& rhs);
+size_t HashMonomial(const Term& term);
+
+struct MonomialHash {
+    size_t operator()(const Term& term) const {
+        return HashMonomial(term);
+    }
+};
+
+struct MonomialEqual {
+    bool operator()(const Term& lhs, const Term& rhs) const {
+        return CompareMonomials(lhs, rhs) == 0;
+    }
+};
+
 }  /* namespace calculus */
@@ -1,11 +1,15 @@
 #include <call_op.h>
 #include <product.h>
 #include <differentiate_op.h>
+#include <function.h>
+#include <negate_op.h>
 #include "calculus_internal.h"
 
+#include <unordered_map>
+
 namespace calculus {
 
-ExpressionPtr CallOp::Simplify() {
+ExpressionPtr CallOp::DoSimplify() {
     std::vector<ExpressionPtr> simplified_args;
     simplified_args.reserve(args_.size());
     for (const auto& arg : args_) {
@@ -14,15 +18,60 @@ ExpressionPtr CallOp::Simplify() {
     return func_->Simplify()->Call(simplified_args);
 }
 
-ExpressionPtr CallOp::TakeDerivative(char var_name) {
-    if (args_.size() == 1) {
-        auto result = std::make_shared<Product>();
-        result->ReserveSize(2);
-        *result *= args_[0]->TakeDerivative(var_name);
-        *result *= std::make_shared<CallOp>(func_->TakeDerivative(var_name), args_);
+using CallDerivativeRule = ExpressionPtr (*)(const ExpressionPtr& call, const ExpressionPtr& arg);
+
+/* f'(u) for the functions of kTableOfDerivatives, built directly instead of calling the
+ * derivative function. Never modified after static initialization. */
+static const std::unordered_map<std::string, CallDerivativeRule> kCallDerivativeRules = {
+    {"sin", [](const ExpressionPtr&, const ExpressionPtr& arg) -> ExpressionPtr {
+        return Make<CallOp>(Make<Function>("cos"), std::vector<ExpressionPtr>{arg});
+    }},
+    {"cos", [](const ExpressionPtr&, const ExpressionPtr& arg) -> ExpressionPtr {
+        return Make<NegateOp>(Make<CallOp>(Make<Function>("sin"), std::vector<ExpressionPtr>{arg}));
+    }},
+    {"log", [](const ExpressionPtr&, const ExpressionPtr& arg) -> ExpressionPtr {
+        auto result = Allocate<Product>();
+        *result /= arg;
         return result;
+    }},
+    {"exp", [](const ExpressionPtr& call, const ExpressionPtr&) -> ExpressionPtr {
+        return call;
+    }},
+    {"id", [](const ExpressionPtr&, const ExpressionPtr&) -> ExpressionPtr {
+        return kConstantOne;
+    }},
+};
+
+ExpressionPtr CallOp::DoTakeDerivative(char var_name) {
+    if (args_.size() != 1) {
+        return Make<DifferentiateOp>(shared_from_this(), var_name);
+    }
+
+    // f(u)' = u' * f'(u), where a constant u' (a linear argument) is folded right away
+    auto arg_derivative = args_[0]->TakeDerivative(var_name)->Simplify();
+    if (IsConstantEqual(arg_derivative, 0)) {
+        return kConstantZero;
+    }
+
+    ExpressionPtr outer;
+    if (Is<Function>(func_)) {
+        auto rule = kCallDerivativeRules.find(As<Function>(func_)->GetName());
+        if (rule != kCallDerivativeRules.end()) {
+            outer = rule->second(shared_from_this(), args_[0]);
+        }
     }
-    return std::make_shared<DifferentiateOp>(shared_from_this(), var_name);
+    if (outer == nullptr) {
+        outer = Make<CallOp>(func_->TakeDerivative(var_name), args_);
+    }
+    if (IsConstantEqual(arg_derivative, 1)) {
+        return outer;
+    }
+
+    auto result = Allocate<Product>();
+    result->ReserveSize(2);
+    *result *= arg_derivative;
+    *result *= outer;
+    return result;
 }
 
 ExpressionPtr CallOp::Call(const std::vector<ExpressionPtr>&/* args*/) {
@@ -39,16 +88,15 @@ ExpressionPtr CallOp::Call(const std::vector<ExpressionPtr>&/* args*/) {
     */
 }
 
-ExpressionPtr CallOp::Substitute(char var_name, const ExpressionPtr& value) {
+ExpressionPtr CallOp::DoSubstitute(const Bindings& bindings) {
     std::vector<ExpressionPtr> new_args;
     new_args.reserve(args_.size());
 
     for (const auto& arg : args_) {
-        new_args.push_back(arg->Substitute(var_name, value));
+        new_args.push_back(arg->Substitute(bindings));
     }
 
-    return std::make_shared<CallOp>(func_->Substitute(var_name, value), new_args);
-
+    return Make<CallOp>(func_->Substitute(bindings), new_args);
 }
 
 void CallOp::Print(std::ostream& out, int cur_priority_level) const {
@@ -77,6 +125,14 @@ void CallOp::TexDump(std::ostream& out, int cur_priority_level) const {
     out << "\\right)";
 }
 
+size_t CallOp::ComputeHash() const {
+    size_t hash = HashCombine(HashSeed(kKind), func_->GetHash());
+    for (const auto& arg : args_) {
+        hash = HashCombine(hash, arg->GetHash());
+    }
+    return hash;
+}
+
 bool CallOp::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     if (args_.size() != ptr->args_.size()) {
@@ -3,11 +3,11 @@
 
 namespace calculus {
 
-ExpressionPtr Constant::Simplify() {
+ExpressionPtr Constant::DoSimplify() {
     return shared_from_this();
 }
 
-ExpressionPtr Constant::TakeDerivative(char) {
+ExpressionPtr Constant::DoTakeDerivative(char) {
     return kConstantZero;
 }
 
@@ -15,38 +15,62 @@ ExpressionPtr Constant::Call(const std::vector<ExpressionPtr>&) {
     return shared_from_this();
 }
 
-ExpressionPtr Constant::Substitute(char, const ExpressionPtr&) {
+ExpressionPtr Constant::DoSubstitute(const Bindings&) {
     return shared_from_this();
 }
 
+/* Negative numbers are parenthesized in products and powers, fractions in powers and divisors */
+static bool NeedsParentheses(const Number& number, int current_priority_level) {
+    return (number.Sign() < 0 && current_priority_level > kSumPriorityLevel) ||
+           (number.IsPrintedAsFraction() && current_priority_level > kProdPriorityLevel);
+}
+
 void Constant::Print(std::ostream& out, int current_priority_level) const {
-    if (value_ < 0 && current_priority_level > kSumPriorityLevel) {
+    bool parentheses = NeedsParentheses(number_, current_priority_level);
+    if (parentheses) {
         out << '(';
     }
-    out << value_;
-    if (value_ < 0 && current_priority_level > kSumPriorityLevel) {
+    number_.Print(out);
+    if (parentheses) {
         out << ')';
     }
 }
 
 void Constant::TexDump(std::ostream& out, int current_priority_level) const {
-    if (value_ < 0 && current_priority_level > kSumPriorityLevel) {
+    bool parentheses = NeedsParentheses(number_, current_priority_level);
+    if (parentheses) {
         out << "\\left(";
     }
-    out << value_;
-    if (value_ < 0 && current_priority_level > kSumPriorityLevel) {
+    number_.TexDump(out);
+    if (parentheses) {
         out << "\\right)";
     }
 }
 
+size_t Constant::ComputeHash() const {
+    return HashCombine(HashSeed(kKind), number_.Hash());
+}
+
 bool Constant::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
-    return std::fabs(value_ - ptr->value_) < kDoubleTolerance;
+    return number_ == ptr->number_;
+}
+
+const ExpressionPtr& SmallIntegerConstant(int value) {
+    static const std::vector<ExpressionPtr> table = [] {
+        std::vector<ExpressionPtr> constants;
+        constants.reserve(2 * kSmallIntegerBound + 1);
+        for (int i = -kSmallIntegerBound; i <= kSmallIntegerBound; ++i) {
+            constants.push_back(Make<Constant>(Number(i)));
+        }
+        return constants;
+    }();
+    return table[value + kSmallIntegerBound];
 }
 
-const ExpressionPtr kConstantZero   = std::make_shared<Constant>(0);
-const ExpressionPtr kConstantOne    = std::make_shared<Constant>(1);
-const ExpressionPtr kConstantNegOne = std::make_shared<Constant>(-1);
-const ExpressionPtr kConstantPi     = std::make_shared<Constant>(M_PI);
+const ExpressionPtr kConstantZero   = SmallIntegerConstant(0);
+const ExpressionPtr kConstantOne    = SmallIntegerConstant(1);
+const ExpressionPtr kConstantNegOne = SmallIntegerConstant(-1);
+const ExpressionPtr kConstantPi     = Make<Constant>(Number::Real(M_PI));
 
 }  /* namespace calculus */
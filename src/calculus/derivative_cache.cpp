@@ -0,0 +1,19 @@
+#include <derivative_cache.h>
+
+namespace calculus {
+
+static thread_local DerivativeCache* current_derivative_cache = nullptr;
+
+DerivativeCacheScope::DerivativeCacheScope(DerivativeCache* cache) : previous_(current_derivative_cache) {
+    current_derivative_cache = cache;
+}
+
+DerivativeCacheScope::~DerivativeCacheScope() {
+    current_derivative_cache = previous_;
+}
+
+DerivativeCache* GetCurrentDerivativeCache() {
+    return current_derivative_cache;
+}
+
+}  /* namespace calculus */
@@ -2,27 +2,55 @@
 #include <call_op.h>
 #include "calculus_internal.h"
 
+#include <algorithm>
+
 namespace calculus {
 
-ExpressionPtr DifferentiateOp::Simplify() {
-    return expr_->Simplify()->TakeDerivative(var_name_);
+ExpressionPtr DifferentiateOp::DoSimplify() {
+    // Mixed partial derivatives commute, so differentiate in alphabetical order to share cached results
+    ExpressionPtr inner_expr = expr_;
+    std::vector<char> variables = {var_name_};
+    while (Is<DifferentiateOp>(inner_expr)) {
+        variables.push_back(As<DifferentiateOp>(inner_expr)->var_name_);
+        inner_expr = As<DifferentiateOp>(inner_expr)->expr_;
+    }
+    std::sort(variables.begin(), variables.end());
+
+    auto result = inner_expr->Simplify();
+    for (size_t i = 0; i < variables.size(); ++i) {
+        result = result->TakeDerivative(variables[i]);
+        if (i + 1 < variables.size()) {
+            result = result->Simplify();
+        }
+    }
+    return result;
 }
 
-ExpressionPtr DifferentiateOp::TakeDerivative(char var_name) {
-    return std::make_shared<DifferentiateOp>(expr_->TakeDerivative(var_name_), var_name);
+ExpressionPtr DifferentiateOp::DoTakeDerivative(char var_name) {
+    return Make<DifferentiateOp>(expr_->TakeDerivative(var_name_), var_name);
 }
 
 ExpressionPtr DifferentiateOp::Call(const std::vector<ExpressionPtr>& args) {
     auto func = expr_->TakeDerivative(var_name_);
     if (Is<DifferentiateOp>(func)) {
-        return std::make_shared<CallOp>(func, args);
+        return Make<CallOp>(func, args);
     } else {
         return func->Call(args);
     }
 }
 
-ExpressionPtr DifferentiateOp::Substitute(char var_name, const ExpressionPtr& expr) {
-    return std::make_shared<DifferentiateOp>(expr_->Substitute(var_name, expr), var_name_);
+ExpressionPtr DifferentiateOp::DoSubstitute(const Bindings& bindings) {
+    // Substituting under the derivative is only sound if no binding involves its variable,
+    // otherwise (z'_z)[z = 1] would become 1'_z instead of 1
+    uint32_t mask = VariableMask(var_name_);
+    uint32_t involved = bindings.GetMask();
+    for (const auto& entry : bindings.GetEntries()) {
+        involved |= entry.value->GetFreeVariables();
+    }
+    if (mask == 0 || (involved & mask) != 0) {
+        return expr_->TakeDerivative(var_name_)->Substitute(bindings);
+    }
+    return Make<DifferentiateOp>(expr_->Substitute(bindings), var_name_);
 }
 
 void DifferentiateOp::Print(std::ostream& out, int cur_priority_level) const {
@@ -63,6 +91,10 @@ void DifferentiateOp::TexDump(std::ostream& out, int cur_priority_level) const {
     out << '}';
 }
 
+size_t DifferentiateOp::ComputeHash() const {
+    return HashCombine(HashCombine(HashSeed(kKind), expr_->GetHash()), var_name_);
+}
+
 bool DifferentiateOp::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     return var_name_ == ptr->var_name_ && expr_->DeepCompare(ptr->expr_);
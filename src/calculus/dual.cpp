@@ -0,0 +1,132 @@
+#include <dual.h>
+#include <bytecode.h>
+#include <visit.h>
+#include "calculus_internal.h"
+
+#include <unordered_map>
+
+namespace calculus {
+
+/* Walks the expression with every variable bound to a dual number. Shared subtrees are
+ * evaluated once; the memo holds its keys, so derivatives built on the way cannot be freed
+ * and have their addresses reused. */
+class DualEvaluator {
+public:
+    explicit DualEvaluator(const Dual* bindings) {
+        for (size_t i = 0; i < kVariableCount; ++i) {
+            bindings_[i] = bindings[i];
+        }
+    }
+
+    Dual Evaluate(const ExpressionPtr& expr) {
+        auto iter = values_.find(expr);
+        if (iter != values_.end()) {
+            return iter->second;
+        }
+        Dual value = Visit(expr, *this);
+        values_.emplace(expr, value);
+        return value;
+    }
+
+    Dual operator()(const Constant& expr) {
+        return expr.GetValue();
+    }
+
+    Dual operator()(const Variable& expr) {
+        char name = expr.GetName();
+        if (name < 'a' || name > 'z') {
+            throw RuntimeError(std::string("Cannot evaluate variable ") + name);
+        }
+        return bindings_[name - 'a'];
+    }
+
+    Dual operator()(const Function& expr) {
+        throw RuntimeError("Cannot evaluate function " + expr.GetName() + " without arguments");
+    }
+
+    Dual operator()(const Sum& expr) {
+        Dual result;
+        for (const auto& summand : expr.GetOperands()) {
+            Dual value = Evaluate(summand.expr);
+            result = summand.inverse ? result - value : result + value;
+        }
+        return result;
+    }
+
+    Dual operator()(const Product& expr) {
+        Dual result = 1;
+        for (const auto& multiplier : expr.GetOperands()) {
+            Dual value = Evaluate(multiplier.expr);
+            result = multiplier.inverse ? result / value : result * value;
+        }
+        return result;
+    }
+
+    Dual operator()(const PowerOp& expr) {
+        return Pow(Evaluate(expr.GetBase()), Evaluate(expr.GetExp()));
+    }
+
+    Dual operator()(const NegateOp& expr) {
+        return -Evaluate(expr.GetInnerExpr());
+    }
+
+    Dual operator()(const CallOp& expr) {
+        const auto& func = expr.GetFunction();
+        const auto& args = expr.GetArguments();
+        if (!Is<Function>(func)) {
+            auto called = func->Call(args);
+            if (Is<CallOp>(called) && !Is<Function>(As<CallOp>(called)->GetFunction())) {
+                throw RuntimeError("Cannot evaluate a call of a non-function expression");
+            }
+            return Evaluate(called);
+        }
+
+        const auto& name = As<Function>(func)->GetName();
+        if (args.size() != 1) {
+            throw RuntimeError("Argument count mismatch: expected 1, got " + std::to_string(args.size()));
+        }
+        Dual arg = Evaluate(args[0]);
+        if (name == "id") {
+            return arg;
+        } else if (name == "sin") {
+            return Sin(arg);
+        } else if (name == "cos") {
+            return Cos(arg);
+        } else if (name == "log") {
+            return Log(arg);
+        } else if (name == "exp") {
+            return Exp(arg);
+        }
+        throw RuntimeError("Cannot evaluate a call of unknown function " + name);
+    }
+
+    Dual operator()(const DifferentiateOp& expr) {
+        return Evaluate(expr.GetInnerExpr()->TakeDerivative(expr.GetVariable()));
+    }
+
+    Dual operator()(const SubstOp& expr) {
+        Dual bindings[kVariableCount];
+        for (size_t i = 0; i < kVariableCount; ++i) {
+            bindings[i] = bindings_[i];
+        }
+        // All values are taken in the outer scope, so [x = y, y = x] swaps the variables
+        for (const auto& entry : expr.GetBindings().GetEntries()) {
+            bindings[entry.var_name - 'a'] = Evaluate(entry.value);
+        }
+        return DualEvaluator(bindings).Evaluate(expr.GetTarget());
+    }
+
+private:
+    Dual bindings_[kVariableCount];
+    std::unordered_map<ExpressionPtr, Dual> values_;
+};
+
+Dual EvaluateDual(const ExpressionPtr& expr, const double* variables, const double* direction) {
+    Dual bindings[kVariableCount];
+    for (size_t i = 0; i < kVariableCount; ++i) {
+        bindings[i] = Dual(variables[i], direction[i]);
+    }
+    return DualEvaluator(bindings).Evaluate(expr);
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,1016 @@
+#include <expr_pool.h>
+#include <visit.h>
+#include "calculus_internal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+namespace calculus {
+
+static constexpr int kMaxPoolSimplifySteps = 100;
+static constexpr size_t kLetterCount = 'z' - 'a' + 1;
+
+static bool HasSlice(ExpressionKind kind) {
+    return kind == ExpressionKind::kSum || kind == ExpressionKind::kProduct || kind == ExpressionKind::kCallOp ||
+        kind == ExpressionKind::kSubstOp;
+}
+
+NodeIndex ExprPool::AddNode(const PoolNode& node, const std::vector<uint32_t>& slice) {
+    bool has_slice = HasSlice(node.kind);
+
+    size_t hash = HashCombine(HashSeed(node.kind), node.variable);
+    if (has_slice) {
+        for (uint32_t operand : slice) {
+            hash = HashCombine(hash, operand);
+        }
+    } else {
+        hash = HashCombine(HashCombine(hash, node.first), node.second);
+    }
+
+    auto range = node_indices_.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        const auto& candidate = nodes_[iter->second];
+        if (candidate.kind != node.kind || candidate.variable != node.variable) {
+            continue;
+        }
+        if (has_slice) {
+            if (candidate.second == slice.size() &&
+                    std::equal(slice.begin(), slice.end(), operands_.begin() + candidate.first)) {
+                return iter->second;
+            }
+        } else if (candidate.first == node.first && candidate.second == node.second) {
+            return iter->second;
+        }
+    }
+
+    if (nodes_.size() >= kInverseBit) {
+        throw RuntimeError("Expression pool is full");
+    }
+
+    PoolNode stored = node;
+    if (has_slice) {
+        stored.first = operands_.size();
+        stored.second = slice.size();
+        operands_.insert(operands_.end(), slice.begin(), slice.end());
+    }
+
+    NodeIndex index = nodes_.size();
+    nodes_.push_back(stored);
+    node_indices_.emplace(hash, index);
+    return index;
+}
+
+NodeIndex ExprPool::AddConstant(double value) {
+    if (value == 0) {
+        value = 0;  // -0.0 and 0.0 share one node
+    } else if (std::isnan(value)) {
+        value = std::numeric_limits<double>::quiet_NaN();  // as in Number, all NaNs are one
+    }
+
+    /* Constants are matched by bit pattern, so that a NaN finds its own node and a
+     * simplification that keeps producing it still reaches a fixpoint */
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    size_t hash = HashCombine(HashSeed(ExpressionKind::kConstant), bits);
+    auto range = node_indices_.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        const auto& candidate = nodes_[iter->second];
+        if (candidate.kind == ExpressionKind::kConstant &&
+                std::memcmp(&constants_[candidate.first], &value, sizeof(value)) == 0) {
+            return iter->second;
+        }
+    }
+
+    if (nodes_.size() >= kInverseBit) {
+        throw RuntimeError("Expression pool is full");
+    }
+
+    NodeIndex index = nodes_.size();
+    nodes_.push_back({ExpressionKind::kConstant, 0, static_cast<uint32_t>(constants_.size()), 0});
+    constants_.push_back(value);
+    node_indices_.emplace(hash, index);
+    return index;
+}
+
+NodeIndex ExprPool::AddVariable(char name) {
+    return AddNode({ExpressionKind::kVariable, name, 0, 0});
+}
+
+NodeIndex ExprPool::AddFunction(const std::string& name) {
+    auto iter = name_indices_.find(name);
+    if (iter == name_indices_.end()) {
+        iter = name_indices_.emplace(name, names_.size()).first;
+        names_.push_back(name);
+    }
+    return AddNode({ExpressionKind::kFunction, 0, iter->second, 0});
+}
+
+NodeIndex ExprPool::AddAssociative(ExpressionKind kind, const std::vector<PoolOperand>& operands) {
+    std::vector<uint32_t> slice;
+    slice.reserve(operands.size());
+    for (const auto& operand : operands) {
+        slice.push_back(operand.index | (operand.inverse ? kInverseBit : 0));
+    }
+    return AddNode({kind, 0, 0, 0}, slice);
+}
+
+NodeIndex ExprPool::AddSum(const std::vector<PoolOperand>& summands) {
+    return AddAssociative(ExpressionKind::kSum, summands);
+}
+
+NodeIndex ExprPool::AddProduct(const std::vector<PoolOperand>& multipliers) {
+    return AddAssociative(ExpressionKind::kProduct, multipliers);
+}
+
+NodeIndex ExprPool::AddPower(NodeIndex base, NodeIndex exp) {
+    return AddNode({ExpressionKind::kPowerOp, 0, base, exp});
+}
+
+NodeIndex ExprPool::AddNegate(NodeIndex expr) {
+    return AddNode({ExpressionKind::kNegateOp, 0, expr, 0});
+}
+
+NodeIndex ExprPool::AddCall(NodeIndex func, const std::vector<NodeIndex>& args) {
+    std::vector<uint32_t> slice;
+    slice.reserve(args.size() + 1);
+    slice.push_back(func);
+    slice.insert(slice.end(), args.begin(), args.end());
+    return AddNode({ExpressionKind::kCallOp, 0, 0, 0}, slice);
+}
+
+NodeIndex ExprPool::AddDerivative(NodeIndex expr, char var_name) {
+    return AddNode({ExpressionKind::kDifferentiateOp, var_name, expr, 0});
+}
+
+NodeIndex ExprPool::AddSubstitution(NodeIndex target, char var_name, NodeIndex value) {
+    return AddSubstitution(target, {{var_name, value}});
+}
+
+NodeIndex ExprPool::AddSubstitution(NodeIndex target, std::vector<std::pair<char, NodeIndex>> bindings) {
+    std::sort(bindings.begin(), bindings.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    std::vector<uint32_t> slice;
+    slice.reserve(2 * bindings.size() + 1);
+    slice.push_back(target);
+    for (const auto& binding : bindings) {
+        if (slice.size() > 1 && slice[slice.size() - 2] == static_cast<uint32_t>(binding.first)) {
+            throw RuntimeError(std::string("Variable ") + binding.first + " is bound twice");
+        }
+        slice.push_back(binding.first);
+        slice.push_back(binding.second);
+    }
+    return AddNode({ExpressionKind::kSubstOp, 0, 0, 0}, slice);
+}
+
+size_t ExprPool::GetMemoryUsage() const {
+    size_t result = nodes_.capacity() * sizeof(PoolNode) + operands_.capacity() * sizeof(uint32_t) +
+        constants_.capacity() * sizeof(double) + simplified_.capacity() * sizeof(NodeIndex);
+    for (const auto& name : names_) {
+        result += sizeof(name) + name.capacity();
+    }
+    return result;
+}
+
+NodeIndex ExprPool::FromExpression(const ExpressionPtr& expr) {
+    std::unordered_map<const Expression*, NodeIndex> converted;
+
+    std::function<NodeIndex(const ExpressionPtr&)> convert = [&](const ExpressionPtr& node) -> NodeIndex {
+        auto iter = converted.find(node.get());
+        if (iter != converted.end()) {
+            return iter->second;
+        }
+
+        auto convert_operands = [&](const std::vector<AssociativeOperand>& operands) {
+            std::vector<PoolOperand> result;
+            result.reserve(operands.size());
+            for (const auto& operand : operands) {
+                result.push_back({convert(operand.expr), operand.inverse});
+            }
+            return result;
+        };
+
+        NodeIndex index = Visit(node, [&](const auto& typed) -> NodeIndex {
+            using T = std::decay_t<decltype(typed)>;
+            if constexpr (std::is_same_v<T, Constant>) {
+                return AddConstant(typed.GetValue());
+            } else if constexpr (std::is_same_v<T, Variable>) {
+                return AddVariable(typed.GetName());
+            } else if constexpr (std::is_same_v<T, Function>) {
+                return AddFunction(typed.GetName());
+            } else if constexpr (std::is_same_v<T, Sum>) {
+                return AddSum(convert_operands(typed.GetOperands()));
+            } else if constexpr (std::is_same_v<T, Product>) {
+                return AddProduct(convert_operands(typed.GetOperands()));
+            } else if constexpr (std::is_same_v<T, PowerOp>) {
+                NodeIndex base = convert(typed.GetBase());
+                return AddPower(base, convert(typed.GetExp()));
+            } else if constexpr (std::is_same_v<T, NegateOp>) {
+                return AddNegate(convert(typed.GetInnerExpr()));
+            } else if constexpr (std::is_same_v<T, CallOp>) {
+                NodeIndex func = convert(typed.GetFunction());
+                std::vector<NodeIndex> args;
+                args.reserve(typed.GetArguments().size());
+                for (const auto& arg : typed.GetArguments()) {
+                    args.push_back(convert(arg));
+                }
+                return AddCall(func, args);
+            } else if constexpr (std::is_same_v<T, DifferentiateOp>) {
+                return AddDerivative(convert(typed.GetInnerExpr()), typed.GetVariable());
+            } else {
+                NodeIndex target = convert(typed.GetTarget());
+                std::vector<std::pair<char, NodeIndex>> bindings;
+                for (const auto& entry : typed.GetBindings().GetEntries()) {
+                    bindings.emplace_back(entry.var_name, convert(entry.value));
+                }
+                return AddSubstitution(target, std::move(bindings));
+            }
+        });
+
+        converted.emplace(node.get(), index);
+        return index;
+    };
+
+    return convert(expr);
+}
+
+ExpressionPtr ExprPool::ToExpression(NodeIndex root) const {
+    std::vector<ExpressionPtr> built(root + 1);
+
+    std::function<const ExpressionPtr&(NodeIndex)> build = [&](NodeIndex index) -> const ExpressionPtr& {
+        if (built[index] != nullptr) {
+            return built[index];
+        }
+
+        const auto& node = nodes_[index];
+        ExpressionPtr result;
+        switch (node.kind) {
+            case ExpressionKind::kConstant:
+                result = BuildConstant(constants_[node.first]);
+                break;
+            case ExpressionKind::kVariable:
+                result = Make<Variable>(node.variable);
+                break;
+            case ExpressionKind::kFunction:
+                result = Make<Function>(names_[node.first]);
+                break;
+            case ExpressionKind::kSum:
+            case ExpressionKind::kProduct:
+            {
+                std::vector<AssociativeOperand> operands;
+                operands.reserve(node.second);
+                for (uint32_t i = 0; i < node.second; ++i) {
+                    auto operand = GetOperand(index, i);
+                    operands.emplace_back(build(operand.index), operand.inverse);
+                }
+                if (node.kind == ExpressionKind::kSum) {
+                    result = Make<Sum>(std::move(operands));
+                } else {
+                    result = Make<Product>(std::move(operands));
+                }
+                break;
+            }
+            case ExpressionKind::kPowerOp:
+                result = Make<PowerOp>(build(node.first), build(node.second));
+                break;
+            case ExpressionKind::kNegateOp:
+                result = Make<NegateOp>(build(node.first));
+                break;
+            case ExpressionKind::kCallOp:
+            {
+                std::vector<ExpressionPtr> args;
+                args.reserve(node.second - 1);
+                for (uint32_t i = 1; i < node.second; ++i) {
+                    args.push_back(build(operands_[node.first + i]));
+                }
+                result = Make<CallOp>(build(operands_[node.first]), std::move(args));
+                break;
+            }
+            case ExpressionKind::kDifferentiateOp:
+                result = Make<DifferentiateOp>(build(node.first), node.variable);
+                break;
+            case ExpressionKind::kSubstOp:
+            {
+                Bindings bindings;
+                for (uint32_t i = 1; i < node.second; i += 2) {
+                    bindings.Bind(static_cast<char>(operands_[node.first + i]), build(operands_[node.first + i + 1]));
+                }
+                result = Make<SubstOp>(build(operands_[node.first]), std::move(bindings));
+                break;
+            }
+        }
+        built[index] = std::move(result);
+        return built[index];
+    };
+
+    return build(root);
+}
+
+bool ExprPool::IsConstant(NodeIndex index) const {
+    return nodes_[index].kind == ExpressionKind::kConstant;
+}
+
+bool ExprPool::IsConstant(NodeIndex index, double value) const {
+    return IsConstant(index) && IsZero(GetConstant(index) - value);
+}
+
+NodeIndex ExprPool::Simplify(NodeIndex root) {
+    for (int step = 0; step < kMaxPoolSimplifySteps; ++step) {
+        NodeIndex simplified = SimplifyNode(root);
+        if (simplified == root) {
+            return root;
+        }
+        root = simplified;
+    }
+    throw RuntimeError("The maximum iterations number has been exceeded.");
+}
+
+NodeIndex ExprPool::SimplifyNode(NodeIndex index) {
+    if (index < simplified_.size() && simplified_[index] != kInvalidNodeIndex) {
+        return simplified_[index];
+    }
+
+    NodeIndex result = index;
+    const PoolNode node = nodes_[index];
+    switch (node.kind) {
+        case ExpressionKind::kConstant:
+        case ExpressionKind::kVariable:
+        case ExpressionKind::kFunction:
+            break;
+        case ExpressionKind::kSum:
+            result = SimplifySum(index);
+            break;
+        case ExpressionKind::kProduct:
+            result = SimplifyProduct(index);
+            break;
+        case ExpressionKind::kPowerOp:
+            result = SimplifyPower(index);
+            break;
+        case ExpressionKind::kNegateOp:
+        {
+            NodeIndex inner = SimplifyNode(node.first);
+            if (IsConstant(inner)) {
+                result = AddConstant(-GetConstant(inner));
+            } else if (nodes_[inner].kind == ExpressionKind::kNegateOp) {
+                result = nodes_[inner].first;
+            } else {
+                result = AddNegate(inner);
+            }
+            break;
+        }
+        case ExpressionKind::kCallOp:
+            result = SimplifyCall(index);
+            break;
+        case ExpressionKind::kDifferentiateOp:
+            result = SimplifyNode(TakeDerivative(SimplifyNode(node.first), node.variable));
+            break;
+        case ExpressionKind::kSubstOp:
+        {
+            std::vector<std::pair<char, NodeIndex>> bindings;
+            for (uint32_t i = 1; i < node.second; i += 2) {
+                bindings.emplace_back(operands_[node.first + i], SimplifyNode(operands_[node.first + i + 1]));
+            }
+            result = SimplifyNode(Substitute(SimplifyNode(operands_[node.first]), bindings));
+            break;
+        }
+    }
+
+    if (simplified_.size() < nodes_.size()) {
+        simplified_.resize(nodes_.size(), kInvalidNodeIndex);
+    }
+    simplified_[index] = result;
+    return result;
+}
+
+void ExprPool::FlattenOperands(NodeIndex index, bool global_inverse, std::vector<PoolOperand>* result) const {
+    ExpressionKind kind = nodes_[index].kind;
+    for (uint32_t i = 0; i < nodes_[index].second; ++i) {
+        auto operand = GetOperand(index, i);
+        operand.inverse ^= global_inverse;
+        if (nodes_[operand.index].kind == kind) {
+            FlattenOperands(operand.index, operand.inverse, result);
+        } else {
+            result->push_back(operand);
+        }
+    }
+}
+
+NodeIndex ExprPool::SimplifySum(NodeIndex index) {
+    std::vector<PoolOperand> summands;
+    FlattenOperands(index, false, &summands);
+
+    double constant = 0;
+    std::vector<NodeIndex> monomials;
+    std::unordered_map<NodeIndex, double> coefficients;
+
+    auto add_term = [&](NodeIndex monomial, double coefficient) {
+        auto iter = coefficients.find(monomial);
+        if (iter == coefficients.end()) {
+            monomials.push_back(monomial);
+            coefficients.emplace(monomial, coefficient);
+        } else {
+            iter->second += coefficient;
+        }
+    };
+
+    for (size_t i = 0; i < summands.size(); ++i) {
+        auto summand = summands[i];
+        NodeIndex expr = SimplifyNode(summand.index);
+        double sign = summand.inverse ? -1 : 1;
+        if (nodes_[expr].kind == ExpressionKind::kNegateOp) {
+            expr = nodes_[expr].first;
+            sign = -sign;
+        }
+
+        if (IsConstant(expr)) {
+            constant += sign * GetConstant(expr);
+            continue;
+        }
+        if (nodes_[expr].kind == ExpressionKind::kSum) {
+            FlattenOperands(expr, sign < 0, &summands);
+            continue;
+        }
+
+        double coefficient = sign;
+        NodeIndex monomial = expr;
+        if (nodes_[expr].kind == ExpressionKind::kProduct) {
+            std::vector<PoolOperand> rest;
+            for (uint32_t i = 0; i < nodes_[expr].second; ++i) {
+                auto operand = GetOperand(expr, i);
+                if (IsConstant(operand.index) && !operand.inverse) {
+                    coefficient *= GetConstant(operand.index);
+                } else {
+                    rest.push_back(operand);
+                }
+            }
+            if (rest.size() == 1 && !rest[0].inverse) {
+                monomial = rest[0].index;
+            } else if (rest.size() != nodes_[expr].second) {
+                monomial = AddProduct(rest);
+            }
+        }
+        add_term(monomial, coefficient);
+    }
+
+    std::vector<PoolOperand> result;
+    for (NodeIndex monomial : monomials) {
+        double coefficient = coefficients[monomial];
+        if (IsZero(coefficient)) {
+            continue;
+        }
+        if (IsZero(std::fabs(coefficient) - 1)) {
+            result.push_back({monomial, coefficient < 0});
+        } else {
+            NodeIndex term = AddProduct({{monomial, false}, {AddConstant(std::fabs(coefficient)), false}});
+            result.push_back({SimplifyNode(term), coefficient < 0});
+        }
+    }
+    if (!IsZero(constant) || result.empty()) {
+        result.push_back({AddConstant(std::fabs(constant)), constant < 0});
+    }
+
+    if (result.size() == 1) {
+        if (!result[0].inverse) {
+            return result[0].index;
+        }
+        // A negative constant stays a constant, as NegateOp simplification leaves it
+        return IsConstant(result[0].index) ? AddConstant(-GetConstant(result[0].index)) : AddNegate(result[0].index);
+    }
+    return AddSum(result);
+}
+
+NodeIndex ExprPool::SimplifyProduct(NodeIndex index) {
+    std::vector<PoolOperand> multipliers;
+    FlattenOperands(index, false, &multipliers);
+
+    bool negate = false;
+    double constant = 1;
+    std::vector<NodeIndex> bases;
+    std::unordered_map<NodeIndex, std::vector<PoolOperand>> exponents;
+
+    for (size_t i = 0; i < multipliers.size(); ++i) {
+        auto multiplier = multipliers[i];
+        NodeIndex expr = SimplifyNode(multiplier.index);
+        if (nodes_[expr].kind == ExpressionKind::kNegateOp) {
+            expr = nodes_[expr].first;
+            negate ^= true;
+        }
+
+        if (IsConstant(expr)) {
+            double value = GetConstant(expr);
+            if (multiplier.inverse) {
+                if (IsZero(value)) {
+                    throw RuntimeError("Division by zero");
+                }
+                constant /= value;
+            } else {
+                constant *= value;
+            }
+            continue;
+        }
+        if (nodes_[expr].kind == ExpressionKind::kProduct) {
+            FlattenOperands(expr, multiplier.inverse, &multipliers);
+            continue;
+        }
+
+        NodeIndex base = expr;
+        NodeIndex exp = AddConstant(1);
+        if (nodes_[expr].kind == ExpressionKind::kPowerOp) {
+            base = nodes_[expr].first;
+            exp = nodes_[expr].second;
+        }
+        auto iter = exponents.find(base);
+        if (iter == exponents.end()) {
+            bases.push_back(base);
+            iter = exponents.emplace(base, std::vector<PoolOperand>()).first;
+        }
+        iter->second.push_back({exp, multiplier.inverse});
+    }
+
+    if (IsZero(constant)) {
+        return AddConstant(0);
+    }
+    if (constant < 0) {
+        constant = -constant;
+        negate ^= true;
+    }
+
+    std::vector<PoolOperand> result;
+    for (NodeIndex base : bases) {
+        const auto& exps = exponents[base];
+        NodeIndex exp = exps.size() == 1 && !exps[0].inverse ? exps[0].index : SimplifyNode(AddSum(exps));
+        bool inverse = false;
+        if (IsConstant(exp) && GetConstant(exp) < 0) {
+            exp = AddConstant(-GetConstant(exp));
+            inverse = true;
+        } else if (nodes_[exp].kind == ExpressionKind::kNegateOp) {
+            exp = nodes_[exp].first;
+            inverse = true;
+        }
+
+        if (IsConstant(exp, 0)) {
+            continue;
+        }
+        NodeIndex power = IsConstant(exp, 1) ? base : SimplifyNode(AddPower(base, exp));
+        if (IsConstant(power)) {
+            double value = GetConstant(power);
+            if (inverse && IsZero(value)) {
+                throw RuntimeError("Division by zero");
+            }
+            constant = inverse ? constant / value : constant * value;
+            continue;
+        }
+        result.push_back({power, inverse});
+    }
+
+    if (result.empty()) {
+        return AddConstant(negate ? -constant : constant);
+    }
+    if (!IsZero(constant - 1)) {
+        result.push_back({AddConstant(constant), false});
+    }
+
+    NodeIndex product = (result.size() == 1 && !result[0].inverse) ? result[0].index : AddProduct(result);
+    return negate ? AddNegate(product) : product;
+}
+
+NodeIndex ExprPool::SimplifyPower(NodeIndex index) {
+    NodeIndex base = SimplifyNode(nodes_[index].first);
+    NodeIndex exp = SimplifyNode(nodes_[index].second);
+
+    if (IsConstant(base, 1) || IsConstant(exp, 0)) {
+        return AddConstant(1);
+    }
+    if (IsConstant(base, 0)) {
+        return AddConstant(0);
+    }
+    if (IsConstant(exp, 1)) {
+        return base;
+    }
+    if (IsConstant(base) && IsConstant(exp)) {
+        return AddConstant(std::pow(GetConstant(base), GetConstant(exp)));
+    }
+    if (nodes_[base].kind == ExpressionKind::kPowerOp) {
+        NodeIndex new_exp = SimplifyNode(AddProduct({{nodes_[base].second, false}, {exp, false}}));
+        return SimplifyNode(AddPower(nodes_[base].first, new_exp));
+    }
+    if (nodes_[base].kind == ExpressionKind::kProduct) {
+        std::vector<PoolOperand> multipliers;
+        for (uint32_t i = 0; i < nodes_[base].second; ++i) {
+            auto operand = GetOperand(base, i);
+            multipliers.push_back({AddPower(operand.index, exp), operand.inverse});
+        }
+        return SimplifyNode(AddProduct(multipliers));
+    }
+    return AddPower(base, exp);
+}
+
+NodeIndex ExprPool::SimplifyCall(NodeIndex index) {
+    const PoolNode node = nodes_[index];
+    NodeIndex func = SimplifyNode(operands_[node.first]);
+    std::vector<NodeIndex> args;
+    args.reserve(node.second - 1);
+    for (uint32_t i = 1; i < node.second; ++i) {
+        args.push_back(SimplifyNode(operands_[node.first + i]));
+    }
+    return Call(func, args);
+}
+
+NodeIndex ExprPool::Call(NodeIndex func, const std::vector<NodeIndex>& args) {
+    const PoolNode node = nodes_[func];
+    switch (node.kind) {
+        case ExpressionKind::kConstant:
+        case ExpressionKind::kVariable:
+        case ExpressionKind::kCallOp:
+            return func;
+        case ExpressionKind::kFunction:
+            break;
+        case ExpressionKind::kSum:
+        case ExpressionKind::kProduct:
+        {
+            std::vector<PoolOperand> operands;
+            operands.reserve(node.second);
+            for (uint32_t i = 0; i < node.second; ++i) {
+                auto operand = GetOperand(func, i);
+                operands.push_back({Call(operand.index, args), operand.inverse});
+            }
+            return AddAssociative(node.kind, operands);
+        }
+        case ExpressionKind::kPowerOp:
+        {
+            NodeIndex base = Call(node.first, args);
+            return AddPower(base, Call(node.second, args));
+        }
+        case ExpressionKind::kNegateOp:
+            return AddNegate(Call(node.first, args));
+        case ExpressionKind::kDifferentiateOp:
+        {
+            NodeIndex derivative = TakeDerivative(node.first, node.variable);
+            if (nodes_[derivative].kind == ExpressionKind::kDifferentiateOp) {
+                return AddCall(derivative, args);
+            }
+            return Call(derivative, args);
+        }
+        case ExpressionKind::kSubstOp:
+            return Call(SimplifyNode(func), args);
+    }
+
+    if (args.size() != 1) {
+        throw RuntimeError("Argument count mismatch: expected 1, got " + std::to_string(args.size()));
+    }
+
+    const auto& name = GetFunctionName(func);
+    if (name == "id") {
+        return args[0];
+    }
+    if (IsConstant(args[0])) {
+        double arg = GetConstant(args[0]);
+        if (name == "sin") {
+            return AddConstant(std::sin(arg));
+        } else if (name == "cos") {
+            return AddConstant(std::cos(arg));
+        } else if (name == "log") {
+            return AddConstant(std::log(arg));
+        } else if (name == "exp") {
+            return AddConstant(std::exp(arg));
+        }
+    }
+    return AddCall(func, args);
+}
+
+NodeIndex ExprPool::FunctionDerivative(NodeIndex func) {
+    const auto& name = GetFunctionName(func);
+    if (name == "sin") {
+        return AddFunction("cos");
+    } else if (name == "cos") {
+        return AddNegate(AddFunction("sin"));
+    } else if (name == "log") {
+        return AddProduct({{AddFunction("id"), true}});
+    } else if (name == "exp") {
+        return func;
+    } else if (name == "id") {
+        return AddConstant(1);
+    }
+    return AddDerivative(func, kDefaultDerivativeVariable);
+}
+
+NodeIndex ExprPool::TakeDerivative(NodeIndex root, char var_name) {
+    std::unordered_map<NodeIndex, NodeIndex> derivatives;
+
+    std::function<NodeIndex(NodeIndex)> derive = [&](NodeIndex index) -> NodeIndex {
+        auto iter = derivatives.find(index);
+        if (iter != derivatives.end()) {
+            return iter->second;
+        }
+
+        const PoolNode node = nodes_[index];
+        NodeIndex result = kInvalidNodeIndex;
+        switch (node.kind) {
+            case ExpressionKind::kConstant:
+                result = AddConstant(0);
+                break;
+            case ExpressionKind::kVariable:
+                result = AddConstant(node.variable == var_name ? 1 : 0);
+                break;
+            case ExpressionKind::kFunction:
+                result = FunctionDerivative(index);
+                break;
+            case ExpressionKind::kSum:
+            {
+                std::vector<PoolOperand> summands;
+                for (uint32_t i = 0; i < node.second; ++i) {
+                    auto operand = GetOperand(index, i);
+                    NodeIndex derivative = derive(operand.index);
+                    if (!IsConstant(derivative, 0)) {
+                        summands.push_back({derivative, operand.inverse});
+                    }
+                }
+                result = summands.empty() ? AddConstant(0) : AddSum(summands);
+                break;
+            }
+            case ExpressionKind::kProduct:
+            {
+                std::vector<PoolOperand> summands;
+                for (uint32_t i = 0; i < node.second; ++i) {
+                    auto operand = GetOperand(index, i);
+                    NodeIndex derivative = derive(operand.index);
+                    if (IsConstant(derivative, 0)) {
+                        continue;
+                    }
+                    std::vector<PoolOperand> multipliers;
+                    multipliers.reserve(node.second + 1);
+                    for (uint32_t j = 0; j < node.second; ++j) {
+                        if (j != i) {
+                            multipliers.push_back(GetOperand(index, j));
+                        }
+                    }
+                    multipliers.push_back({derivative, false});
+                    if (operand.inverse) {
+                        multipliers.push_back({AddPower(operand.index, AddConstant(2)), true});
+                    }
+                    summands.push_back({AddProduct(multipliers), operand.inverse});
+                }
+                result = summands.empty() ? AddConstant(0) : AddSum(summands);
+                break;
+            }
+            case ExpressionKind::kPowerOp:
+            {
+                NodeIndex base = node.first;
+                NodeIndex exp = node.second;
+                NodeIndex base_derivative = derive(base);
+                if (IsConstant(exp)) {
+                    result = AddProduct({
+                        {AddConstant(GetConstant(exp)), false},
+                        {AddPower(base, AddConstant(GetConstant(exp) - 1)), false},
+                        {base_derivative, false},
+                    });
+                    break;
+                }
+                NodeIndex log_base = AddCall(AddFunction("log"), {base});
+                NodeIndex sum = AddSum({
+                    {AddProduct({{derive(exp), false}, {log_base, false}}), false},
+                    {AddProduct({{exp, false}, {base_derivative, false}, {base, true}}), false},
+                });
+                result = AddProduct({{sum, false}, {index, false}});
+                break;
+            }
+            case ExpressionKind::kNegateOp:
+                result = AddNegate(derive(node.first));
+                break;
+            case ExpressionKind::kCallOp:
+            {
+                NodeIndex func = operands_[node.first];
+                if (node.second == 2) {
+                    NodeIndex arg = operands_[node.first + 1];
+                    NodeIndex func_derivative = nodes_[func].kind == ExpressionKind::kFunction
+                        ? FunctionDerivative(func) : derive(func);
+                    result = AddProduct({{derive(arg), false}, {AddCall(func_derivative, {arg}), false}});
+                } else {
+                    result = AddDerivative(index, var_name);
+                }
+                break;
+            }
+            case ExpressionKind::kDifferentiateOp:
+                result = TakeDerivative(TakeDerivative(node.first, node.variable), var_name);
+                break;
+            case ExpressionKind::kSubstOp:
+                result = TakeDerivative(SimplifyNode(index), var_name);
+                break;
+        }
+
+        derivatives.emplace(index, result);
+        return result;
+    };
+
+    return derive(root);
+}
+
+NodeIndex ExprPool::Substitute(NodeIndex root, char var_name, NodeIndex value) {
+    return Substitute(root, {{var_name, value}});
+}
+
+NodeIndex ExprPool::Substitute(NodeIndex root, const std::vector<std::pair<char, NodeIndex>>& bindings) {
+    NodeIndex values[kLetterCount];
+    std::fill_n(values, kLetterCount, kInvalidNodeIndex);
+    for (const auto& binding : bindings) {
+        if (VariableMask(binding.first) == 0) {
+            throw RuntimeError(std::string("Cannot substitute variable ") + binding.first);
+        }
+        values[binding.first - 'a'] = binding.second;
+    }
+    std::unordered_map<NodeIndex, NodeIndex> substituted;
+
+    std::function<NodeIndex(NodeIndex)> substitute = [&](NodeIndex index) -> NodeIndex {
+        auto iter = substituted.find(index);
+        if (iter != substituted.end()) {
+            return iter->second;
+        }
+
+        const PoolNode node = nodes_[index];
+        NodeIndex result = index;
+        switch (node.kind) {
+            case ExpressionKind::kConstant:
+            case ExpressionKind::kFunction:
+                break;
+            case ExpressionKind::kVariable:
+                if (VariableMask(node.variable) != 0 && values[node.variable - 'a'] != kInvalidNodeIndex) {
+                    result = values[node.variable - 'a'];
+                }
+                break;
+            case ExpressionKind::kSum:
+            case ExpressionKind::kProduct:
+            {
+                std::vector<PoolOperand> operands;
+                operands.reserve(node.second);
+                for (uint32_t i = 0; i < node.second; ++i) {
+                    auto operand = GetOperand(index, i);
+                    operands.push_back({substitute(operand.index), operand.inverse});
+                }
+                result = AddAssociative(node.kind, operands);
+                break;
+            }
+            case ExpressionKind::kPowerOp:
+            {
+                NodeIndex base = substitute(node.first);
+                result = AddPower(base, substitute(node.second));
+                break;
+            }
+            case ExpressionKind::kNegateOp:
+                result = AddNegate(substitute(node.first));
+                break;
+            case ExpressionKind::kCallOp:
+            {
+                NodeIndex func = substitute(operands_[node.first]);
+                std::vector<NodeIndex> args;
+                for (uint32_t i = 1; i < node.second; ++i) {
+                    args.push_back(substitute(operands_[node.first + i]));
+                }
+                result = AddCall(func, args);
+                break;
+            }
+            case ExpressionKind::kDifferentiateOp:
+                result = AddDerivative(substitute(node.first), node.variable);
+                break;
+            case ExpressionKind::kSubstOp:
+                result = substitute(SimplifyNode(index));
+                break;
+        }
+
+        substituted.emplace(index, result);
+        return result;
+    };
+
+    return substitute(root);
+}
+
+void ExprPool::Print(std::ostream& out, NodeIndex root, int cur_priority_level) const {
+    const PoolNode& node = nodes_[root];
+    switch (node.kind) {
+        case ExpressionKind::kConstant:
+        {
+            double value = GetConstant(root);
+            if (value < 0 && cur_priority_level > kSumPriorityLevel) {
+                out << '(' << value << ')';
+            } else {
+                out << value;
+            }
+            break;
+        }
+        case ExpressionKind::kVariable:
+            out << node.variable;
+            break;
+        case ExpressionKind::kFunction:
+            out << GetFunctionName(root);
+            break;
+        case ExpressionKind::kSum:
+        {
+            if (cur_priority_level > kSumPriorityLevel) {
+                out << '(';
+            }
+            for (uint32_t i = 0; i < node.second; ++i) {
+                auto operand = GetOperand(root, i);
+                if (i > 0) {
+                    out << (operand.inverse ? " - " : " + ");
+                } else if (operand.inverse) {
+                    out << '-';
+                }
+                Print(out, operand.index, kSumPriorityLevel + (operand.inverse ? 1 : 0));
+            }
+            if (cur_priority_level > kSumPriorityLevel) {
+                out << ')';
+            }
+            break;
+        }
+        case ExpressionKind::kProduct:
+        {
+            if (cur_priority_level > kProdPriorityLevel) {
+                out << '(';
+            }
+            uint32_t count = node.second;
+            auto first = GetOperand(root, 0);
+            if (first.inverse) {
+                auto last = GetOperand(root, count - 1);
+                if (IsConstant(last.index) && !last.inverse) {
+                    out << GetConstant(last.index) << " / ";
+                    --count;
+                } else {
+                    out << "1 / ";
+                }
+            }
+            Print(out, first.index, kProdPriorityLevel + (first.inverse ? 1 : 0));
+            for (uint32_t i = 1; i < count; ++i) {
+                auto operand = GetOperand(root, i);
+                out << (operand.inverse ? " / " : " * ");
+                Print(out, operand.index, kProdPriorityLevel + (operand.inverse ? 1 : 0));
+            }
+            if (cur_priority_level > kProdPriorityLevel) {
+                out << ')';
+            }
+            break;
+        }
+        case ExpressionKind::kPowerOp:
+            if (cur_priority_level > kPostfixOpPriorityLevel) {
+                out << '(';
+            }
+            Print(out, node.first, kPostfixOpPriorityLevel);
+            out << " ^ ";
+            Print(out, node.second, kPostfixOpPriorityLevel);
+            if (cur_priority_level > kPostfixOpPriorityLevel) {
+                out << ')';
+            }
+            break;
+        case ExpressionKind::kNegateOp:
+            out << '-';
+            if (cur_priority_level > kPrefixOpPriorityLevel) {
+                out << '(';
+            }
+            Print(out, node.first, kPrefixOpPriorityLevel);
+            if (cur_priority_level > kPrefixOpPriorityLevel) {
+                out << ')';
+            }
+            break;
+        case ExpressionKind::kCallOp:
+            Print(out, operands_[node.first], cur_priority_level);
+            out << '(';
+            for (uint32_t i = 1; i < node.second; ++i) {
+                if (i > 1) {
+                    out << ", ";
+                }
+                Print(out, operands_[node.first + i], kSumPriorityLevel);
+            }
+            out << ')';
+            break;
+        case ExpressionKind::kDifferentiateOp:
+            if (cur_priority_level > kPostfixOpPriorityLevel) {
+                out << '(';
+            }
+            Print(out, node.first, kPostfixOpPriorityLevel);
+            if (cur_priority_level > kPostfixOpPriorityLevel) {
+                out << ')';
+            }
+            out << "'_" << node.variable;
+            break;
+        case ExpressionKind::kSubstOp:
+            if (cur_priority_level > kPostfixOpPriorityLevel) {
+                out << '(';
+            }
+            Print(out, operands_[node.first], kPostfixOpPriorityLevel);
+            out << '[';
+            for (uint32_t i = 1; i < node.second; i += 2) {
+                if (i > 1) {
+                    out << ", ";
+                }
+                out << static_cast<char>(operands_[node.first + i]) << " = ";
+                Print(out, operands_[node.first + i + 1], kSumPriorityLevel);
+            }
+            out << ']';
+            if (cur_priority_level > kPostfixOpPriorityLevel) {
+                out << ')';
+            }
+            break;
+    }
+}
+
+}  /* namespace calculus */
@@ -2,187 +2,389 @@
 #include <negate_op.h>
 #include <product.h>
 #include <sum.h>
+#include <variable.h>
+#include <function.h>
+#include <simplify_cache.h>
+#include <derivative_cache.h>
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 #include <cmath>
 #include <ostream>
+#include <sstream>
 
 #include "calculus_internal.h"
 
 namespace calculus {
 
-static double RatioOfSums(const std::vector<AssociativeOperand>& l_summands, const std::vector<AssociativeOperand>& r_summands) {
-    std::vector<bool> l_used(l_summands.size(), false);
-    std::vector<bool> r_used(r_summands.size(), false);
-    std::vector<std::vector<double>> ratios(l_summands.size(), std::vector<double>(r_summands.size(), std::nan("")));
+Expression::~Expression() {
+    if (interned_) {
+        ForgetInterned(this);
+    }
+}
 
-    double final_ratio = std::nan("");
+ExpressionPtr Expression::Simplify() {
+    auto self = shared_from_this();
+    if (normal_form_.load(std::memory_order_relaxed)) {
+        return self;
+    }
 
-    for (size_t l_index = 0; l_index < l_summands.size(); ++l_index) {
-        if (l_used[l_index]) {
-            continue;
-        }
+    SimplifyCache* cache = GetCurrentSimplifyCache();
+    if (cache == nullptr || kind_ == ExpressionKind::kConstant || kind_ == ExpressionKind::kVariable ||
+            kind_ == ExpressionKind::kFunction) {
+        auto result = DoSimplify();
+        MarkIfNormalForm(result);
+        return result;
+    }
 
-        l_used[l_index] = true;
+    ExpressionPtr cached;
+    if (cache->Find(self, &cached)) {
+        return cached;
+    }
+    auto result = DoSimplify();
+    MarkIfNormalForm(result);
+    cache->Insert(self, result);
+    return result;
+}
 
-        std::vector<int> r_active;
-        for (size_t r_index = 0; r_index < r_summands.size(); ++r_index) {
-            if (r_used[r_index]) {
-                continue;
-            }
+void Expression::MarkIfNormalForm(const ExpressionPtr& simplified) {
+    if (simplified->DeepCompare(shared_from_this())) {
+        normal_form_.store(true, std::memory_order_relaxed);
+        simplified->normal_form_.store(true, std::memory_order_relaxed);
+    }
+}
 
-            ratios[l_index][r_index] = Ratio(l_summands[l_index].expr, r_summands[r_index].expr);
-            if (l_summands[l_index].inverse ^ r_summands[r_index].inverse) {
-                ratios[l_index][r_index] *= -1;
-            }
+ExpressionPtr Expression::TakeDerivative(char var_name) {
+    if (!MayDependOn(var_name)) {
+        return kConstantZero;
+    }
 
-            if (!std::isnan(ratios[l_index][r_index])) {
-                r_used[r_index] = true;
-                r_active.push_back(r_index);
-            }
-        }
+    DerivativeCache* cache = GetCurrentDerivativeCache();
+    if (cache == nullptr || kind_ == ExpressionKind::kConstant || kind_ == ExpressionKind::kVariable) {
+        return DoTakeDerivative(var_name);
+    }
 
-        if (r_active.empty()) {
-            return std::nan("");
-        }
+    DerivativeKey key{shared_from_this(), var_name};
+    ExpressionPtr cached;
+    if (cache->Find(key, &cached)) {
+        return cached;
+    }
+    auto result = DoTakeDerivative(var_name);
+    cache->Insert(key, result);
+    return result;
+}
 
-        std::vector<size_t> l_active{l_index};
+ExpressionPtr Expression::Substitute(const Bindings& bindings) {
+    if ((free_variables_ & bindings.GetMask()) == 0) {
+        return shared_from_this();
+    }
+    return DoSubstitute(bindings);
+}
 
-        for (size_t l_candidate = l_index + 1; l_candidate < l_summands.size(); ++l_candidate) {
-            bool success = true;
-            for (int r_index : r_active) {
-                ratios[l_candidate][r_index] = Ratio(l_summands[l_candidate].expr, r_summands[r_index].expr);
-                if (l_summands[l_candidate].inverse ^ r_summands[r_index].inverse) {
-                    ratios[l_candidate][r_index] *= -1;
-                }
-                if (std::isnan(ratios[l_candidate][r_index])) {
-                    success = false;
-                    break;
-                }
-            }
-            if (success) {
-                l_active.push_back(l_candidate);
-                l_used[l_candidate] = true;
-            }
-        }
+ExpressionPtr Expression::Substitute(char var_name, const ExpressionPtr& value) {
+    return Substitute(Bindings(var_name, value));
+}
 
-        double current_ratio = 0;
-        for (auto r_index : r_active) {
-            double sum = 0;
-            for (auto l_index : l_active) {
-                sum += ratios[l_index][r_index];
-            }
-            current_ratio += 1 / sum;
-        }
-        current_ratio = 1 / current_ratio;
+void Bindings::Bind(char var_name, const ExpressionPtr& value) {
+    uint32_t mask = VariableMask(var_name);
+    if (mask == 0) {
+        throw RuntimeError(std::string("Cannot substitute for ") + var_name);
+    }
+    auto iter = std::lower_bound(entries_.begin(), entries_.end(), var_name, [](const Binding& entry, char name) {
+        return entry.var_name < name;
+    });
+    if (iter != entries_.end() && iter->var_name == var_name) {
+        iter->value = value;
+    } else {
+        entries_.insert(iter, {var_name, value});
+        mask_ |= mask;
+    }
+}
+
+const ExpressionPtr* Bindings::Find(char var_name) const {
+    if ((mask_ & VariableMask(var_name)) == 0) {
+        return nullptr;
+    }
+    auto iter = std::lower_bound(entries_.begin(), entries_.end(), var_name, [](const Binding& entry, char name) {
+        return entry.var_name < name;
+    });
+    return &iter->value;
+}
+
+int CompareExpressions(const ExpressionPtr& lhs, const ExpressionPtr& rhs) {
+    if (lhs == rhs) {
+        return 0;
+    }
+    bool l_constant = Is<Constant>(lhs);
+    bool r_constant = Is<Constant>(rhs);
+    if (l_constant != r_constant) {
+        return l_constant ? 1 : -1;
+    }
+    if (lhs->GetKind() != rhs->GetKind()) {
+        return static_cast<int>(lhs->GetKind()) - static_cast<int>(rhs->GetKind());
+    }
 
-        if (!std::isnan(final_ratio) && !IsZero(final_ratio - current_ratio)) {
-            return std::nan("");
+    switch (lhs->GetKind()) {
+        case ExpressionKind::kConstant:
+        {
+            return Number::Compare(As<Constant>(lhs)->GetNumber(), As<Constant>(rhs)->GetNumber());
         }
-        final_ratio = current_ratio;
+        case ExpressionKind::kVariable:
+            return As<Variable>(lhs)->GetName() - As<Variable>(rhs)->GetName();
+        case ExpressionKind::kFunction:
+            return As<Function>(lhs)->GetName().compare(As<Function>(rhs)->GetName());
+        default:
+            break;
     }
 
-    return final_ratio;
+    if (lhs->GetHash() != rhs->GetHash()) {
+        return lhs->GetHash() < rhs->GetHash() ? -1 : 1;
+    }
+    if (lhs->DeepCompare(rhs)) {
+        return 0;
+    }
+    // Different expressions with the same hash are rare enough to be ordered by their text
+    std::ostringstream l_text;
+    std::ostringstream r_text;
+    lhs->Print(l_text);
+    rhs->Print(r_text);
+    return l_text.str().compare(r_text.str());
 }
 
-static double RatioOfProducts(const std::vector<AssociativeOperand>& l_multipliers, const std::vector<AssociativeOperand>& r_multipliers) {
-    std::vector<bool> used(r_multipliers.size(), false);
+bool CanonicalOperandLess(const AssociativeOperand& lhs, const AssociativeOperand& rhs) {
+    bool l_constant = Is<Constant>(lhs.expr);
+    bool r_constant = Is<Constant>(rhs.expr);
+    if (l_constant != r_constant) {
+        return r_constant;
+    }
+    if (lhs.inverse != rhs.inverse) {
+        return rhs.inverse;
+    }
+    return CompareExpressions(lhs.expr, rhs.expr) < 0;
+}
 
-    double const_ratio = 1;
+static const std::vector<AssociativeOperand>& InCanonicalOrder(const std::vector<AssociativeOperand>& operands,
+                                                               std::vector<AssociativeOperand>* storage) {
+    if (std::is_sorted(operands.begin(), operands.end(), CanonicalOperandLess)) {
+        return operands;
+    }
+    *storage = operands;
+    std::sort(storage->begin(), storage->end(), CanonicalOperandLess);
+    return *storage;
+}
 
-    for (size_t i = 0; i < r_multipliers.size(); ++i) {
-        if (Is<Constant>(r_multipliers[i].expr)) {
-            used[i] = true;
-            double value = As<Constant>(r_multipliers[i].expr)->GetValue();
-            if (r_multipliers[i].inverse) {
-                const_ratio *= value;
-            } else {
-                const_ratio /= value;
-            }
-        }
+static size_t CountNonConstant(const std::vector<AssociativeOperand>& operands) {
+    size_t count = 0;
+    while (count < operands.size() && !Is<Constant>(operands[count].expr)) {
+        ++count;
     }
+    return count;
+}
 
-    for (size_t l_index = 0; l_index < l_multipliers.size(); ++l_index) {
-        if (Is<Constant>(l_multipliers[l_index].expr)) {
-            double value = As<Constant>(l_multipliers[l_index].expr)->GetValue();
-            if (l_multipliers[l_index].inverse) {
-                const_ratio /= value;
-            } else {
-                const_ratio *= value;
-            }
-            continue;
+Term SplitTerm(const AssociativeOperand& summand) {
+    int sign = summand.inverse ? -1 : 1;
+    const ExpressionPtr* expr = &summand.expr;
+    if (Is<NegateOp>(*expr)) {
+        sign = -sign;
+        expr = &As<NegateOp>(*expr)->GetInnerExpr();
+    }
+    if (Is<Constant>(*expr)) {
+        return {sign * As<Constant>(*expr)->GetNumber(), nullptr, nullptr, 0};
+    }
+    if (!Is<Product>(*expr)) {
+        return {sign, expr, nullptr, 0};
+    }
+
+    const auto& multipliers = As<Product>(*expr)->GetOperands();
+    size_t count = CountNonConstant(multipliers);
+    Number coefficient = sign;
+    for (size_t i = count; i < multipliers.size(); ++i) {
+        if (!Is<Constant>(multipliers[i].expr)) {
+            // Constants are not trailing, the product is taken as a whole
+            return {sign, expr, nullptr, 0};
         }
+        const Number& value = As<Constant>(multipliers[i].expr)->GetNumber();
+        if (multipliers[i].inverse) {
+            coefficient /= value;
+        } else {
+            coefficient *= value;
+        }
+    }
+    return {coefficient, nullptr, multipliers.data(), count};
+}
 
-        bool success = false;
-        for (size_t r_index = 0; r_index < r_multipliers.size(); ++r_index) {
-            if (!used[r_index] && l_multipliers[l_index].inverse == r_multipliers[r_index].inverse &&
-                    l_multipliers[l_index].expr->DeepCompare(r_multipliers[r_index].expr)) {
-                success = true;
-                used[r_index] = true;
-                break;
-            }
+int CompareMonomials(const Term& lhs, const Term& rhs) {
+    size_t size = std::min(lhs.GetSize(), rhs.GetSize());
+    for (size_t i = 0; i < size; ++i) {
+        if (lhs.IsInverse(i) != rhs.IsInverse(i)) {
+            return lhs.IsInverse(i) ? 1 : -1;
+        }
+        int result = CompareExpressions(lhs.GetFactor(i), rhs.GetFactor(i));
+        if (result != 0) {
+            return result;
         }
+    }
+    return static_cast<int>(lhs.GetSize()) - static_cast<int>(rhs.GetSize());
+}
+
+size_t HashMonomial(const Term& term) {
+    size_t hash = 0;
+    for (size_t i = 0; i < term.GetSize(); ++i) {
+        hash = HashCombine(hash, HashCombine(term.GetFactor(i)->GetHash(), term.IsInverse(i) ? 1 : 0));
+    }
+    return hash;
+}
+
+/* Sorts the terms by monomial and merges equal monomials, dropping the ones that cancel out */
+static std::vector<Term> CollectTerms(const std::vector<AssociativeOperand>& summands) {
+    std::vector<Term> terms;
+    terms.reserve(summands.size());
+    for (const auto& summand : summands) {
+        terms.push_back(SplitTerm(summand));
+    }
+    std::sort(terms.begin(), terms.end(), [](const Term& lhs, const Term& rhs) {
+        return CompareMonomials(lhs, rhs) < 0;
+    });
 
-        if (!success) {
-            return std::nan("");
+    std::vector<Term> result;
+    for (const auto& term : terms) {
+        if (!result.empty() && CompareMonomials(result.back(), term) == 0) {
+            result.back().coefficient += term.coefficient;
+        } else {
+            result.push_back(term);
         }
     }
+    result.erase(std::remove_if(result.begin(), result.end(), [](const Term& term) {
+        return IsZero(term.coefficient);
+    }), result.end());
+    return result;
+}
+
+static bool RatioOfSums(const std::vector<AssociativeOperand>& l_summands, const std::vector<AssociativeOperand>& r_summands, Number* ratio) {
+    auto l_terms = CollectTerms(l_summands);
+    auto r_terms = CollectTerms(r_summands);
+    if (l_terms.empty() || l_terms.size() != r_terms.size()) {
+        return false;
+    }
 
-    for (bool flag : used) {
-        if (!flag) {
-            return std::nan("");
+    Number final_ratio = l_terms[0].coefficient / r_terms[0].coefficient;
+    for (size_t i = 0; i < l_terms.size(); ++i) {
+        if (CompareMonomials(l_terms[i], r_terms[i]) != 0 ||
+                !IsZero(l_terms[i].coefficient / r_terms[i].coefficient - final_ratio)) {
+            return false;
         }
     }
-    return const_ratio;
+    *ratio = final_ratio;
+    return true;
 }
 
-double Ratio(const ExpressionPtr& lhs, const ExpressionPtr& rhs) {
-    if (Is<NegateOp>(lhs)) {
-        return -Ratio(As<NegateOp>(lhs)->GetInnerExpr(), rhs);
+static bool RatioOfProducts(const std::vector<AssociativeOperand>& l_operands, const std::vector<AssociativeOperand>& r_operands, Number* ratio) {
+    std::vector<AssociativeOperand> l_storage;
+    std::vector<AssociativeOperand> r_storage;
+    const auto& l_multipliers = InCanonicalOrder(l_operands, &l_storage);
+    const auto& r_multipliers = InCanonicalOrder(r_operands, &r_storage);
+
+    // Constants are ordered last, the rest has to match position by position
+    size_t count = CountNonConstant(l_multipliers);
+    if (CountNonConstant(r_multipliers) != count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (l_multipliers[i].inverse != r_multipliers[i].inverse ||
+                !l_multipliers[i].expr->DeepCompare(r_multipliers[i].expr)) {
+            return false;
+        }
+    }
+
+    // The ratio is l / r, so the constants of r enter inverted
+    Number const_ratio = 1;
+    for (size_t k = 0; k < 2; ++k) {
+        const auto& multipliers = k == 0 ? l_multipliers : r_multipliers;
+        for (size_t i = count; i < multipliers.size(); ++i) {
+            const Number& value = As<Constant>(multipliers[i].expr)->GetNumber();
+            if (IsZero(value)) {
+                return false;
+            }
+            if (multipliers[i].inverse == (k == 0)) {
+                const_ratio /= value;
+            } else {
+                const_ratio *= value;
+            }
+        }
     }
-    if (Is<NegateOp>(rhs)) {
-        return -Ratio(lhs, As<NegateOp>(rhs)->GetInnerExpr());
+    *ratio = const_ratio;
+    return true;
+}
+
+bool Ratio(const ExpressionPtr& lhs, const ExpressionPtr& rhs, Number* ratio) {
+    if (Is<NegateOp>(lhs) || Is<NegateOp>(rhs)) {
+        const auto& l_inner = Is<NegateOp>(lhs) ? As<NegateOp>(lhs)->GetInnerExpr() : lhs;
+        const auto& r_inner = Is<NegateOp>(rhs) ? As<NegateOp>(rhs)->GetInnerExpr() : rhs;
+        if (!Ratio(l_inner, r_inner, ratio)) {
+            return false;
+        }
+        if (Is<NegateOp>(lhs) != Is<NegateOp>(rhs)) {
+            *ratio = -*ratio;
+        }
+        return true;
     }
 
     if (Is<Constant>(lhs) && Is<Constant>(rhs)) {
-        return As<Constant>(lhs)->GetValue() / As<Constant>(rhs)->GetValue();
+        const Number& divisor = As<Constant>(rhs)->GetNumber();
+        if (IsZero(divisor)) {
+            return false;
+        }
+        *ratio = As<Constant>(lhs)->GetNumber() / divisor;
+        return true;
     }
 
     if (lhs->DeepCompare(rhs)) {
-        return 1;
+        *ratio = 1;
+        return true;
     }
 
     if (Is<Product>(lhs)) {
         const auto& l_multipliers = As<Product>(lhs)->GetOperands();
         if (l_multipliers.size() == 2) {
-            if (Is<Constant>(l_multipliers[0].expr) && !l_multipliers[1].inverse) {
-                double r = Ratio(l_multipliers[1].expr, rhs);
-                double alpha = As<Constant>(l_multipliers[0].expr)->GetValue();
-                return l_multipliers[0].inverse ? r / alpha : r * alpha;
-            }
-            if (Is<Constant>(l_multipliers[1].expr) && !l_multipliers[0].inverse) {
-                double r = Ratio(l_multipliers[0].expr, rhs);
-                double alpha = As<Constant>(l_multipliers[1].expr)->GetValue();
-                return l_multipliers[1].inverse ? r / alpha : r * alpha;
+            for (size_t i = 0; i < 2; ++i) {
+                const auto& alpha = l_multipliers[i];
+                const auto& other = l_multipliers[1 - i];
+                if (!Is<Constant>(alpha.expr) || other.inverse) {
+                    continue;
+                }
+                const Number& value = As<Constant>(alpha.expr)->GetNumber();
+                if (IsZero(value) || !Ratio(other.expr, rhs, ratio)) {
+                    return false;
+                }
+                if (alpha.inverse) {
+                    *ratio /= value;
+                } else {
+                    *ratio *= value;
+                }
+                return true;
             }
         }
 
         if (Is<Product>(rhs)) {
             const auto& r_multipliers = As<Product>(rhs)->GetOperands();
-            return RatioOfProducts(l_multipliers, r_multipliers);
+            return RatioOfProducts(l_multipliers, r_multipliers, ratio);
         }
     } else if (Is<Product>(rhs)) {
-        return 1 / Ratio(rhs, lhs);
+        if (!Ratio(rhs, lhs, ratio) || IsZero(*ratio)) {
+            return false;
+        }
+        *ratio = 1 / *ratio;
+        return true;
     }
 
     if (Is<Sum>(lhs) && Is<Sum>(rhs)) {
         const auto& l_summands = As<Sum>(lhs)->GetOperands();
         const auto& r_summands = As<Sum>(rhs)->GetOperands();
-        return RatioOfSums(l_summands, r_summands);
+        return RatioOfSums(l_summands, r_summands, ratio);
     }
 
-    return std::nan("");
+    return false;
 }
 
 }
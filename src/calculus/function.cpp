@@ -10,17 +10,20 @@
 namespace calculus {
 
 static ExpressionPtr Inverse(const ExpressionPtr& expr) {
-    auto result = std::make_shared<Product>();
+    auto result = Allocate<Product>();
     *result /= expr;
     return result;
 }
 
+/* The tables below are never modified after static initialization, so concurrent
+ * lookups are safe. SmallIntegerConstant() is used instead of kConstantOne because
+ * the latter may not be constructed yet at this point. */
 static const std::unordered_map<std::string, ExpressionPtr> kTableOfDerivatives = {
-    {"sin", std::make_shared<Function>("cos")},
-    {"cos", std::make_shared<NegateOp>(std::make_shared<Function>("sin"))},
-    {"log", Inverse(std::make_shared<Function>("id"))},
-    {"exp", std::make_shared<Function>("exp")},
-    {"id",  kConstantOne},
+    {"sin", Make<Function>("cos")},
+    {"cos", Make<NegateOp>(Make<Function>("sin"))},
+    {"log", Inverse(Make<Function>("id"))},
+    {"exp", Make<Function>("exp")},
+    {"id",  SmallIntegerConstant(1)},
 };
 
 static const std::unordered_map<std::string, double(*)(double)> kUnaryFunctionTable = {
@@ -36,14 +39,14 @@ static const std::unordered_set<std::string> kTableOfLaTeXDeclaredFunctions = {
 };
 
 
-ExpressionPtr Function::Simplify() {
+ExpressionPtr Function::DoSimplify() {
     return shared_from_this();
 }
 
-ExpressionPtr Function::TakeDerivative(char) {
+ExpressionPtr Function::DoTakeDerivative(char) {
     auto iter = kTableOfDerivatives.find(name_);
     if (iter == kTableOfDerivatives.end()) {
-        return std::make_shared<DifferentiateOp>(shared_from_this(), kDefaultDerivativeVariable);
+        return Make<DifferentiateOp>(shared_from_this(), kDefaultDerivativeVariable);
     }
     return iter->second;
 }
@@ -64,14 +67,14 @@ ExpressionPtr Function::Call(const std::vector<ExpressionPtr>& args) {
 
     auto iter = kUnaryFunctionTable.find(name_);
     if (!Is<Constant>(arg) || iter == kUnaryFunctionTable.end()) {
-        return std::make_shared<CallOp>(shared_from_this(), args);
+        return Make<CallOp>(shared_from_this(), args);
     }
 
     double result = iter->second(As<Constant>(arg)->GetValue());
     return BuildConstant(result);
 }
 
-ExpressionPtr Function::Substitute(char, const ExpressionPtr&) {
+ExpressionPtr Function::DoSubstitute(const Bindings&) {
     return shared_from_this();
 }
 
@@ -86,6 +89,10 @@ void Function::TexDump(std::ostream& out, int) const {
     out << name_;
 }
 
+size_t Function::ComputeHash() const {
+    return HashCombine(HashSeed(kKind), std::hash<std::string>()(name_));
+}
+
 bool Function::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     return name_ == ptr->name_;
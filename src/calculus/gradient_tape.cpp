@@ -0,0 +1,353 @@
+#include <gradient_tape.h>
+#include "calculus_internal.h"
+#include "batch_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace calculus {
+
+static constexpr size_t kStackScratchSize = 128;
+
+static bool IsBinary(OpCode op) {
+    switch (op) {
+        case OpCode::kAdd:
+        case OpCode::kSub:
+        case OpCode::kMul:
+        case OpCode::kDiv:
+        case OpCode::kPow:
+            return true;
+        default:
+            return false;
+    }
+}
+
+GradientTape::GradientTape(const BytecodeProgram& program) : constants_(program.GetConstants()) {
+    /* The program reuses registers, the tape renames them so that the slot of an entry is
+     * its index */
+    std::vector<uint32_t> slots(program.GetRegisterCount());
+    const auto& code = program.GetInstructions();
+    entries_.reserve(code.size());
+    for (const auto& instruction : code) {
+        TapeEntry entry = {instruction.op, false, instruction.lhs, 0};
+        if (instruction.op == OpCode::kLoadVariable) {
+            entry.active = true;
+        } else if (instruction.op != OpCode::kLoadConstant) {
+            entry.lhs = slots[instruction.lhs];
+            entry.rhs = IsBinary(instruction.op) ? slots[instruction.rhs] : entry.lhs;
+            entry.active = entries_[entry.lhs].active || entries_[entry.rhs].active;
+        }
+        slots[instruction.dst] = static_cast<uint32_t>(entries_.size());
+        entries_.push_back(entry);
+    }
+    result_ = slots[program.GetResultRegister()];
+}
+
+GradientTape GradientTape::Compile(const ExpressionPtr& expr) {
+    return GradientTape(BytecodeProgram::Compile(expr));
+}
+
+double GradientTape::Evaluate(const double* variables, double* gradient, double* scratch) const {
+    size_t size = entries_.size();
+    double* v = scratch;
+    double* adjoint = scratch + size;
+
+    for (size_t i = 0; i < size; ++i) {
+        const auto& entry = entries_[i];
+        double lhs = entry.op == OpCode::kLoadConstant || entry.op == OpCode::kLoadVariable ? 0 : v[entry.lhs];
+        double rhs = IsBinary(entry.op) ? v[entry.rhs] : 0;
+        switch (entry.op) {
+            case OpCode::kLoadConstant:
+                v[i] = constants_[entry.lhs];
+                break;
+            case OpCode::kLoadVariable:
+                v[i] = variables[entry.lhs];
+                break;
+            case OpCode::kAdd:
+                v[i] = lhs + rhs;
+                break;
+            case OpCode::kSub:
+                v[i] = lhs - rhs;
+                break;
+            case OpCode::kMul:
+                v[i] = lhs * rhs;
+                break;
+            case OpCode::kDiv:
+                v[i] = lhs / rhs;
+                break;
+            case OpCode::kNeg:
+                v[i] = -lhs;
+                break;
+            case OpCode::kPow:
+                v[i] = std::pow(lhs, rhs);
+                break;
+            case OpCode::kSqrt:
+                v[i] = std::sqrt(lhs);
+                break;
+            case OpCode::kSin:
+                v[i] = std::sin(lhs);
+                break;
+            case OpCode::kCos:
+                v[i] = std::cos(lhs);
+                break;
+            case OpCode::kLog:
+                v[i] = std::log(lhs);
+                break;
+            case OpCode::kExp:
+                v[i] = std::exp(lhs);
+                break;
+        }
+    }
+
+    std::fill_n(gradient, kVariableCount, 0.0);
+    std::fill_n(adjoint, size, 0.0);
+    adjoint[result_] = 1;
+    for (size_t i = result_ + 1; i-- > 0;) {
+        const auto& entry = entries_[i];
+        double a = adjoint[i];
+        /* Constants need no adjoint, and skipping them keeps e.g. the log of a negative base
+         * under a constant exponent out of the sums */
+        if (!entry.active || a == 0) {
+            continue;
+        }
+        if (entry.op == OpCode::kLoadVariable) {
+            gradient[entry.lhs] += a;
+            continue;
+        }
+        uint32_t l = entry.lhs;
+        uint32_t r = entry.rhs;
+        bool lhs_active = entries_[l].active;
+        bool rhs_active = entries_[r].active;
+        switch (entry.op) {
+            case OpCode::kLoadConstant:
+            case OpCode::kLoadVariable:
+                break;
+            case OpCode::kAdd:
+                adjoint[l] += a;
+                adjoint[r] += a;
+                break;
+            case OpCode::kSub:
+                adjoint[l] += a;
+                adjoint[r] -= a;
+                break;
+            case OpCode::kMul:
+                adjoint[l] += a * v[r];
+                adjoint[r] += a * v[l];
+                break;
+            case OpCode::kDiv:
+                adjoint[l] += a / v[r];
+                adjoint[r] -= a * v[i] / v[r];
+                break;
+            case OpCode::kNeg:
+                adjoint[l] -= a;
+                break;
+            case OpCode::kPow:
+                if (lhs_active) {
+                    adjoint[l] += a * v[r] * std::pow(v[l], v[r] - 1);
+                }
+                if (rhs_active) {
+                    adjoint[r] += a * v[i] * std::log(v[l]);
+                }
+                break;
+            case OpCode::kSqrt:
+                adjoint[l] += a / (2 * v[i]);
+                break;
+            case OpCode::kSin:
+                adjoint[l] += a * std::cos(v[l]);
+                break;
+            case OpCode::kCos:
+                adjoint[l] -= a * std::sin(v[l]);
+                break;
+            case OpCode::kLog:
+                adjoint[l] += a / v[l];
+                break;
+            case OpCode::kExp:
+                adjoint[l] += a * v[i];
+                break;
+        }
+    }
+    return v[result_];
+}
+
+double GradientTape::Evaluate(const double* variables, double* gradient) const {
+    if (GetScratchSize() <= kStackScratchSize) {
+        double scratch[kStackScratchSize];
+        return Evaluate(variables, gradient, scratch);
+    }
+    std::vector<double> scratch(GetScratchSize());
+    return Evaluate(variables, gradient, scratch.data());
+}
+
+void GradientTape::EvaluateBatch(const double* const* variables, size_t count, double* values,
+                                 double* const* gradient) const {
+    std::vector<double> scratch(GetBatchScratchSize());
+    EvaluateBatch(variables, count, values, gradient, GetSimdLevel(), scratch.data());
+}
+
+void GradientTape::EvaluateBatch(const double* const* variables, size_t count, double* values,
+                                 double* const* gradient, SimdLevel level, double* scratch) const {
+    const BatchKernels* kernels = GetBatchKernels(level);
+    for (const auto& entry : entries_) {
+        if (entry.op == OpCode::kLoadVariable && variables[entry.lhs] == nullptr) {
+            throw RuntimeError(std::string("No values given for variable ") + static_cast<char>('a' + entry.lhs));
+        }
+    }
+
+    size_t slots = entries_.size();
+    auto v = [scratch](uint32_t index) {
+        return scratch + index * kBatchBlockSize;
+    };
+    auto adjoint = [scratch, slots](uint32_t index) {
+        return scratch + (slots + index) * kBatchBlockSize;
+    };
+    double* temp = scratch + 2 * slots * kBatchBlockSize;
+    auto kernel = [kernels](OpCode op) {
+        return kernels->ops[static_cast<size_t>(op)];
+    };
+
+    for (size_t begin = 0; begin < count; begin += kBatchBlockSize) {
+        size_t size = std::min(kBatchBlockSize, count - begin);
+        for (size_t i = 0; i < slots; ++i) {
+            const auto& entry = entries_[i];
+            switch (entry.op) {
+                case OpCode::kLoadConstant:
+                    std::fill_n(v(i), size, constants_[entry.lhs]);
+                    break;
+                case OpCode::kLoadVariable:
+                    std::copy_n(variables[entry.lhs] + begin, size, v(i));
+                    break;
+                default:
+                    kernel(entry.op)(v(entry.lhs), v(entry.rhs), v(i), size);
+                    break;
+            }
+        }
+        std::copy_n(v(result_), size, values + begin);
+
+        for (size_t c = 0; c < kVariableCount; ++c) {
+            if (gradient[c] != nullptr) {
+                std::fill_n(gradient[c] + begin, size, 0.0);
+            }
+        }
+        for (size_t i = 0; i <= result_; ++i) {
+            if (entries_[i].active) {
+                std::fill_n(adjoint(i), size, i == result_ ? 1.0 : 0.0);
+            }
+        }
+
+        for (size_t i = result_ + 1; i-- > 0;) {
+            const auto& entry = entries_[i];
+            if (!entry.active) {
+                continue;
+            }
+            const double* a = adjoint(i);
+            if (entry.op == OpCode::kLoadVariable) {
+                if (double* out = gradient[entry.lhs]) {
+                    for (size_t k = 0; k < size; ++k) {
+                        out[begin + k] += a[k];
+                    }
+                }
+                continue;
+            }
+            const double* value = v(i);
+            const double* lhs = v(entry.lhs);
+            const double* rhs = v(entry.rhs);
+            double* lhs_adjoint = adjoint(entry.lhs);
+            double* rhs_adjoint = adjoint(entry.rhs);
+            bool lhs_active = entries_[entry.lhs].active;
+            bool rhs_active = entries_[entry.rhs].active;
+            switch (entry.op) {
+                case OpCode::kLoadConstant:
+                case OpCode::kLoadVariable:
+                    break;
+                case OpCode::kAdd:
+                case OpCode::kSub: {
+                    double sign = entry.op == OpCode::kAdd ? 1 : -1;
+                    if (lhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            lhs_adjoint[k] += a[k];
+                        }
+                    }
+                    if (rhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            rhs_adjoint[k] += sign * a[k];
+                        }
+                    }
+                    break;
+                }
+                case OpCode::kMul:
+                    if (lhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            lhs_adjoint[k] += a[k] * rhs[k];
+                        }
+                    }
+                    if (rhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            rhs_adjoint[k] += a[k] * lhs[k];
+                        }
+                    }
+                    break;
+                case OpCode::kDiv:
+                    if (lhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            lhs_adjoint[k] += a[k] / rhs[k];
+                        }
+                    }
+                    if (rhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            rhs_adjoint[k] -= a[k] * value[k] / rhs[k];
+                        }
+                    }
+                    break;
+                case OpCode::kNeg:
+                    for (size_t k = 0; k < size; ++k) {
+                        lhs_adjoint[k] -= a[k];
+                    }
+                    break;
+                case OpCode::kPow:
+                    if (lhs_active) {
+                        for (size_t k = 0; k < size; ++k) {
+                            temp[k] = rhs[k] - 1;
+                        }
+                        kernel(OpCode::kPow)(lhs, temp, temp, size);
+                        for (size_t k = 0; k < size; ++k) {
+                            lhs_adjoint[k] += a[k] * rhs[k] * temp[k];
+                        }
+                    }
+                    if (rhs_active) {
+                        kernel(OpCode::kLog)(lhs, lhs, temp, size);
+                        for (size_t k = 0; k < size; ++k) {
+                            rhs_adjoint[k] += a[k] * value[k] * temp[k];
+                        }
+                    }
+                    break;
+                case OpCode::kSqrt:
+                    for (size_t k = 0; k < size; ++k) {
+                        lhs_adjoint[k] += a[k] / (2 * value[k]);
+                    }
+                    break;
+                case OpCode::kSin:
+                case OpCode::kCos: {
+                    bool sin = entry.op == OpCode::kSin;
+                    kernel(sin ? OpCode::kCos : OpCode::kSin)(lhs, lhs, temp, size);
+                    double sign = sin ? 1 : -1;
+                    for (size_t k = 0; k < size; ++k) {
+                        lhs_adjoint[k] += sign * a[k] * temp[k];
+                    }
+                    break;
+                }
+                case OpCode::kLog:
+                    for (size_t k = 0; k < size; ++k) {
+                        lhs_adjoint[k] += a[k] / lhs[k];
+                    }
+                    break;
+                case OpCode::kExp:
+                    for (size_t k = 0; k < size; ++k) {
+                        lhs_adjoint[k] += a[k] * value[k];
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,75 @@
+#include <intern_table.h>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace calculus {
+
+namespace {
+
+struct InternTableEntry {
+    const Expression* raw;
+    std::weak_ptr<Expression> expr;
+};
+
+using InternTable = std::unordered_multimap<size_t, InternTableEntry>;
+
+/* Never destroyed: static expressions may outlive any other static object */
+InternTable& GetInternTable() {
+    static InternTable* table = new InternTable();
+    return *table;
+}
+
+std::mutex& GetInternTableMutex() {
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+}
+
+}  /* namespace */
+
+ExpressionPtr Intern(ExpressionPtr expr) {
+    if (expr->interned_) {
+        return expr;
+    }
+
+    /* Declared before the lock: if another thread drops its reference meanwhile, a rejected
+     * candidate may be the last owner, and its destructor takes the lock in ForgetInterned() */
+    std::vector<ExpressionPtr> rejected;
+    std::lock_guard<std::mutex> lock(GetInternTableMutex());
+
+    auto& table = GetInternTable();
+    auto range = table.equal_range(expr->GetHash());
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        auto candidate = iter->second.expr.lock();
+        if (candidate == nullptr) {
+            continue;
+        }
+        if (candidate->DeepCompare(expr)) {
+            return candidate;
+        }
+        rejected.push_back(std::move(candidate));
+    }
+
+    table.emplace(expr->GetHash(), InternTableEntry{expr.get(), expr});
+    expr->interned_ = true;
+    return expr;
+}
+
+void ForgetInterned(const Expression* expr) {
+    std::lock_guard<std::mutex> lock(GetInternTableMutex());
+    auto& table = GetInternTable();
+    auto range = table.equal_range(expr->GetHash());
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (iter->second.raw == expr) {
+            table.erase(iter);
+            return;
+        }
+    }
+}
+
+size_t GetInternTableSize() {
+    std::lock_guard<std::mutex> lock(GetInternTableMutex());
+    return GetInternTable().size();
+}
+
+}  /* namespace calculus */
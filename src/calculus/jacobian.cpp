@@ -0,0 +1,137 @@
+#include <jacobian.h>
+#include <sum.h>
+#include <product.h>
+#include <normalize.h>
+#include <simplify_cache.h>
+#include <derivative_cache.h>
+#include "calculus_internal.h"
+
+namespace calculus {
+
+ExpressionMatrix::ExpressionMatrix(size_t rows, size_t columns)
+    : rows_(rows), columns_(columns), entries_(rows * columns, SmallIntegerConstant(0)),
+      structural_zeros_(rows * columns, true) {
+}
+
+void ExpressionMatrix::Set(size_t row, size_t column, const ExpressionPtr& expr) {
+    entries_[row * columns_ + column] = expr;
+    structural_zeros_[row * columns_ + column] = false;
+}
+
+/* Installs shared caches for the duration of one call unless the caller already has some,
+ * and derives simplified partial derivatives under them */
+class Deriver {
+public:
+    Deriver()
+        : simplify_scope_(GetCurrentSimplifyCache() != nullptr ? GetCurrentSimplifyCache() : &simplify_cache_),
+          derivative_scope_(GetCurrentDerivativeCache() != nullptr ? GetCurrentDerivativeCache() : &derivative_cache_) {
+    }
+
+    static std::vector<char> ParseVariables(const std::string& variables) {
+        for (char name : variables) {
+            if (VariableMask(name) == 0) {
+                throw RuntimeError(std::string("Cannot differentiate by ") + name);
+            }
+        }
+        return {variables.begin(), variables.end()};
+    }
+
+    ExpressionPtr Normalize(const ExpressionPtr& expr) {
+        return calculus::Normalize(expr).expr;
+    }
+
+    /* nullptr if the derivative is a structural zero */
+    ExpressionPtr Derive(const ExpressionPtr& expr, char var_name) {
+        if (!expr->MayDependOn(var_name)) {
+            return nullptr;
+        }
+        return Normalize(expr->TakeDerivative(var_name));
+    }
+
+    void DeriveRow(const ExpressionPtr& expr, const std::vector<char>& variables, size_t row,
+                   ExpressionMatrix* matrix) {
+        for (size_t column = 0; column < variables.size(); ++column) {
+            if (auto derivative = Derive(expr, variables[column])) {
+                matrix->Set(row, column, derivative);
+            }
+        }
+    }
+
+private:
+    SimplifyCache simplify_cache_;
+    DerivativeCache derivative_cache_;
+    SimplifyCacheScope simplify_scope_;
+    DerivativeCacheScope derivative_scope_;
+};
+
+static std::vector<ExpressionPtr> FirstRow(const ExpressionMatrix& matrix) {
+    std::vector<ExpressionPtr> result;
+    result.reserve(matrix.GetColumns());
+    for (size_t column = 0; column < matrix.GetColumns(); ++column) {
+        result.push_back(matrix.At(0, column));
+    }
+    return result;
+}
+
+std::vector<ExpressionPtr> Gradient(const ExpressionPtr& expr, const std::string& variables) {
+    return FirstRow(Jacobian({expr}, variables));
+}
+
+ExpressionMatrix Jacobian(const std::vector<ExpressionPtr>& exprs, const std::string& variables) {
+    auto names = Deriver::ParseVariables(variables);
+    Deriver deriver;
+    ExpressionMatrix result(exprs.size(), names.size());
+    for (size_t row = 0; row < exprs.size(); ++row) {
+        deriver.DeriveRow(deriver.Normalize(exprs[row]), names, row, &result);
+    }
+    return result;
+}
+
+ExpressionMatrix Hessian(const ExpressionPtr& expr, const std::string& variables) {
+    auto names = Deriver::ParseVariables(variables);
+    Deriver deriver;
+    auto normal = deriver.Normalize(expr);
+    ExpressionMatrix result(names.size(), names.size());
+    for (size_t row = 0; row < names.size(); ++row) {
+        auto first = deriver.Derive(normal, names[row]);
+        if (first == nullptr) {
+            continue;
+        }
+        for (size_t column = row; column < names.size(); ++column) {
+            if (auto second = deriver.Derive(first, names[column])) {
+                result.Set(row, column, second);
+                result.Set(column, row, second);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<ExpressionPtr> HessianVectorProduct(const ExpressionPtr& expr, const std::string& variables,
+                                                const std::vector<ExpressionPtr>& direction) {
+    auto names = Deriver::ParseVariables(variables);
+    if (direction.size() != names.size()) {
+        throw RuntimeError("Direction size mismatch: expected " + std::to_string(names.size()) + ", got " +
+                           std::to_string(direction.size()));
+    }
+    Deriver deriver;
+    auto normal = deriver.Normalize(expr);
+
+    auto directional = Allocate<Sum>();
+    directional->ReserveSize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (auto derivative = deriver.Derive(normal, names[i])) {
+            auto term = Allocate<Product>();
+            term->ReserveSize(2);
+            *term *= derivative;
+            *term *= direction[i];
+            *directional += term;
+        }
+    }
+
+    ExpressionMatrix matrix(1, names.size());
+    deriver.DeriveRow(deriver.Normalize(directional), names, 0, &matrix);
+    return FirstRow(matrix);
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,250 @@
+#include <jit.h>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define CALCULUS_JIT_X86_64 1
+#endif
+
+namespace calculus {
+
+#ifdef CALCULUS_JIT_X86_64
+
+namespace {
+
+/* Machine code for the System V ABI: double f(const double* variables).
+ *
+ *   push rbp; mov rbp, rsp; push rbx; sub rsp, N; mov rbx, rdi
+ *
+ * rbx keeps the variable array across calls, every bytecode register gets a stack slot
+ * below the saved rbx, and N keeps rsp 16-byte aligned at call sites. Each instruction
+ * computes in xmm0 (and xmm1 for the second operand of pow) and stores to its slot;
+ * functions are called through rax. */
+class CodeEmitter {
+public:
+    explicit CodeEmitter(const BytecodeProgram& program) : program_(program) {
+    }
+
+    std::vector<uint8_t> Emit() {
+        size_t slots = program_.GetRegisterCount();
+        uint32_t frame = static_cast<uint32_t>(8 * slots + (slots % 2 == 0 ? 8 : 0));
+
+        Bytes({0x55});                          // push rbp
+        Bytes({0x48, 0x89, 0xE5});              // mov rbp, rsp
+        Bytes({0x53});                          // push rbx
+        Bytes({0x48, 0x81, 0xEC});              // sub rsp, imm32
+        Imm32(frame);
+        Bytes({0x48, 0x89, 0xFB});              // mov rbx, rdi
+
+        for (const auto& instruction : program_.GetInstructions()) {
+            EmitInstruction(instruction);
+        }
+
+        LoadSlot(0, program_.GetResultRegister());
+        Bytes({0x48, 0x8D, 0x65, 0xF8});        // lea rsp, [rbp - 8]
+        Bytes({0x5B});                          // pop rbx
+        Bytes({0x5D});                          // pop rbp
+        Bytes({0xC3});                          // ret
+        return std::move(code_);
+    }
+
+private:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    void EmitInstruction(const Instruction& instruction) {
+        switch (instruction.op) {
+            case OpCode::kLoadConstant: {
+                uint64_t bits;
+                double value = program_.GetConstants()[instruction.lhs];
+                std::memcpy(&bits, &value, sizeof(bits));
+                MoveImm64ToXmm(0, bits);
+                break;
+            }
+            case OpCode::kLoadVariable:
+                Bytes({0xF2, 0x0F, 0x10, 0x83});    // movsd xmm0, [rbx + disp32]
+                Imm32(8 * instruction.lhs);
+                break;
+            case OpCode::kAdd:
+                Arithmetic(0x58, instruction);
+                break;
+            case OpCode::kSub:
+                Arithmetic(0x5C, instruction);
+                break;
+            case OpCode::kMul:
+                Arithmetic(0x59, instruction);
+                break;
+            case OpCode::kDiv:
+                Arithmetic(0x5E, instruction);
+                break;
+            case OpCode::kNeg:
+                LoadSlot(0, instruction.lhs);
+                MoveImm64ToXmm(1, 0x8000000000000000ULL);
+                Bytes({0x66, 0x0F, 0x57, 0xC1});    // xorpd xmm0, xmm1
+                break;
+            case OpCode::kPow:
+                LoadSlot(0, instruction.lhs);
+                LoadSlot(1, instruction.rhs);
+                Call(reinterpret_cast<uint64_t>(static_cast<double (*)(double, double)>(std::pow)));
+                break;
+            case OpCode::kSqrt:
+                Bytes({0xF2, 0x0F, 0x51, 0x85});    // sqrtsd xmm0, [rbp + disp32]
+                Imm32(SlotOffset(instruction.lhs));
+                break;
+            case OpCode::kSin:
+                CallUnary(static_cast<double (*)(double)>(std::sin), instruction);
+                break;
+            case OpCode::kCos:
+                CallUnary(static_cast<double (*)(double)>(std::cos), instruction);
+                break;
+            case OpCode::kLog:
+                CallUnary(static_cast<double (*)(double)>(std::log), instruction);
+                break;
+            case OpCode::kExp:
+                CallUnary(static_cast<double (*)(double)>(std::exp), instruction);
+                break;
+        }
+        StoreSlot(instruction.dst);
+    }
+
+    /* <op>sd xmm0, [rbp + slot] with the left operand loaded into xmm0 */
+    void Arithmetic(uint8_t opcode, const Instruction& instruction) {
+        LoadSlot(0, instruction.lhs);
+        Bytes({0xF2, 0x0F, opcode, 0x85});
+        Imm32(SlotOffset(instruction.rhs));
+    }
+
+    void CallUnary(double (*function)(double), const Instruction& instruction) {
+        LoadSlot(0, instruction.lhs);
+        Call(reinterpret_cast<uint64_t>(function));
+    }
+
+    void Call(uint64_t address) {
+        Bytes({0x48, 0xB8});                    // mov rax, imm64
+        Imm64(address);
+        Bytes({0xFF, 0xD0});                    // call rax
+        xmm0_slot_ = kNoSlot;
+    }
+
+    void MoveImm64ToXmm(uint8_t xmm, uint64_t bits) {
+        Bytes({0x48, 0xB8});                    // mov rax, imm64
+        Imm64(bits);
+        Bytes({0x66, 0x48, 0x0F, 0x6E, static_cast<uint8_t>(0xC0 | (xmm << 3))});  // movq xmm, rax
+        if (xmm == 0) {
+            xmm0_slot_ = kNoSlot;
+        }
+    }
+
+    /* movsd xmm, [rbp + slot], skipped if xmm0 still holds the slot just stored */
+    void LoadSlot(uint8_t xmm, uint32_t slot) {
+        if (xmm == 0 && xmm0_slot_ == slot) {
+            return;
+        }
+        Bytes({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x85 | (xmm << 3))});
+        Imm32(SlotOffset(slot));
+        if (xmm == 0) {
+            xmm0_slot_ = slot;
+        }
+    }
+
+    /* movsd [rbp + slot], xmm0 */
+    void StoreSlot(uint32_t slot) {
+        Bytes({0xF2, 0x0F, 0x11, 0x85});
+        Imm32(SlotOffset(slot));
+        xmm0_slot_ = slot;
+    }
+
+    static uint32_t SlotOffset(uint32_t slot) {
+        return static_cast<uint32_t>(-16 - 8 * static_cast<int64_t>(slot));
+    }
+
+    void Bytes(std::initializer_list<uint8_t> bytes) {
+        code_.insert(code_.end(), bytes);
+    }
+
+    void Imm32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void Imm64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    const BytecodeProgram& program_;
+    std::vector<uint8_t> code_;
+    uint32_t xmm0_slot_ = kNoSlot;
+};
+
+}  /* namespace */
+
+JitFunction::JitFunction(BytecodeProgram program) : program_(std::move(program)) {
+    auto code = CodeEmitter(program_).Emit();
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        return;
+    }
+    code_ = memory;
+    code_size_ = code.size();
+    native_ = reinterpret_cast<NativeFunction>(memory);
+}
+
+JitFunction::~JitFunction() {
+    if (code_ != nullptr) {
+        munmap(code_, code_size_);
+    }
+}
+
+#else
+
+JitFunction::JitFunction(BytecodeProgram program) : program_(std::move(program)) {
+}
+
+JitFunction::~JitFunction() {
+}
+
+#endif
+
+std::shared_ptr<JitFunction> JitFunction::Compile(const ExpressionPtr& expr) {
+    return std::make_shared<JitFunction>(BytecodeProgram::Compile(expr));
+}
+
+std::shared_ptr<JitFunction> JitCache::GetOrCompile(const ExpressionPtr& expr) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (auto function = functions_.Find(expr)) {
+            return *function;
+        }
+    }
+    /* Compiled without the lock, a concurrent miss on the same expression only costs time */
+    auto function = JitFunction::Compile(expr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    functions_.Insert(expr, function);
+    return function;
+}
+
+void JitCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    functions_.Clear();
+}
+
+size_t JitCache::GetHits() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return functions_.GetHits();
+}
+
+size_t JitCache::GetMisses() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return functions_.GetMisses();
+}
+
+}  /* namespace calculus */
@@ -4,9 +4,9 @@
 
 namespace calculus {
 
-ExpressionPtr NegateOp::Simplify() {
+ExpressionPtr NegateOp::DoSimplify() {
     if (Is<Constant>(expr_)) {
-        return BuildConstant(-As<Constant>(expr_)->GetValue());
+        return BuildConstant(-As<Constant>(expr_)->GetNumber());
     }
     if (Is<NegateOp>(expr_)) {
         return As<NegateOp>(expr_)->GetInnerExpr()->Simplify();
@@ -16,21 +16,21 @@ ExpressionPtr NegateOp::Simplify() {
         for (size_t i = 0; i < summands_copy.size(); ++i) {
             summands_copy[i].inverse ^= true;
         }
-        return std::make_shared<Sum>(std::move(summands_copy));
+        return Make<Sum>(std::move(summands_copy));
     }
-    return std::make_shared<NegateOp>(expr_->Simplify());
+    return Make<NegateOp>(expr_->Simplify());
 }
 
-ExpressionPtr NegateOp::TakeDerivative(char var_name) {
-    return std::make_shared<NegateOp>(expr_->TakeDerivative(var_name));
+ExpressionPtr NegateOp::DoTakeDerivative(char var_name) {
+    return Make<NegateOp>(expr_->TakeDerivative(var_name));
 }
 
 ExpressionPtr NegateOp::Call(const std::vector<ExpressionPtr>& args) {
-    return std::make_shared<NegateOp>(expr_->Call(args));
+    return Make<NegateOp>(expr_->Call(args));
 }
 
-ExpressionPtr NegateOp::Substitute(char var_name, const ExpressionPtr& value) {
-    return std::make_shared<NegateOp>(expr_->Substitute(var_name, value));
+ExpressionPtr NegateOp::DoSubstitute(const Bindings& bindings) {
+    return Make<NegateOp>(expr_->Substitute(bindings));
 }
 
 void NegateOp::Print(std::ostream& out, int cur_priority_level) const {
@@ -57,6 +57,10 @@ void NegateOp::TexDump(std::ostream& out, int cur_priority_level) const {
     }
 }
 
+size_t NegateOp::ComputeHash() const {
+    return HashCombine(HashSeed(kKind), expr_->GetHash());
+}
+
 bool NegateOp::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     return expr_->DeepCompare(ptr->expr_);
@@ -0,0 +1,40 @@
+#include <normalize.h>
+
+#include <unordered_map>
+
+namespace calculus {
+
+NormalizeResult Normalize(const ExpressionPtr& expr, int max_passes, const NormalizeCallback& on_pass) {
+    NormalizeResult result;
+    result.expr = expr;
+
+    std::unordered_multimap<size_t, ExpressionPtr> seen;
+
+    while (result.passes < max_passes) {
+        if (on_pass) {
+            on_pass(result.expr, result.passes);
+        }
+
+        auto next = result.expr->Simplify();
+        ++result.passes;
+        if (next->DeepCompare(result.expr)) {
+            result.converged = true;
+            return result;
+        }
+
+        seen.emplace(result.expr->GetHash(), result.expr);
+        result.expr = next;
+
+        auto range = seen.equal_range(next->GetHash());
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (iter->second->DeepCompare(next)) {
+                result.oscillating = true;
+                return result;
+            }
+        }
+    }
+
+    return result;
+}
+
+}  /* namespace calculus */
@@ -0,0 +1,418 @@
+#include <number.h>
+#include "calculus_internal.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <ostream>
+
+namespace calculus {
+
+// Decimal exponents beyond this make Parse() fall back to a double
+constexpr int kMaxParsedExponent = 4096;
+
+/* int64 arithmetic that fails instead of overflowing. INT64_MIN is excluded as well, so that
+ * negating and taking std::gcd of inline values stays defined. */
+static bool CheckedAdd(int64_t lhs, int64_t rhs, int64_t* result) {
+    return !__builtin_add_overflow(lhs, rhs, result) && *result != INT64_MIN;
+}
+
+static bool CheckedMultiply(int64_t lhs, int64_t rhs, int64_t* result) {
+    return !__builtin_mul_overflow(lhs, rhs, result) && *result != INT64_MIN;
+}
+
+static BigInt PowerOfTen(unsigned exp) {
+    BigInt result(1);
+    for (; exp >= 18; exp -= 18) {
+        result *= BigInt(int64_t(1000000000000000000));
+    }
+    int64_t rest = 1;
+    for (; exp > 0; --exp) {
+        rest *= 10;
+    }
+    return result * BigInt(rest);
+}
+
+Number::Number(int64_t value) {
+    if (value == INT64_MIN) {
+        *this = FromBig(BigInt(value), BigInt(1));
+    } else {
+        numerator_ = value;
+    }
+}
+
+Number Number::FromSmall(int64_t numerator, int64_t denominator) {
+    if (denominator < 0) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+    int64_t gcd = std::gcd(numerator, denominator);
+    Number result;
+    result.numerator_ = numerator / gcd;
+    result.denominator_ = denominator / gcd;
+    return result;
+}
+
+Number Number::FromBig(BigInt numerator, BigInt denominator) {
+    if (denominator.IsZero()) {
+        throw RuntimeError("Division by zero");
+    }
+    if (denominator.IsNegative()) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+    BigInt gcd = BigInt::Gcd(numerator, denominator);
+    if (gcd != BigInt(1)) {
+        numerator /= gcd;
+        denominator /= gcd;
+    }
+    if (numerator.FitsInt64() && denominator.FitsInt64() && numerator != BigInt(INT64_MIN) &&
+            denominator != BigInt(INT64_MIN)) {
+        Number result;
+        result.numerator_ = numerator.ToInt64();
+        result.denominator_ = denominator.ToInt64();
+        return result;
+    }
+    Number result;
+    result.kind_ = Kind::kBig;
+    result.big_ = std::make_shared<const Big>(Big{std::move(numerator), std::move(denominator)});
+    return result;
+}
+
+Number::Big Number::ToBig() const {
+    if (kind_ == Kind::kBig) {
+        return *big_;
+    }
+    return {BigInt(numerator_), BigInt(denominator_)};
+}
+
+Number Number::Fraction(const BigInt& numerator, const BigInt& denominator) {
+    return FromBig(numerator, denominator);
+}
+
+Number Number::Real(double value) {
+    Number result;
+    result.kind_ = Kind::kReal;
+    // One NaN regardless of sign and payload, so that it hashes and compares as one value
+    result.real_ = std::isnan(value) ? std::numeric_limits<double>::quiet_NaN() : value;
+    return result;
+}
+
+Number Number::Parse(const std::string& text) {
+    BigInt mantissa;
+    int exp = 0;
+    size_t i = 0;
+    bool fraction = false;
+    int64_t chunk = 0;
+    int64_t chunk_scale = 1;
+    for (; i < text.size() && (std::isdigit(text[i]) || text[i] == '.'); ++i) {
+        if (text[i] == '.') {
+            fraction = true;
+            continue;
+        }
+        chunk = chunk * 10 + (text[i] - '0');
+        chunk_scale *= 10;
+        if (fraction) {
+            --exp;
+        }
+        if (chunk_scale == 1000000000) {
+            mantissa = mantissa * BigInt(chunk_scale) + BigInt(chunk);
+            chunk = 0;
+            chunk_scale = 1;
+        }
+    }
+    mantissa = mantissa * BigInt(chunk_scale) + BigInt(chunk);
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        long literal_exp = std::strtol(text.c_str() + i + 1, nullptr, 10);
+        if (std::labs(literal_exp) > kMaxParsedExponent) {
+            return Real(std::stod(text));
+        }
+        exp += literal_exp;
+    }
+    if (std::abs(exp) > kMaxParsedExponent) {
+        return Real(std::stod(text));
+    }
+    if (exp >= 0) {
+        return FromBig(mantissa * PowerOfTen(exp), BigInt(1));
+    }
+    return FromBig(mantissa, PowerOfTen(-exp));
+}
+
+bool Number::IsInteger() const {
+    switch (kind_) {
+        case Kind::kSmall:
+            return denominator_ == 1;
+        case Kind::kBig:
+            return big_->denominator == BigInt(1);
+        default:
+            return false;
+    }
+}
+
+bool Number::IsZero() const {
+    return kind_ == Kind::kSmall ? numerator_ == 0 : (kind_ == Kind::kReal && real_ == 0);
+}
+
+int Number::Sign() const {
+    switch (kind_) {
+        case Kind::kSmall:
+            return (numerator_ > 0) - (numerator_ < 0);
+        case Kind::kBig:
+            return big_->numerator.IsNegative() ? -1 : 1;
+        default:
+            return (real_ > 0) - (real_ < 0);
+    }
+}
+
+double Number::ToDouble() const {
+    switch (kind_) {
+        case Kind::kSmall:
+            return static_cast<double>(numerator_) / denominator_;
+        case Kind::kBig:
+        {
+            // The quotient is taken to 64 bits before scaling back, so that huge parts do not overflow
+            long shift = 64 - (static_cast<long>(big_->numerator.BitLength()) -
+                               static_cast<long>(big_->denominator.BitLength()));
+            BigInt numerator = big_->numerator;
+            BigInt denominator = big_->denominator;
+            if (shift > 0) {
+                numerator <<= shift;
+            } else {
+                denominator <<= -shift;
+            }
+            return std::ldexp((numerator / denominator).ToDouble(), -shift);
+        }
+        default:
+            return real_;
+    }
+}
+
+bool Number::ToInt64(int64_t* value) const {
+    if (kind_ != Kind::kSmall || denominator_ != 1) {
+        return false;
+    }
+    *value = numerator_;
+    return true;
+}
+
+BigInt Number::GetNumerator() const {
+    return kind_ == Kind::kBig ? big_->numerator : BigInt(numerator_);
+}
+
+BigInt Number::GetDenominator() const {
+    return kind_ == Kind::kBig ? big_->denominator : BigInt(denominator_);
+}
+
+Number Number::operator-() const {
+    switch (kind_) {
+        case Kind::kSmall:
+        {
+            Number result = *this;
+            result.numerator_ = -numerator_;
+            return result;
+        }
+        case Kind::kBig:
+            return FromBig(-big_->numerator, big_->denominator);
+        default:
+            return Real(-real_);
+    }
+}
+
+Number Number::Abs() const {
+    return Sign() < 0 ? -*this : *this;
+}
+
+Number& Number::operator+=(const Number& other) {
+    if (!IsRational() || !other.IsRational()) {
+        return *this = Real(ToDouble() + other.ToDouble());
+    }
+    if (kind_ == Kind::kSmall && other.kind_ == Kind::kSmall) {
+        int64_t gcd = std::gcd(denominator_, other.denominator_);
+        int64_t lhs, rhs, numerator, denominator;
+        if (CheckedMultiply(numerator_, other.denominator_ / gcd, &lhs) &&
+                CheckedMultiply(other.numerator_, denominator_ / gcd, &rhs) && CheckedAdd(lhs, rhs, &numerator) &&
+                CheckedMultiply(denominator_, other.denominator_ / gcd, &denominator)) {
+            return *this = denominator == 1 ? Number(numerator) : FromSmall(numerator, denominator);
+        }
+    }
+    Big lhs = ToBig();
+    Big rhs = other.ToBig();
+    return *this = FromBig(lhs.numerator * rhs.denominator + rhs.numerator * lhs.denominator,
+                           lhs.denominator * rhs.denominator);
+}
+
+Number& Number::operator-=(const Number& other) {
+    return *this += -other;
+}
+
+Number& Number::operator*=(const Number& other) {
+    if (!IsRational() || !other.IsRational()) {
+        return *this = Real(ToDouble() * other.ToDouble());
+    }
+    if (kind_ == Kind::kSmall && other.kind_ == Kind::kSmall) {
+        if (numerator_ == 0 || other.numerator_ == 0) {
+            return *this = Number();
+        }
+        // Cross-cancelling first keeps the result reduced
+        int64_t l_gcd = std::gcd(numerator_, other.denominator_);
+        int64_t r_gcd = std::gcd(other.numerator_, denominator_);
+        int64_t numerator, denominator;
+        if (CheckedMultiply(numerator_ / l_gcd, other.numerator_ / r_gcd, &numerator) &&
+                CheckedMultiply(denominator_ / r_gcd, other.denominator_ / l_gcd, &denominator)) {
+            numerator_ = numerator;
+            denominator_ = denominator;
+            return *this;
+        }
+    }
+    Big lhs = ToBig();
+    Big rhs = other.ToBig();
+    return *this = FromBig(lhs.numerator * rhs.numerator, lhs.denominator * rhs.denominator);
+}
+
+Number& Number::operator/=(const Number& other) {
+    if (!IsRational() || !other.IsRational()) {
+        return *this = Real(ToDouble() / other.ToDouble());
+    }
+    if (other.IsZero()) {
+        throw RuntimeError("Division by zero");
+    }
+    Number inverse;
+    if (other.kind_ == Kind::kSmall) {
+        inverse = FromSmall(other.denominator_, other.numerator_);
+    } else {
+        inverse = FromBig(other.big_->denominator, other.big_->numerator);
+    }
+    return *this *= inverse;
+}
+
+Number Number::Pow(const Number& exp) const {
+    int64_t power;
+    if (IsRational() && exp.ToInt64(&power) && !(IsZero() && power < 0)) {
+        Big base = ToBig();
+        double bits = std::max(base.numerator.BitLength(), base.denominator.BitLength()) * std::fabs(power);
+        if (bits <= kMaxExactPowerBits) {
+            Number factor = power < 0 ? Number(1) / *this : *this;
+            Number result(1);
+            for (uint64_t rest = power < 0 ? 0 - static_cast<uint64_t>(power) : power; rest != 0; rest >>= 1) {
+                if (rest & 1) {
+                    result *= factor;
+                }
+                if (rest > 1) {
+                    factor *= factor;
+                }
+            }
+            return result;
+        }
+    }
+    return Real(std::pow(ToDouble(), exp.ToDouble()));
+}
+
+int Number::Compare(const Number& lhs, const Number& rhs) {
+    if (!lhs.IsRational() || !rhs.IsRational()) {
+        double l_value = lhs.ToDouble();
+        double r_value = rhs.ToDouble();
+        if (std::isnan(l_value) || std::isnan(r_value)) {
+            return static_cast<int>(std::isnan(l_value)) - static_cast<int>(std::isnan(r_value));
+        }
+        if (l_value != r_value) {
+            return l_value < r_value ? -1 : 1;
+        }
+        if (lhs.IsRational() == rhs.IsRational()) {
+            return 0;
+        }
+        return lhs.IsRational() ? -1 : 1;
+    }
+    if (lhs.kind_ == Kind::kSmall && rhs.kind_ == Kind::kSmall) {
+        __int128 l_value = static_cast<__int128>(lhs.numerator_) * rhs.denominator_;
+        __int128 r_value = static_cast<__int128>(rhs.numerator_) * lhs.denominator_;
+        return l_value < r_value ? -1 : (r_value < l_value ? 1 : 0);
+    }
+    Big l_big = lhs.ToBig();
+    Big r_big = rhs.ToBig();
+    return BigInt::Compare(l_big.numerator * r_big.denominator, r_big.numerator * l_big.denominator);
+}
+
+size_t Number::Hash() const {
+    switch (kind_) {
+        case Kind::kSmall:
+            return HashCombine(HashCombine(0, std::hash<int64_t>()(numerator_)), std::hash<int64_t>()(denominator_));
+        case Kind::kBig:
+            return HashCombine(big_->numerator.Hash(), big_->denominator.Hash());
+        default:
+            return HashCombine(1, std::hash<double>()(real_));
+    }
+}
+
+/* The smallest k for which the denominator divides 10 ^ k, or 0 if there is none, i.e. the
+ * denominator has prime factors other than 2 and 5 */
+static unsigned DecimalPlaces(const Number& number) {
+    unsigned twos = 0;
+    unsigned fives = 0;
+    if (number.GetDenominator().FitsInt64()) {
+        int64_t denominator = number.GetDenominator().ToInt64();
+        for (; denominator % 2 == 0; denominator /= 2) {
+            ++twos;
+        }
+        for (; denominator % 5 == 0; denominator /= 5) {
+            ++fives;
+        }
+        if (denominator != 1) {
+            return 0;
+        }
+    } else {
+        BigInt denominator = number.GetDenominator();
+        const BigInt two(2);
+        const BigInt five(5);
+        for (; (denominator % two).IsZero(); denominator /= two) {
+            ++twos;
+        }
+        for (; (denominator % five).IsZero(); denominator /= five) {
+            ++fives;
+        }
+        if (denominator != BigInt(1)) {
+            return 0;
+        }
+    }
+    return std::max(twos, fives);
+}
+
+bool Number::IsPrintedAsFraction() const {
+    return IsRational() && !IsInteger() && DecimalPlaces(*this) == 0;
+}
+
+std::string Number::ToDecimal() const {
+    unsigned places = DecimalPlaces(*this);
+    BigInt scaled = GetNumerator().Abs() * (PowerOfTen(places) / GetDenominator());
+    std::string digits = scaled.ToString();
+    if (digits.size() <= places) {
+        digits.insert(0, places + 1 - digits.size(), '0');
+    }
+    digits.insert(digits.size() - places, ".");
+    return (Sign() < 0 ? "-" : "") + digits;
+}
+
+void Number::Print(std::ostream& out) const {
+    if (!IsRational()) {
+        out << real_;
+    } else if (IsInteger()) {
+        out << GetNumerator().ToString();
+    } else if (IsPrintedAsFraction()) {
+        out << GetNumerator().ToString() << " / " << GetDenominator().ToString();
+    } else {
+        out << ToDecimal();
+    }
+}
+
+void Number::TexDump(std::ostream& out) const {
+    if (IsPrintedAsFraction()) {
+        out << (Sign() < 0 ? "-" : "") << "\\frac{" << GetNumerator().Abs().ToString() << "}{"
+            << GetDenominator().ToString() << "}";
+    } else {
+        Print(out);
+    }
+}
+
+}  /* namespace calculus */
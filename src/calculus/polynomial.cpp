@@ -0,0 +1,996 @@
+#include <polynomial.h>
+#include <big_int.h>
+#include <variable.h>
+#include <sum.h>
+#include <product.h>
+#include <power_op.h>
+#include <negate_op.h>
+#include "calculus_internal.h"
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <unordered_map>
+
+namespace calculus {
+
+static bool MonomialLess(const Polynomial::Term& lhs, const Polynomial::Term& rhs) {
+    return lhs.monomial < rhs.monomial;
+}
+
+Polynomial::Polynomial(const Number& value) {
+    if (!calculus::IsZero(value)) {
+        terms_.push_back({0, value});
+    }
+}
+
+Polynomial Polynomial::FromVariable(char name) {
+    if (VariableMask(name) == 0) {
+        throw RuntimeError(std::string("Cannot take ") + name + " as a polynomial variable");
+    }
+    Polynomial result;
+    result.variables_ = std::string(1, name);
+    result.terms_.push_back({1, 1});
+    return result;
+}
+
+unsigned Polynomial::GetDegree(size_t variable) const {
+    unsigned degree = 0;
+    for (const auto& term : terms_) {
+        degree = std::max(degree, GetExponent(term.monomial, variable));
+    }
+    return degree;
+}
+
+Polynomial Polynomial::Extend(const std::string& variables) const {
+    std::vector<unsigned> shifts;
+    shifts.reserve(variables_.size());
+    for (char name : variables_) {
+        shifts.push_back(variables.find(name) * kPolynomialExponentBits);
+    }
+
+    Polynomial result;
+    result.variables_ = variables;
+    result.terms_.reserve(terms_.size());
+    for (const auto& term : terms_) {
+        Monomial monomial = 0;
+        for (size_t i = 0; i < variables_.size(); ++i) {
+            monomial |= Monomial(GetExponent(term.monomial, i)) << shifts[i];
+        }
+        result.terms_.push_back({monomial, term.coefficient});
+    }
+    std::sort(result.terms_.begin(), result.terms_.end(), MonomialLess);
+    return result;
+}
+
+void Polynomial::Unify(Polynomial* lhs, Polynomial* rhs) {
+    if (lhs->variables_ == rhs->variables_) {
+        return;
+    }
+    std::string variables;
+    std::set_union(lhs->variables_.begin(), lhs->variables_.end(), rhs->variables_.begin(), rhs->variables_.end(),
+                   std::back_inserter(variables));
+    if (variables.size() > kMaxPolynomialVariables) {
+        throw RuntimeError("A polynomial takes at most " + std::to_string(kMaxPolynomialVariables) + " variables");
+    }
+    if (lhs->variables_ != variables) {
+        *lhs = lhs->Extend(variables);
+    }
+    if (rhs->variables_ != variables) {
+        *rhs = rhs->Extend(variables);
+    }
+}
+
+void Polynomial::AddScaled(const Polynomial& other, const Number& factor) {
+    std::vector<Term> result;
+    result.reserve(terms_.size() + other.terms_.size());
+    size_t i = 0;
+    size_t j = 0;
+    while (i < terms_.size() || j < other.terms_.size()) {
+        if (j == other.terms_.size() || (i < terms_.size() && terms_[i].monomial < other.terms_[j].monomial)) {
+            result.push_back(terms_[i++]);
+        } else if (i == terms_.size() || other.terms_[j].monomial < terms_[i].monomial) {
+            result.push_back({other.terms_[j].monomial, factor * other.terms_[j].coefficient});
+            ++j;
+        } else {
+            Number coefficient = terms_[i].coefficient + factor * other.terms_[j].coefficient;
+            if (!calculus::IsZero(coefficient)) {
+                result.push_back({terms_[i].monomial, coefficient});
+            }
+            ++i;
+            ++j;
+        }
+    }
+    terms_ = std::move(result);
+}
+
+Polynomial& Polynomial::operator+=(const Polynomial& other) {
+    if (variables_ == other.variables_) {
+        AddScaled(other, 1);
+    } else {
+        Polynomial copy = other;
+        Unify(this, &copy);
+        AddScaled(copy, 1);
+    }
+    return *this;
+}
+
+Polynomial& Polynomial::operator-=(const Polynomial& other) {
+    if (variables_ == other.variables_) {
+        AddScaled(other, -1);
+    } else {
+        Polynomial copy = other;
+        Unify(this, &copy);
+        AddScaled(copy, -1);
+    }
+    return *this;
+}
+
+Polynomial& Polynomial::operator*=(const Number& factor) {
+    if (calculus::IsZero(factor)) {
+        terms_.clear();
+        return *this;
+    }
+    for (auto& term : terms_) {
+        term.coefficient *= factor;
+    }
+    return *this;
+}
+
+Polynomial Polynomial::operator*(const Polynomial& other) const {
+    Polynomial lhs = *this;
+    Polynomial rhs = other;
+    Unify(&lhs, &rhs);
+    for (size_t i = 0; i < lhs.variables_.size(); ++i) {
+        if (lhs.GetDegree(i) + rhs.GetDegree(i) > kMaxPolynomialDegree) {
+            throw RuntimeError("Polynomial degree overflow");
+        }
+    }
+
+    Polynomial result;
+    result.variables_ = lhs.variables_;
+    if (lhs.terms_.size() > rhs.terms_.size()) {
+        std::swap(lhs, rhs);
+    }
+    if (lhs.terms_.size() == 1) {
+        // Adding one monomial to all keys keeps their order
+        result.terms_ = std::move(rhs.terms_);
+        for (auto& term : result.terms_) {
+            term.monomial += lhs.terms_[0].monomial;
+            term.coefficient *= lhs.terms_[0].coefficient;
+        }
+        return result;
+    }
+
+    std::unordered_map<Monomial, Number> products;
+    products.reserve(lhs.terms_.size() * rhs.terms_.size());
+    for (const auto& l_term : lhs.terms_) {
+        for (const auto& r_term : rhs.terms_) {
+            products[l_term.monomial + r_term.monomial] += l_term.coefficient * r_term.coefficient;
+        }
+    }
+    result.terms_.reserve(products.size());
+    for (const auto& product : products) {
+        if (!calculus::IsZero(product.second)) {
+            result.terms_.push_back({product.first, product.second});
+        }
+    }
+    std::sort(result.terms_.begin(), result.terms_.end(), MonomialLess);
+    return result;
+}
+
+Polynomial Polynomial::Pow(unsigned exp) const {
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        if (static_cast<uint64_t>(GetDegree(i)) * exp > kMaxPolynomialDegree) {
+            throw RuntimeError("Polynomial degree overflow");
+        }
+    }
+
+    Polynomial result(1);
+    result.variables_ = variables_;
+    if (exp == 0 || terms_.empty()) {
+        return exp == 0 ? result : *this;
+    }
+
+    if (terms_.size() == 2) {
+        // (a + b) ^ n as the sum of C(n, k) a ^ k b ^ (n - k)
+        const Term& a = terms_[0];
+        const Term& b = terms_[1];
+        result.terms_.clear();
+        result.terms_.reserve(exp + 1);
+        Number binomial = 1;
+        for (unsigned k = 0; k <= exp; ++k) {
+            int a_exp = static_cast<int>(k);
+            int b_exp = static_cast<int>(exp - k);
+            Number coefficient = binomial * a.coefficient.Pow(a_exp) * b.coefficient.Pow(b_exp);
+            result.terms_.push_back({a.monomial * k + b.monomial * (exp - k), coefficient});
+            binomial = binomial * b_exp / (a_exp + 1);
+        }
+        std::sort(result.terms_.begin(), result.terms_.end(), MonomialLess);
+        return result;
+    }
+
+    Polynomial base = *this;
+    while (true) {
+        if (exp & 1) {
+            result = result * base;
+        }
+        exp >>= 1;
+        if (exp == 0) {
+            return result;
+        }
+        base = base * base;
+    }
+}
+
+static std::string VariablesOf(uint32_t free_variables) {
+    std::string variables;
+    for (char name = 'a'; name <= 'z'; ++name) {
+        if ((free_variables & VariableMask(name)) != 0) {
+            variables.push_back(name);
+        }
+    }
+    return variables;
+}
+
+bool Polynomial::FromExpression(const ExpressionPtr& expr, size_t max_terms, Polynomial* result) {
+    if (!expr->IsPolynomial()) {
+        return false;
+    }
+    std::string variables = VariablesOf(expr->GetFreeVariables());
+    if (variables.size() > kMaxPolynomialVariables) {
+        return false;
+    }
+    return Build(expr, variables, max_terms, result);
+}
+
+bool Polynomial::FromRationalFunction(const std::vector<AssociativeOperand>& multipliers, size_t max_terms,
+                                      Polynomial* numerator, Polynomial* denominator) {
+    uint32_t free_variables = 0;
+    for (const auto& multiplier : multipliers) {
+        free_variables |= multiplier.expr->GetFreeVariables();
+    }
+    std::string variables = VariablesOf(free_variables);
+    if (variables.size() > kMaxPolynomialVariables) {
+        return false;
+    }
+    Polynomial parts[2] = {Polynomial(1), Polynomial(1)};
+    for (auto& part : parts) {
+        part.variables_ = variables;
+    }
+    for (const auto& multiplier : multipliers) {
+        Polynomial factor;
+        if (!multiplier.expr->IsPolynomial() || !Build(multiplier.expr, variables, max_terms, &factor)) {
+            return false;
+        }
+        Polynomial& part = parts[multiplier.inverse];
+        if (!part.FitsProduct(factor, 1) || part.terms_.size() * factor.terms_.size() > max_terms * max_terms) {
+            return false;
+        }
+        part = part * factor;
+        if (part.terms_.size() > max_terms) {
+            return false;
+        }
+    }
+    *numerator = std::move(parts[0]);
+    *denominator = std::move(parts[1]);
+    return true;
+}
+
+/* Upper bound for the number of terms of p ^ exp, p having `terms` terms: the number of
+ * multisets of size `exp` over the terms */
+static double PowerTermBound(size_t terms, unsigned exp) {
+    double bound = 1;
+    for (unsigned k = 1; k <= exp && bound < SIZE_MAX; ++k) {
+        bound = bound * (terms - 1 + k) / k;
+    }
+    return bound;
+}
+
+bool Polynomial::FitsProduct(const Polynomial& factor, uint64_t times) const {
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        if (GetDegree(i) + factor.GetDegree(i) * times > kMaxPolynomialDegree) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Polynomial::Build(const ExpressionPtr& expr, const std::string& variables, size_t max_terms, Polynomial* result) {
+    Polynomial polynomial;
+    polynomial.variables_ = variables;
+
+    switch (expr->GetKind()) {
+        case ExpressionKind::kConstant:
+            polynomial = Polynomial(As<Constant>(expr)->GetNumber());
+            polynomial.variables_ = variables;
+            break;
+        case ExpressionKind::kVariable:
+        {
+            size_t index = variables.find(As<Variable>(expr)->GetName());
+            if (index == std::string::npos) {
+                return false;
+            }
+            polynomial.terms_.push_back({Monomial(1) << (index * kPolynomialExponentBits), 1});
+            break;
+        }
+        case ExpressionKind::kSum:
+            for (const auto& summand : As<Sum>(expr)->GetOperands()) {
+                Polynomial term;
+                if (!Build(summand.expr, variables, max_terms, &term)) {
+                    return false;
+                }
+                polynomial.AddScaled(term, summand.inverse ? -1 : 1);
+                if (polynomial.terms_.size() > max_terms) {
+                    return false;
+                }
+            }
+            break;
+        case ExpressionKind::kProduct:
+            polynomial = Polynomial(1);
+            polynomial.variables_ = variables;
+            for (const auto& multiplier : As<Product>(expr)->GetOperands()) {
+                if (multiplier.inverse) {
+                    const Number& value = As<Constant>(multiplier.expr)->GetNumber();
+                    if (calculus::IsZero(value)) {
+                        return false;
+                    }
+                    polynomial *= Number(1) / value;
+                    continue;
+                }
+                Polynomial factor;
+                if (!Build(multiplier.expr, variables, max_terms, &factor) || !polynomial.FitsProduct(factor, 1) ||
+                        polynomial.terms_.size() * factor.terms_.size() > max_terms * max_terms) {
+                    return false;
+                }
+                polynomial = polynomial * factor;
+                if (polynomial.terms_.size() > max_terms) {
+                    return false;
+                }
+            }
+            break;
+        case ExpressionKind::kPowerOp:
+        {
+            double exp = As<Constant>(As<PowerOp>(expr)->GetExp())->GetValue();
+            Polynomial base;
+            if (exp > kMaxPolynomialDegree || !Build(As<PowerOp>(expr)->GetBase(), variables, max_terms, &base) ||
+                    PowerTermBound(base.terms_.size(), exp) > max_terms || !polynomial.FitsProduct(base, exp)) {
+                return false;
+            }
+            polynomial = base.Pow(static_cast<unsigned>(exp));
+            break;
+        }
+        case ExpressionKind::kNegateOp:
+            if (!Build(As<NegateOp>(expr)->GetInnerExpr(), variables, max_terms, &polynomial)) {
+                return false;
+            }
+            polynomial *= -1;
+            break;
+        default:
+            return false;
+    }
+
+    *result = std::move(polynomial);
+    return true;
+}
+
+bool Polynomial::PrintsBefore(Monomial lhs, Monomial rhs) const {
+    unsigned l_degree = 0;
+    unsigned r_degree = 0;
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        l_degree += GetExponent(lhs, i);
+        r_degree += GetExponent(rhs, i);
+    }
+    if (l_degree != r_degree) {
+        return l_degree > r_degree;
+    }
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        if (GetExponent(lhs, i) != GetExponent(rhs, i)) {
+            return GetExponent(lhs, i) > GetExponent(rhs, i);
+        }
+    }
+    return false;
+}
+
+ExpressionPtr Polynomial::ToExpression() const {
+    std::vector<const Term*> ordered;
+    ordered.reserve(terms_.size());
+    for (const auto& term : terms_) {
+        ordered.push_back(&term);
+    }
+    std::sort(ordered.begin(), ordered.end(), [this](const Term* lhs, const Term* rhs) {
+        return PrintsBefore(lhs->monomial, rhs->monomial);
+    });
+
+    std::vector<AssociativeOperand> summands;
+    summands.reserve(terms_.size());
+    for (const Term* term_ptr : ordered) {
+        const Term& term = *term_ptr;
+        std::vector<AssociativeOperand> factors;
+        for (size_t i = 0; i < variables_.size(); ++i) {
+            unsigned exp = GetExponent(term.monomial, i);
+            if (exp == 0) {
+                continue;
+            }
+            auto variable = Make<Variable>(variables_[i]);
+            factors.emplace_back(exp == 1 ? variable : Make<PowerOp>(variable, BuildConstant(static_cast<int64_t>(exp))), false);
+        }
+
+        Number magnitude = term.coefficient.Abs();
+        ExpressionPtr summand;
+        if (factors.empty()) {
+            summand = BuildConstant(magnitude);
+        } else {
+            if (!calculus::IsZero(magnitude - 1)) {
+                factors.emplace_back(BuildConstant(magnitude), false);
+            }
+            summand = factors.size() == 1 ? factors[0].expr : Make<Product>(std::move(factors));
+        }
+        summands.emplace_back(summand, term.coefficient.Sign() < 0);
+    }
+
+    if (summands.empty()) {
+        return kConstantZero;
+    }
+    if (summands.size() == 1) {
+        if (IsConstant()) {
+            return BuildConstant(terms_[0].coefficient);
+        }
+        return summands[0].inverse ? Make<NegateOp>(summands[0].expr) : summands[0].expr;
+    }
+    return Make<Sum>(std::move(summands));
+}
+
+/* The GCD works on exact integral coefficients */
+struct IntegralTerm {
+    Polynomial::Monomial monomial;
+    BigInt coefficient;
+};
+
+using IntegralPolynomial = std::vector<IntegralTerm>;
+
+constexpr int kHeuristicGcdAttempts = 6;
+// The heuristic gives up once the evaluation point or a value takes more bits
+constexpr size_t kMaxHeuristicGcdBits = 1 << 14;
+
+static unsigned Exponent(Polynomial::Monomial monomial, size_t variable) {
+    return (monomial >> (variable * kPolynomialExponentBits)) & kMaxPolynomialDegree;
+}
+
+/* The polynomial times the least common denominator of its coefficients, which is stored in
+ * `scale`. Fails for floating point coefficients. */
+static bool ToIntegral(const Polynomial& polynomial, IntegralPolynomial* result, Number* scale) {
+    BigInt common(1);
+    for (const auto& term : polynomial.GetTerms()) {
+        if (!term.coefficient.IsRational()) {
+            return false;
+        }
+        BigInt denominator = term.coefficient.GetDenominator();
+        common *= denominator / BigInt::Gcd(common, denominator);
+    }
+
+    result->clear();
+    result->reserve(polynomial.GetTerms().size());
+    for (const auto& term : polynomial.GetTerms()) {
+        result->push_back({term.monomial,
+                           term.coefficient.GetNumerator() * (common / term.coefficient.GetDenominator())});
+    }
+    *scale = Number::Fraction(common, BigInt(1));
+    return true;
+}
+
+static void FromIntegral(const IntegralPolynomial& polynomial, std::vector<Polynomial::Term>* result) {
+    result->clear();
+    result->reserve(polynomial.size());
+    for (const auto& term : polynomial) {
+        result->push_back({term.monomial, Number::Fraction(term.coefficient, BigInt(1))});
+    }
+}
+
+static BigInt Content(const IntegralPolynomial& polynomial) {
+    BigInt content;
+    for (const auto& term : polynomial) {
+        content = BigInt::Gcd(content, term.coefficient);
+    }
+    return content;
+}
+
+static BigInt MaxNorm(const IntegralPolynomial& polynomial) {
+    BigInt norm;
+    for (const auto& term : polynomial) {
+        norm = std::max(norm, term.coefficient.Abs());
+    }
+    return norm;
+}
+
+static bool DependsOn(const IntegralPolynomial& polynomial, size_t variable) {
+    for (const auto& term : polynomial) {
+        if (Exponent(term.monomial, variable) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Sorts the terms and merges the equal monomials */
+static void Canonicalize(IntegralPolynomial* polynomial) {
+    std::sort(polynomial->begin(), polynomial->end(), [](const IntegralTerm& lhs, const IntegralTerm& rhs) {
+        return lhs.monomial < rhs.monomial;
+    });
+    size_t size = 0;
+    for (size_t i = 0; i < polynomial->size();) {
+        IntegralTerm term = std::move((*polynomial)[i++]);
+        while (i < polynomial->size() && (*polynomial)[i].monomial == term.monomial) {
+            term.coefficient += (*polynomial)[i++].coefficient;
+        }
+        if (!term.coefficient.IsZero()) {
+            (*polynomial)[size++] = std::move(term);
+        }
+    }
+    polynomial->resize(size);
+}
+
+/* Substitutes `point` for the variable, leaving its exponents zero */
+static bool Evaluate(const IntegralPolynomial& polynomial, size_t variable, const BigInt& point,
+                     IntegralPolynomial* result) {
+    std::vector<BigInt> powers(1, BigInt(1));
+    unsigned shift = variable * kPolynomialExponentBits;
+    result->clear();
+    result->reserve(polynomial.size());
+    for (const auto& term : polynomial) {
+        unsigned exp = Exponent(term.monomial, variable);
+        while (powers.size() <= exp) {
+            powers.push_back(powers.back() * point);
+            if (powers.back().BitLength() > kMaxHeuristicGcdBits) {
+                return false;
+            }
+        }
+        result->push_back({term.monomial - (Polynomial::Monomial(exp) << shift), term.coefficient * powers[exp]});
+    }
+    Canonicalize(result);
+    return true;
+}
+
+/* The inverse of Evaluate() for a polynomial whose coefficients are small in base `point`:
+ * the coefficient of variable ^ i holds the i-th digits, taken from (-point / 2, point / 2] */
+static bool Interpolate(const IntegralPolynomial& polynomial, size_t variable, const BigInt& point,
+                        IntegralPolynomial* result) {
+    unsigned shift = variable * kPolynomialExponentBits;
+    BigInt twice_point = point * 2;
+    IntegralPolynomial rest = polynomial;
+    result->clear();
+    for (unsigned i = 0; !rest.empty(); ++i) {
+        if (i > kMaxPolynomialDegree) {
+            return false;
+        }
+        IntegralPolynomial next;
+        for (auto& term : rest) {
+            BigInt digit = term.coefficient % point;
+            BigInt twice_digit = digit * 2;
+            if (twice_digit > point) {
+                digit -= point;
+            } else if (twice_digit <= -point) {
+                digit += point;
+            }
+            term.coefficient -= digit;
+            if (!digit.IsZero()) {
+                result->push_back({term.monomial + (Polynomial::Monomial(i) << shift), std::move(digit)});
+            }
+            if (!term.coefficient.IsZero()) {
+                next.push_back({term.monomial, term.coefficient / point});
+            }
+        }
+        rest = std::move(next);
+    }
+    Canonicalize(result);
+    return true;
+}
+
+/* Multivariate division by leading terms, the largest monomials. Fails as soon as a quotient
+ * term would not be integral or would push some degree above that of the dividend, as then
+ * the division is not exact. */
+static bool DivideExactly(const IntegralPolynomial& dividend, const IntegralPolynomial& divisor, size_t variables,
+                          IntegralPolynomial* quotient) {
+    std::vector<unsigned> dividend_degrees(variables, 0);
+    std::vector<unsigned> divisor_degrees(variables, 0);
+    for (size_t i = 0; i < variables; ++i) {
+        for (const auto& term : dividend) {
+            dividend_degrees[i] = std::max(dividend_degrees[i], Exponent(term.monomial, i));
+        }
+        for (const auto& term : divisor) {
+            divisor_degrees[i] = std::max(divisor_degrees[i], Exponent(term.monomial, i));
+        }
+    }
+
+    const IntegralTerm& lead = divisor.back();
+    IntegralPolynomial rest = dividend;
+    quotient->clear();
+    while (!rest.empty()) {
+        const IntegralTerm& top = rest.back();
+        for (size_t i = 0; i < variables; ++i) {
+            unsigned exp = Exponent(top.monomial, i);
+            unsigned lead_exp = Exponent(lead.monomial, i);
+            if (exp < lead_exp || exp - lead_exp + divisor_degrees[i] > dividend_degrees[i]) {
+                return false;
+            }
+        }
+        IntegralTerm factor{top.monomial - lead.monomial, {}};
+        BigInt remainder;
+        BigInt::DivMod(top.coefficient, lead.coefficient, &factor.coefficient, &remainder);
+        if (!remainder.IsZero()) {
+            return false;
+        }
+
+        // rest -= factor * divisor; adding one monomial to all keys keeps their order
+        IntegralPolynomial next;
+        next.reserve(rest.size() + divisor.size());
+        size_t i = 0;
+        size_t j = 0;
+        while (i < rest.size() || j < divisor.size()) {
+            Polynomial::Monomial monomial = j < divisor.size() ? divisor[j].monomial + factor.monomial : 0;
+            if (j == divisor.size() || (i < rest.size() && rest[i].monomial < monomial)) {
+                next.push_back(std::move(rest[i++]));
+            } else if (i == rest.size() || monomial < rest[i].monomial) {
+                next.push_back({monomial, -(divisor[j++].coefficient * factor.coefficient)});
+            } else {
+                BigInt coefficient = rest[i++].coefficient - divisor[j++].coefficient * factor.coefficient;
+                if (!coefficient.IsZero()) {
+                    next.push_back({monomial, std::move(coefficient)});
+                }
+            }
+        }
+        rest = std::move(next);
+        quotient->push_back(std::move(factor));
+    }
+    std::reverse(quotient->begin(), quotient->end());
+    return true;
+}
+
+/* Heuristic GCD of nonzero polynomials in the variables below `variables` (Char, Geddes and
+ * Gonnet): the last variable is replaced with an integer large enough for the digits of the
+ * gcd of the values to be the coefficients of the gcd, which is then checked by division */
+static bool HeuristicGcd(const IntegralPolynomial& lhs, const IntegralPolynomial& rhs, size_t variables,
+                         IntegralPolynomial* result) {
+    if (variables == 0) {
+        *result = {{0, BigInt::Gcd(lhs[0].coefficient, rhs[0].coefficient)}};
+        return true;
+    }
+    if (!DependsOn(lhs, variables - 1) && !DependsOn(rhs, variables - 1)) {
+        return HeuristicGcd(lhs, rhs, variables - 1, result);
+    }
+
+    BigInt lhs_content = Content(lhs);
+    BigInt rhs_content = Content(rhs);
+    BigInt content = BigInt::Gcd(lhs_content, rhs_content);
+    IntegralPolynomial lhs_primitive = lhs;
+    IntegralPolynomial rhs_primitive = rhs;
+    for (auto& term : lhs_primitive) {
+        term.coefficient /= lhs_content;
+    }
+    for (auto& term : rhs_primitive) {
+        term.coefficient /= rhs_content;
+    }
+
+    BigInt lhs_norm = MaxNorm(lhs_primitive);
+    BigInt rhs_norm = MaxNorm(rhs_primitive);
+    BigInt bound = std::min(lhs_norm, rhs_norm) * 2 + 29;
+    BigInt point = std::max(std::min(bound, BigInt::FromDouble(99 * std::sqrt(bound.ToDouble()))),
+                            std::min(lhs_norm / lhs_primitive.back().coefficient.Abs(),
+                                     rhs_norm / rhs_primitive.back().coefficient.Abs()) * 2 + 2);
+
+    for (int attempt = 0; attempt < kHeuristicGcdAttempts && point.BitLength() <= kMaxHeuristicGcdBits; ++attempt) {
+        IntegralPolynomial lhs_value, rhs_value, value_gcd, candidate, quotient;
+        if (!Evaluate(lhs_primitive, variables - 1, point, &lhs_value) ||
+                !Evaluate(rhs_primitive, variables - 1, point, &rhs_value)) {
+            return false;
+        }
+        if (!lhs_value.empty() && !rhs_value.empty() &&
+                HeuristicGcd(lhs_value, rhs_value, variables - 1, &value_gcd) &&
+                Interpolate(value_gcd, variables - 1, point, &candidate)) {
+            BigInt candidate_content = Content(candidate);
+            if (candidate.back().coefficient.IsNegative()) {
+                candidate_content = -candidate_content;
+            }
+            for (auto& term : candidate) {
+                term.coefficient /= candidate_content;
+            }
+            if (DivideExactly(lhs_primitive, candidate, variables, &quotient) &&
+                    DivideExactly(rhs_primitive, candidate, variables, &quotient)) {
+                for (auto& term : candidate) {
+                    term.coefficient *= content;
+                }
+                *result = std::move(candidate);
+                return true;
+            }
+        }
+        double growth = std::sqrt(std::sqrt(point.ToDouble()));
+        point = point * 73794 * BigInt::FromDouble(std::isfinite(growth) ? growth : kMaxExactDouble) / 27011;
+    }
+    return false;
+}
+
+bool Polynomial::Gcd(const Polynomial& lhs, const Polynomial& rhs, Polynomial* result) {
+    Polynomial lhs_copy = lhs;
+    Polynomial rhs_copy = rhs;
+    Unify(&lhs_copy, &rhs_copy);
+    IntegralPolynomial lhs_integral, rhs_integral, gcd;
+    Number lhs_scale, rhs_scale;
+    if (lhs.IsZero() || rhs.IsZero() || !ToIntegral(lhs_copy, &lhs_integral, &lhs_scale) ||
+            !ToIntegral(rhs_copy, &rhs_integral, &rhs_scale) ||
+            !HeuristicGcd(lhs_integral, rhs_integral, lhs_copy.variables_.size(), &gcd)) {
+        return false;
+    }
+    Polynomial polynomial;
+    polynomial.variables_ = lhs_copy.variables_;
+    FromIntegral(gcd, &polynomial.terms_);
+    *result = std::move(polynomial);
+    return true;
+}
+
+bool Polynomial::Divide(const Polynomial& divisor, Polynomial* quotient) const {
+    Polynomial dividend = *this;
+    Polynomial divisor_copy = divisor;
+    Unify(&dividend, &divisor_copy);
+    IntegralPolynomial dividend_integral, divisor_integral, result;
+    Number dividend_scale, divisor_scale;
+    if (divisor.IsZero() || !ToIntegral(dividend, &dividend_integral, &dividend_scale) ||
+            !ToIntegral(divisor_copy, &divisor_integral, &divisor_scale) ||
+            !DivideExactly(dividend_integral, divisor_integral, dividend.variables_.size(), &result)) {
+        return false;
+    }
+    Polynomial polynomial;
+    polynomial.variables_ = dividend.variables_;
+    FromIntegral(result, &polynomial.terms_);
+    polynomial *= divisor_scale / dividend_scale;
+    *quotient = std::move(polynomial);
+    return true;
+}
+
+ExpressionPtr SimplifyPolynomial(const ExpressionPtr& expr) {
+    Polynomial polynomial;
+    if (!Polynomial::FromExpression(expr, std::max(kPolynomialTermBudget, expr->GetWeight()), &polynomial)) {
+        return nullptr;
+    }
+    // (x + 1) ^ 10 stays as it is, x * (x + 1) - x ^ 2 becomes x
+    ExpressionPtr expanded = polynomial.ToExpression();
+    return expanded->GetWeight() <= expr->GetWeight() ? expanded : nullptr;
+}
+
+/* Polynomial multipliers with nested products spread out, so that their factors cancel one by one */
+static void FlattenMultipliers(const std::vector<AssociativeOperand>& multipliers, bool inverse,
+                               std::vector<AssociativeOperand>* result) {
+    for (const auto& multiplier : multipliers) {
+        if (Is<Product>(multiplier.expr)) {
+            FlattenMultipliers(As<Product>(multiplier.expr)->GetOperands(), multiplier.inverse ^ inverse, result);
+        } else {
+            result->emplace_back(multiplier.expr, multiplier.inverse ^ inverse);
+        }
+    }
+}
+
+/* Takes the factors of `gcd` off the multipliers of one side of a fraction, one power of a
+ * base at a time, and appends what is left of them to `result`. Fails unless the gcd is a
+ * product of those bases up to the constant left in `rest`. */
+static bool CancelFactors(const std::vector<AssociativeOperand>& multipliers, bool inverse, const Polynomial& gcd,
+                          size_t max_terms, std::vector<AssociativeOperand>* result, Number* rest) {
+    Polynomial remainder = gcd;
+    std::vector<AssociativeOperand> left_over;
+    for (const auto& multiplier : multipliers) {
+        if (multiplier.inverse != inverse) {
+            continue;
+        }
+        ExpressionPtr base = multiplier.expr;
+        int64_t exp = 1;
+        if (Is<PowerOp>(base)) {
+            As<Constant>(As<PowerOp>(base)->GetExp())->GetNumber().ToInt64(&exp);
+            base = As<PowerOp>(base)->GetBase();
+        }
+        Polynomial factor, quotient;
+        if (!Polynomial::FromExpression(base, max_terms, &factor)) {
+            return false;
+        }
+        int64_t left = exp;
+        while (left > 0 && !remainder.IsConstant() && !factor.IsConstant() && remainder.Divide(factor, &quotient)) {
+            remainder = std::move(quotient);
+            --left;
+        }
+        if (left == exp) {
+            left_over.push_back(multiplier);
+        } else if (left > 0) {
+            left_over.emplace_back(left == 1 ? base : Make<PowerOp>(base, BuildConstant(left)), inverse);
+        }
+    }
+    if (!remainder.IsConstant() || remainder.IsZero()) {
+        return false;
+    }
+    result->insert(result->end(), left_over.begin(), left_over.end());
+    *rest = remainder.GetTerms()[0].coefficient;
+    return true;
+}
+
+ExpressionPtr CancelRationalFunction(const ExpressionPtr& expr) {
+    // Other multipliers are kept as they are
+    std::vector<AssociativeOperand> polynomials;
+    std::vector<AssociativeOperand> operands;
+    bool has_denominator = false;
+    for (const auto& multiplier : As<Product>(expr)->GetOperands()) {
+        if (multiplier.expr->IsPolynomial()) {
+            polynomials.push_back(multiplier);
+            has_denominator |= multiplier.inverse && !Is<Constant>(multiplier.expr);
+        } else {
+            operands.push_back(multiplier);
+        }
+    }
+    if (!has_denominator) {
+        return nullptr;
+    }
+
+    Polynomial parts[2], gcd;
+    size_t max_terms = std::max(kPolynomialTermBudget, expr->GetWeight());
+    if (!Polynomial::FromRationalFunction(polynomials, max_terms, &parts[0], &parts[1]) ||
+            parts[0].IsZero() || parts[1].IsZero() || !Polynomial::Gcd(parts[0], parts[1], &gcd) ||
+            gcd.IsConstant()) {
+        return nullptr;
+    }
+
+    /* Each side keeps its factors where the gcd divides out of their bases: the side over the
+     * gcd is then what is left of them over the constant left of the gcd. Otherwise that side
+     * is divided by the gcd and multiplied out. */
+    std::vector<AssociativeOperand> multipliers;
+    FlattenMultipliers(polynomials, false, &multipliers);
+    Number scale = 1;
+    for (bool inverse : {false, true}) {
+        Polynomial& part = parts[inverse];
+        Number rest;
+        if (CancelFactors(multipliers, inverse, gcd, max_terms, &operands, &rest)) {
+            scale = inverse ? scale * rest : scale / rest;
+        } else if (!part.Divide(gcd, &part)) {
+            return nullptr;
+        } else if (part.IsConstant()) {
+            const Number& value = part.GetTerms()[0].coefficient;
+            scale = inverse ? scale / value : scale * value;
+        } else {
+            operands.emplace_back(part.ToExpression(), inverse);
+        }
+    }
+    if (!calculus::IsZero(scale - 1)) {
+        operands.emplace_back(BuildConstant(scale), false);
+    }
+
+    ExpressionPtr result;
+    if (operands.empty()) {
+        result = kConstantOne;
+    } else if (operands.size() == 1 && !operands[0].inverse) {
+        result = operands[0].expr;
+    } else {
+        result = Make<Product>(std::move(operands));
+    }
+    // Multiplying out does not always pay off
+    return result->GetWeight() <= expr->GetWeight() ? result : nullptr;
+}
+
+/* One summand of a rational function: sign * multipliers / prod(bases[i] ^ exps[i]) */
+struct RationalSummand {
+    bool negative = false;
+    std::vector<AssociativeOperand> multipliers;
+    std::vector<std::pair<ExpressionPtr, int64_t>> denominator;
+};
+
+/* Splits a summand into its polynomial numerator and the powers of polynomial bases it is
+ * divided by, false if it is no such fraction */
+static bool SplitRationalSummand(const AssociativeOperand& summand, RationalSummand* result) {
+    ExpressionPtr expr = summand.expr;
+    result->negative = summand.inverse;
+    if (Is<NegateOp>(expr)) {
+        result->negative ^= true;
+        expr = As<NegateOp>(expr)->GetInnerExpr();
+    }
+    if (expr->IsPolynomial()) {
+        result->multipliers.emplace_back(expr, false);
+        return true;
+    }
+    if (!Is<Product>(expr)) {
+        return false;
+    }
+    std::vector<AssociativeOperand> multipliers;
+    FlattenMultipliers(As<Product>(expr)->GetOperands(), false, &multipliers);
+    for (const auto& multiplier : multipliers) {
+        if (!multiplier.expr->IsPolynomial()) {
+            return false;
+        }
+        if (!multiplier.inverse || Is<Constant>(multiplier.expr)) {
+            result->multipliers.push_back(multiplier);
+            continue;
+        }
+        ExpressionPtr base = multiplier.expr;
+        int64_t exp = 1;
+        if (Is<PowerOp>(base)) {
+            if (!As<Constant>(As<PowerOp>(base)->GetExp())->GetNumber().ToInt64(&exp) || exp <= 0) {
+                return false;
+            }
+            base = As<PowerOp>(base)->GetBase();
+        }
+        result->denominator.emplace_back(base, exp);
+    }
+    return true;
+}
+
+ExpressionPtr CombineRationalFunctions(const ExpressionPtr& expr) {
+    const auto& summands = As<Sum>(expr)->GetOperands();
+    if (summands.size() < 2) {
+        return nullptr;
+    }
+    std::vector<RationalSummand> parts(summands.size());
+    bool has_denominator = false;
+    for (size_t i = 0; i < summands.size(); ++i) {
+        if (!SplitRationalSummand(summands[i], &parts[i])) {
+            return nullptr;
+        }
+        has_denominator |= !parts[i].denominator.empty();
+    }
+    if (!has_denominator) {
+        return nullptr;
+    }
+
+    /* The common denominator keeps every base at the highest power any summand divides by,
+     * so it stays factored as the summands have it */
+    std::vector<std::pair<ExpressionPtr, int64_t>> denominator;
+    for (const auto& part : parts) {
+        for (const auto& [base, exp] : part.denominator) {
+            auto iter = std::find_if(denominator.begin(), denominator.end(), [&base](const auto& factor) {
+                return factor.first->DeepCompare(base);
+            });
+            if (iter == denominator.end()) {
+                denominator.emplace_back(base, exp);
+            } else {
+                iter->second = std::max(iter->second, exp);
+            }
+        }
+    }
+
+    // Each numerator is multiplied by the factors of the common denominator its summand lacks
+    size_t max_terms = std::max(kPolynomialTermBudget, expr->GetWeight());
+    Polynomial numerator;
+    for (auto& part : parts) {
+        for (const auto& [base, max_exp] : denominator) {
+            int64_t exp = max_exp;
+            for (const auto& factor : part.denominator) {
+                if (factor.first->DeepCompare(base)) {
+                    exp -= factor.second;
+                }
+            }
+            if (exp > 0) {
+                part.multipliers.emplace_back(exp == 1 ? base : Make<PowerOp>(base, BuildConstant(exp)), false);
+            }
+        }
+        Polynomial plain, inverse;
+        if (!Polynomial::FromRationalFunction(part.multipliers, max_terms, &plain, &inverse) || inverse.IsZero()) {
+            return nullptr;
+        }
+        const Number& scale = inverse.GetTerms()[0].coefficient;
+        plain *= (part.negative ? Number(-1) : Number(1)) / scale;
+        numerator += plain;
+        if (numerator.GetTerms().size() > max_terms) {
+            return nullptr;
+        }
+    }
+
+    ExpressionPtr result;
+    if (numerator.IsZero()) {
+        result = kConstantZero;
+    } else {
+        std::vector<AssociativeOperand> multipliers;
+        multipliers.emplace_back(numerator.ToExpression(), false);
+        for (const auto& [base, exp] : denominator) {
+            multipliers.emplace_back(exp == 1 ? base : Make<PowerOp>(base, BuildConstant(exp)), true);
+        }
+        result = Make<Product>(std::move(multipliers));
+        if (auto cancelled = CancelRationalFunction(result)) {
+            result = cancelled;
+        }
+    }
+    // Only when it makes the sum lighter, so that sums of unrelated fractions stay apart
+    return result->GetWeight() < expr->GetWeight() ? result : nullptr;
+}
+
+}  /* namespace calculus */
@@ -7,12 +7,17 @@
 
 namespace calculus {
 
-
-ExpressionPtr PowerOp::Simplify() {
+ExpressionPtr PowerOp::DoSimplify() {
+    if (IsPolynomial()) {
+        if (auto expanded = SimplifyPolynomial(shared_from_this())) {
+            return expanded;
+        }
+    }
     if (Is<Constant>(base_)) {
-        double base = As<Constant>(base_)->GetValue();
+        const Number& base = As<Constant>(base_)->GetNumber();
         if (IsZero(base)) {
-            return kConstantZero;
+            // 0 ^ 0 is 1, as in pow() and in the polynomial kernel
+            return IsConstantEqual(exp_->Simplify(), 0) ? kConstantOne : kConstantZero;
         }
         if (IsZero(base - 1)) {
             return kConstantOne;
@@ -20,7 +25,7 @@ ExpressionPtr PowerOp::Simplify() {
     }
 
     if (Is<Constant>(exp_)) {
-        double exp = As<Constant>(exp_)->GetValue();
+        const Number& exp = As<Constant>(exp_)->GetNumber();
         if (IsZero(exp)) {
             return kConstantOne;
         }
@@ -28,52 +33,101 @@ ExpressionPtr PowerOp::Simplify() {
             return base_;
         }
         if (Is<Constant>(base_)) {
-            return BuildConstant(std::pow(As<Constant>(base_)->GetValue(), exp));
+            return BuildConstant(As<Constant>(base_)->GetNumber().Pow(exp));
         }
     }
     if (Is<PowerOp>(base_)) {
-        auto new_exp = std::make_shared<Product>();
+        auto new_exp = Allocate<Product>();
         *new_exp *= exp_;
         *new_exp *= As<PowerOp>(base_)->exp_;
-        return std::make_shared<PowerOp>(As<PowerOp>(base_)->base_->Simplify(), new_exp->Simplify())->Simplify();
+        return Make<PowerOp>(As<PowerOp>(base_)->base_->Simplify(), new_exp->Simplify())->Simplify();
     }
     if (Is<Product>(base_)) {
         auto multipliers_copy = As<Product>(base_)->GetOperands();
         for (auto& multiplier : multipliers_copy) {
-            multiplier.expr = std::make_shared<PowerOp>(multiplier.expr, exp_);
+            multiplier.expr = Make<PowerOp>(multiplier.expr, exp_);
         }
-        return std::make_shared<Product>(std::move(multipliers_copy))->Simplify();
+        return Make<Product>(std::move(multipliers_copy))->Simplify();
     }
-    return std::make_shared<PowerOp>(base_->Simplify(), exp_->Simplify());
+    return Make<PowerOp>(base_->Simplify(), exp_->Simplify());
 }
 
-ExpressionPtr PowerOp::TakeDerivative(char var_name) {
-    auto prod1 = std::make_shared<Product>();
-    auto sum = std::make_shared<Sum>();
-    auto prod2 = std::make_shared<Product>();
-    auto prod3 = std::make_shared<Product>();
+ExpressionPtr PowerOp::DoTakeDerivative(char var_name) {
+    auto base_derivative = base_->TakeDerivative(var_name)->Simplify();
+    auto exp_derivative = exp_->TakeDerivative(var_name)->Simplify();
+    bool constant_base = IsConstantEqual(base_derivative, 0);
+    bool constant_exp = IsConstantEqual(exp_derivative, 0);
+    if ((constant_base && constant_exp) || (constant_exp && IsConstantEqual(exp_, 0))) {
+        return kConstantZero;
+    }
 
-    *prod2 *= exp_->TakeDerivative(var_name);
-    *prod2 *= std::make_shared<CallOp>(std::make_shared<Function>("log"), std::vector<ExpressionPtr>{base_});
+    auto result = Allocate<Product>();
+    if (constant_exp) {
+        // (b ^ e)' = e * b ^ (e - 1) * b'
+        ExpressionPtr exp_minus_one;
+        if (Is<Constant>(exp_)) {
+            exp_minus_one = BuildConstant(As<Constant>(exp_)->GetNumber() - 1);
+        } else {
+            auto sum = Allocate<Sum>();
+            *sum += exp_;
+            *sum -= kConstantOne;
+            exp_minus_one = sum;
+        }
+        *result *= exp_;
+        if (IsConstantEqual(exp_minus_one, 1)) {
+            *result *= base_;
+        } else if (!IsConstantEqual(exp_minus_one, 0)) {
+            *result *= Make<PowerOp>(base_, exp_minus_one);
+        }
+        if (!IsConstantEqual(base_derivative, 1)) {
+            *result *= base_derivative;
+        }
+        return result;
+    }
+
+    ExpressionPtr log;
+    if (Is<Constant>(base_) && As<Constant>(base_)->GetNumber().Sign() > 0) {
+        log = BuildConstant(std::log(As<Constant>(base_)->GetValue()));
+    } else {
+        log = Make<CallOp>(Make<Function>("log"), std::vector<ExpressionPtr>{base_});
+    }
+
+    if (constant_base) {
+        // (b ^ e)' = e' * log(b) * b ^ e
+        if (!IsConstantEqual(exp_derivative, 1)) {
+            *result *= exp_derivative;
+        }
+        *result *= log;
+        *result *= shared_from_this();
+        return result;
+    }
+
+    // (b ^ e)' = (e' * log(b) + e * b' / b) * b ^ e
+    auto sum = Allocate<Sum>();
+    auto prod2 = Allocate<Product>();
+    auto prod3 = Allocate<Product>();
+
+    *prod2 *= exp_derivative;
+    *prod2 *= log;
 
     *prod3 *= exp_;
-    *prod3 *= base_->TakeDerivative(var_name);
+    *prod3 *= base_derivative;
     *prod3 /= base_;
 
     *sum += prod2;
     *sum += prod3;
 
-    *prod1 *= sum;
-    *prod1 *= shared_from_this();
-    return prod1;
+    *result *= sum;
+    *result *= shared_from_this();
+    return result;
 }
 
 ExpressionPtr PowerOp::Call(const std::vector<ExpressionPtr>& args) {
-    return std::make_shared<PowerOp>(base_->Call(args), exp_->Call(args));
+    return Make<PowerOp>(base_->Call(args), exp_->Call(args));
 }
 
-ExpressionPtr PowerOp::Substitute(char var_name, const ExpressionPtr& value) {
-    return std::make_shared<PowerOp>(base_->Substitute(var_name, value), exp_->Substitute(var_name, value));
+ExpressionPtr PowerOp::DoSubstitute(const Bindings& bindings) {
+    return Make<PowerOp>(base_->Substitute(bindings), exp_->Substitute(bindings));
 }
 
 void PowerOp::Print(std::ostream& out, int cur_priority_level) const {
@@ -92,7 +146,7 @@ void PowerOp::TexDump(std::ostream& out, int cur_priority_level) const {
     if (cur_priority_level > kPostfixOpPriorityLevel) {
         out << "\\left(";
     }
-    if (Is<Constant>(exp_) && IsZero(As<Constant>(exp_)->GetValue() - 0.5)) {
+    if (Is<Constant>(exp_) && IsZero(As<Constant>(exp_)->GetNumber() - Number::Fraction(1, 2))) {
         out << "\\sqrt{";
         base_->TexDump(out, kSumPriorityLevel);
         out << '}';
@@ -107,6 +161,18 @@ void PowerOp::TexDump(std::ostream& out, int cur_priority_level) const {
     }
 }
 
+bool PowerOp::IsNaturalExponent(const ExpressionPtr& exp) {
+    if (!Is<Constant>(exp)) {
+        return false;
+    }
+    const Number& value = As<Constant>(exp)->GetNumber();
+    return value.IsInteger() && value.Sign() >= 0;
+}
+
+size_t PowerOp::ComputeHash() const {
+    return HashCombine(HashCombine(HashSeed(kKind), base_->GetHash()), exp_->GetHash());
+}
+
 bool PowerOp::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     return base_->DeepCompare(ptr->base_) && exp_->DeepCompare(ptr->exp_);
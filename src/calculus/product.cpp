@@ -4,9 +4,19 @@
 #include <sum.h>
 #include "calculus_internal.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 namespace calculus {
 
-ExpressionPtr Product::Simplify() {
+ExpressionPtr Product::DoSimplify() {
+    if (IsPolynomial()) {
+        if (auto expanded = SimplifyPolynomial(shared_from_this())) {
+            return expanded;
+        }
+    } else if (auto cancelled = CancelRationalFunction(shared_from_this())) {
+        return cancelled;
+    }
     if (multipliers_.size() == 1 && !multipliers_[0].inverse) {
         return multipliers_[0].expr->Simplify();
     }
@@ -14,39 +24,45 @@ ExpressionPtr Product::Simplify() {
 
     AssociativeOpAlign<Product>(multipliers_, false, &multipliers_copy);
 
-    bool need_to_be_negated = false;
+    /* Sign flips are collected per operand, so that the operands can be simplified in parallel */
+    std::vector<char> negated(multipliers_copy.size(), false);
 
-    for (size_t i = 0; i < multipliers_copy.size(); ++i) {
+    ForEachOperand(multipliers_copy.size(), weight_, [&multipliers_copy, &negated](size_t i) {
         multipliers_copy[i].expr = multipliers_copy[i].expr->Simplify();
         if (Is<NegateOp>(multipliers_copy[i].expr)) {
-            need_to_be_negated ^= true;
+            negated[i] ^= true;
             multipliers_copy[i].expr = As<NegateOp>(multipliers_copy[i].expr)->GetInnerExpr();
         }
         if (Is<PowerOp>(multipliers_copy[i].expr)) {
             auto expr = As<PowerOp>(multipliers_copy[i].expr);
             if (Is<Constant>(expr->GetExp())) {
-                if (As<Constant>(expr->GetExp())->GetValue() + kDoubleTolerance >= 0) {
-                    continue;
+                if (As<Constant>(expr->GetExp())->GetNumber().Sign() >= 0) {
+                    return;
                 }
             } else if (!multipliers_copy[i].inverse) {
-                continue;
+                return;
             }
             multipliers_copy[i].inverse ^= true;
-            multipliers_copy[i].expr = std::make_shared<PowerOp>(expr->GetBase(), std::make_shared<NegateOp>(expr->GetExp()));
+            multipliers_copy[i].expr = Make<PowerOp>(expr->GetBase(), Make<NegateOp>(expr->GetExp()));
         }
-        if (Is<Constant>(multipliers_copy[i].expr) && As<Constant>(multipliers_copy[i].expr)->GetValue() + kDoubleTolerance < 0) {
-            need_to_be_negated ^= true;
-            multipliers_copy[i].expr = BuildConstant(-As<Constant>(multipliers_copy[i].expr)->GetValue());
+        if (Is<Constant>(multipliers_copy[i].expr) && As<Constant>(multipliers_copy[i].expr)->GetNumber().Sign() < 0) {
+            negated[i] ^= true;
+            multipliers_copy[i].expr = BuildConstant(-As<Constant>(multipliers_copy[i].expr)->GetNumber());
         }
+    });
+
+    bool need_to_be_negated = false;
+    for (char flag : negated) {
+        need_to_be_negated ^= flag != 0;
     }
 
     // Constant folding
     int last_nonconstant = 0;
     MoveConstantsToEnd(&multipliers_copy, &last_nonconstant);
 
-    double value = 1;
+    Number value = 1;
     for (size_t i = last_nonconstant + 1; i < multipliers_copy.size(); ++i) {
-        double multiplier = As<Constant>(multipliers_copy[i].expr)->GetValue();
+        const Number& multiplier = As<Constant>(multipliers_copy[i].expr)->GetNumber();
         if (multipliers_copy[i].inverse) {
             if (IsZero(multiplier)) {
                 throw RuntimeError("Division by zero");
@@ -65,103 +81,214 @@ ExpressionPtr Product::Simplify() {
         return BuildConstant(need_to_be_negated ? -value : value);
     }
 
+    ExpressionPtr constant;
     if (IsZero(value - 1) || IsZero(value + 1)) {
-        multipliers_copy.resize(last_nonconstant + 1);
         need_to_be_negated ^= IsZero(value + 1);
     } else {
-        multipliers_copy.resize(last_nonconstant + 2);
-        multipliers_copy.back().expr = BuildConstant(value);
-        multipliers_copy.back().inverse = false;
+        constant = BuildConstant(value);
     }
-
-    // Power folding
-
+    multipliers_copy.resize(last_nonconstant + 1);
+
+    // Power folding: the exponents are collected per base with one hash lookup per factor
+    struct Power {
+        ExpressionPtr base;
+        std::vector<AssociativeOperand> exps;
+        size_t first;
+    };
+    std::vector<Power> powers;
+    std::unordered_map<ExpressionPtr, size_t, ExpressionHash, ExpressionEqual> positions;
     for (size_t i = 0; i < multipliers_copy.size(); ++i) {
-        if (Is<Constant>(multipliers_copy[i].expr)) {
-            continue;
+        ExpressionPtr base = multipliers_copy[i].expr;
+        ExpressionPtr exp = kConstantOne;
+        if (Is<PowerOp>(base)) {
+            exp = As<PowerOp>(base)->GetExp();
+            base = As<PowerOp>(base)->GetBase();
         }
-
-        auto total_power = std::make_shared<Sum>();
-
-        auto simple = multipliers_copy[i].expr;
-        if (Is<PowerOp>(simple)) {
-            auto exp = As<PowerOp>(simple)->GetExp();
-            simple = As<PowerOp>(simple)->GetBase();
-            *total_power += exp;
-        } else {
-            *total_power += kConstantOne;
+        auto iter = positions.emplace(base, powers.size()).first;
+        if (iter->second == powers.size()) {
+            powers.push_back({base, {}, i});
         }
+        powers[iter->second].exps.emplace_back(exp, multipliers_copy[i].inverse);
+    }
 
-        bool found_similars = false;
-        for (size_t j = i + 1; j < multipliers_copy.size(); ++j) {
-            if (Is<Constant>(multipliers_copy[j].expr)) {
+    /* Distinct sums may still be proportional, e.g. 2 * x + 2 and x + 1. There are few of
+     * them, so they are compared pairwise: b ^ e = r ^ e * a ^ e for b = r * a. */
+    std::vector<AssociativeOperand> result;
+    std::vector<size_t> sums;
+    for (size_t i = 0; i < powers.size(); ++i) {
+        if (Is<Sum>(powers[i].base)) {
+            sums.push_back(i);
+        }
+    }
+    for (size_t i = 0; i < sums.size(); ++i) {
+        auto& power = powers[sums[i]];
+        for (size_t j = i + 1; j < sums.size() && !power.exps.empty(); ++j) {
+            auto& other = powers[sums[j]];
+            if (other.exps.empty()) {
                 continue;
             }
-            bool not_equal_inverse = multipliers_copy[i].inverse != multipliers_copy[j].inverse;
-
-            auto other_simple = multipliers_copy[j].expr;
-            ExpressionPtr other_exp = kConstantOne;
-            if (Is<PowerOp>(other_simple)) {
-                other_exp = As<PowerOp>(other_simple)->GetExp();
-                other_simple = As<PowerOp>(other_simple)->GetBase();
-            }
-
-            double ratio = Ratio(other_simple, simple);
-            if (std::isnan(ratio)) {
+            Number ratio;
+            if (!Ratio(other.base, power.base, &ratio)) {
                 continue;
             }
-            found_similars = true;
-
-            if (not_equal_inverse) {
-                *total_power -= other_exp;
-            } else {
-                *total_power += other_exp;
+            for (const auto& exp : other.exps) {
+                result.emplace_back(Make<PowerOp>(BuildConstant(ratio), exp.expr), exp.inverse);
+                power.exps.push_back(exp);
             }
+            other.exps.clear();
+        }
+    }
 
-            multipliers_copy[j].expr = std::make_shared<PowerOp>(BuildConstant(ratio), other_exp);
+    for (auto& power : powers) {
+        if (power.exps.empty()) {
+            continue;
+        }
+        if (power.exps.size() == 1) {
+            result.push_back(multipliers_copy[power.first]);
+            continue;
+        }
 
-/*            if (multipliers_copy[i].inverse != multipliers_copy[j].inverse) {
-                double ratio = Ratio(multipliers_copy[i].expr, multipliers_copy[j].expr);
-                if (!std::isnan(ratio)) {
-                    multipliers_copy[i].expr = BuildConstant(ratio);
-                    multipliers_copy[j].expr = kConstantOne;
-                    break;
+        bool constant_exp = std::all_of(power.exps.begin(), power.exps.end(), [](const AssociativeOperand& exp) {
+            return Is<Constant>(exp.expr);
+        });
+        if (constant_exp) {
+            Number total = 0;
+            for (const auto& exp : power.exps) {
+                const Number& term = As<Constant>(exp.expr)->GetNumber();
+                if (exp.inverse) {
+                    total -= term;
+                } else {
+                    total += term;
                 }
-            }*/
+            }
+            // Constant exponents are kept positive, with the sign in the inverse flag
+            if (IsZero(total)) {
+                continue;
+            }
+            ExpressionPtr base_power = IsZero(total.Abs() - 1) ? power.base
+                : Make<PowerOp>(power.base, BuildConstant(total.Abs()));
+            result.emplace_back(base_power, total.Sign() < 0);
+            continue;
         }
 
-        if (found_similars) {
-            multipliers_copy[i].expr = std::make_shared<PowerOp>(simple, total_power);
+        auto exp = Make<Sum>(std::move(power.exps))->Simplify();
+        if (IsConstantEqual(exp, 0)) {
+            continue;
         }
+        result.emplace_back(IsConstantEqual(exp, 1) ? power.base : Make<PowerOp>(power.base, exp), false);
+    }
+
+    if (result.empty() || (result.size() == 1 && !result[0].inverse && constant == nullptr)) {
+        ExpressionPtr single = result.empty() ? (constant != nullptr ? constant : kConstantOne) : result[0].expr;
+        return need_to_be_negated ? Make<NegateOp>(single)->Simplify() : single;
+    }
+    if (constant != nullptr) {
+        result.emplace_back(constant, false);
     }
 
-    auto result = std::make_shared<Product>(std::move(multipliers_copy));
+    std::sort(result.begin(), result.end(), CanonicalOperandLess);
+    auto product = Make<Product>(std::move(result));
     if (need_to_be_negated) {
-        return std::make_shared<NegateOp>(result);
+        return Make<NegateOp>(product);
     }
-    return result;
+    return product;
 }
 
-ExpressionPtr Product::TakeDerivative(char var_name) {
-    auto result = std::make_shared<Sum>();
-    result->ReserveSize(multipliers_.size());
+/* The product of factors[begin, end) and its derivative. A product of two halves A and B
+ * has the derivative A' * B + A * B', so the product of every half is built once and used in
+ * both summands of its parent. Every factor then appears once per level of halving, and the
+ * tree takes O(n log n) nodes for n factors, also after Simplify() flattens its products.
+ * Up to kMaxFlatProductRuleFactors factors take the flat sum of f_1 ... f_i' ... f_k. */
+static void DeriveFactors(const std::vector<AssociativeOperand>& factors, const std::vector<ExpressionPtr>& derivatives,
+                          size_t begin, size_t end, ExpressionPtr* product, ExpressionPtr* derivative) {
+    if (end - begin <= kMaxFlatProductRuleFactors) {
+        auto range = Allocate<Product>();
+        range->ReserveSize(end - begin);
+        auto sum = Allocate<Sum>();
+        sum->ReserveSize(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            if (factors[i].inverse) {
+                *range /= factors[i].expr;
+            } else {
+                *range *= factors[i].expr;
+            }
 
-    for (size_t i = 0; i < multipliers_.size(); ++i) {
-        auto multipliers_copy = multipliers_;
-        multipliers_copy[i].expr = multipliers_copy[i].expr->TakeDerivative(var_name);
-        multipliers_copy[i].inverse = false;
-
-        auto summand = std::make_shared<Product>(std::move(multipliers_copy));
-        if (multipliers_[i].inverse) {
-            *summand /= multipliers_[i].expr;
-            *summand /= multipliers_[i].expr;
-            *result -= summand;
+            auto summand = Allocate<Product>();
+            summand->ReserveSize(end - begin + 1);
+            for (size_t j = begin; j < end; ++j) {
+                if (j == i) {
+                    *summand *= derivatives[i];
+                } else if (factors[j].inverse) {
+                    *summand /= factors[j].expr;
+                } else {
+                    *summand *= factors[j].expr;
+                }
+            }
+            // (1 / g)' = -g' / g ^ 2
+            if (factors[i].inverse) {
+                *summand /= Make<PowerOp>(factors[i].expr, SmallIntegerConstant(2));
+                *sum -= summand;
+            } else {
+                *sum += summand;
+            }
+        }
+        *product = range;
+        *derivative = sum;
+        return;
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    ExpressionPtr l_product, l_derivative, r_product, r_derivative;
+    DeriveFactors(factors, derivatives, begin, middle, &l_product, &l_derivative);
+    DeriveFactors(factors, derivatives, middle, end, &r_product, &r_derivative);
+
+    auto both = Allocate<Product>();
+    both->ReserveSize(2);
+    *both *= l_product;
+    *both *= r_product;
+    *product = both;
+
+    auto l_summand = Allocate<Product>();
+    l_summand->ReserveSize(2);
+    *l_summand *= l_derivative;
+    *l_summand *= r_product;
+    auto r_summand = Allocate<Product>();
+    r_summand->ReserveSize(2);
+    *r_summand *= l_product;
+    *r_summand *= r_derivative;
+    auto sum = Allocate<Sum>();
+    sum->ReserveSize(2);
+    *sum += l_summand;
+    *sum += r_summand;
+    *derivative = sum;
+}
+
+ExpressionPtr Product::DoTakeDerivative(char var_name) {
+    // Factors with a vanishing derivative are kept out of the product rule
+    std::vector<AssociativeOperand> constants;
+    size_t sum_position = 0;
+    std::vector<AssociativeOperand> factors;
+    std::vector<ExpressionPtr> derivatives;
+    for (const auto& multiplier : multipliers_) {
+        auto derivative = multiplier.expr->TakeDerivative(var_name)->Simplify();
+        if (IsConstantEqual(derivative, 0)) {
+            constants.push_back(multiplier);
         } else {
-            *result += summand;
+            if (factors.empty()) {
+                sum_position = constants.size();
+            }
+            factors.push_back(multiplier);
+            derivatives.push_back(std::move(derivative));
         }
     }
+    if (factors.empty()) {
+        return kConstantZero;
+    }
 
-    return result->Simplify();
+    ExpressionPtr product, derivative;
+    DeriveFactors(factors, derivatives, 0, factors.size(), &product, &derivative);
+    constants.emplace(constants.begin() + sum_position, std::move(derivative), false);
+    return Allocate<Product>(std::move(constants))->Simplify();
 }
 
 ExpressionPtr Product::Call(const std::vector<ExpressionPtr>& args) {
@@ -171,17 +298,17 @@ ExpressionPtr Product::Call(const std::vector<ExpressionPtr>& args) {
         multipliers.emplace_back(multiplier.expr->Call(args), multiplier.inverse);
     }
 
-    return std::make_shared<Product>(std::move(multipliers))->Simplify();
+    return Make<Product>(std::move(multipliers))->Simplify();
 }
 
-ExpressionPtr Product::Substitute(char var_name, const ExpressionPtr& expr) {
+ExpressionPtr Product::DoSubstitute(const Bindings& bindings) {
     decltype(multipliers_) multipliers;
     multipliers.reserve(multipliers_.size());
     for (const auto& multiplier : multipliers_) {
-        multipliers.emplace_back(multiplier.expr->Substitute(var_name, expr), multiplier.inverse);
+        multipliers.emplace_back(multiplier.expr->Substitute(bindings), multiplier.inverse);
     }
 
-    return std::make_shared<Product>(std::move(multipliers))->Simplify();
+    return Make<Product>(std::move(multipliers));
 }
 
 void Product::Print(std::ostream& out, int cur_priority_level) const {
@@ -193,7 +320,8 @@ void Product::Print(std::ostream& out, int cur_priority_level) const {
 
     if (multipliers_[0].inverse) {
         if (Is<Constant>(multipliers_.back().expr) && !multipliers_.back().inverse) {
-            out << As<Constant>(multipliers_.back().expr)->GetValue() << " / ";
+            multipliers_.back().expr->Print(out, kProdPriorityLevel);
+            out << " / ";
             skip_last = true;
         } else {
             out << "1 / ";
@@ -202,8 +330,17 @@ void Product::Print(std::ostream& out, int cur_priority_level) const {
     multipliers_[0].expr->Print(out, kProdPriorityLevel + (multipliers_[0].inverse ? 1 : 0));
 
     for (size_t i = 1, n = multipliers_.size() - (skip_last ? 1 : 0); i < n; ++i) {
-        out << (multipliers_[i].inverse ? " / " : " * ");
-        multipliers_[i].expr->Print(out, kProdPriorityLevel + (multipliers_[i].inverse ? 1 : 0));
+        const auto& multiplier = multipliers_[i];
+        // x * 1 / 6 reads better as x / 6
+        if (Is<Constant>(multiplier.expr) && !multiplier.inverse) {
+            const Number& value = As<Constant>(multiplier.expr)->GetNumber();
+            if (value.IsPrintedAsFraction() && value.GetNumerator() == BigInt(1)) {
+                out << " / " << value.GetDenominator().ToString();
+                continue;
+            }
+        }
+        out << (multiplier.inverse ? " / " : " * ");
+        multiplier.expr->Print(out, kProdPriorityLevel + (multiplier.inverse ? 1 : 0));
     }
     if (cur_priority_level > kProdPriorityLevel) {
         out << ')';
@@ -257,6 +394,14 @@ void Product::TexDump(std::ostream& out, int cur_priority_level) const {
     }
 }
 
+size_t Product::ComputeHash() const {
+    size_t hash = HashSeed(kKind);
+    for (const auto& multiplier : multipliers_) {
+        hash = HashCombine(hash, HashOperand(multiplier));
+    }
+    return hash;
+}
+
 bool Product::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     if (multipliers_.size() != ptr->multipliers_.size()) {
@@ -273,11 +418,18 @@ bool Product::DeepCompare(const ExpressionPtr& other) const {
 
 Product& Product::operator*=(const ExpressionPtr& expr) {
     multipliers_.emplace_back(expr, false);
+    hash_ = HashCombine(hash_, HashOperand(multipliers_.back()));
+    AddChild(expr);
     return *this;
 }
 
 Product& Product::operator/=(const ExpressionPtr& expr) {
     multipliers_.emplace_back(expr, true);
+    hash_ = HashCombine(hash_, HashOperand(multipliers_.back()));
+    AddChild(expr);
+    if (!Is<Constant>(expr)) {
+        free_variables_ |= kNonPolynomialMask;
+    }
     return *this;
 }
 
@@ -0,0 +1,417 @@
+#pragma once
+
+/* Vector kernels written once against an instruction set wrapper `S` and instantiated by the
+ * per-ISA translation units, which are compiled with their own -m flags. Everything here has
+ * internal linkage and avoids standard library templates, so no code built for a wider
+ * instruction set can be picked by the linker for the rest of the library.
+ *
+ * `S` provides Vec, Int (64-bit lanes), Mask, kWidth and the operations used below.
+ * Transcendental kernels are fdlibm's polynomials evaluated across lanes; lanes outside the
+ * range a kernel handles are recomputed with the scalar libm function. */
+
+#include "batch_kernels.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+namespace calculus {
+namespace {
+
+/* Adding 1.5 * 2^52 to an integral double puts the integer into the low mantissa bits */
+constexpr double kRoundMagic = 6755399441055744.0;
+constexpr uint64_t kSignMask = 0x8000000000000000ULL;
+constexpr uint64_t kMantissaMask = 0x000FFFFFFFFFFFFFULL;
+constexpr uint64_t kExponentOne = 0x3FF0000000000000ULL;
+constexpr uint64_t kExponentBias = 1023;
+
+constexpr double kLn2Hi = 6.93147180369123816490e-01;
+constexpr double kLn2Lo = 1.90821492927058770002e-10;
+constexpr double kInvLn2 = 1.44269504088896338700e+00;
+constexpr double kSqrt2 = 1.41421356237309504880e+00;
+constexpr double kTwoPow52 = 4503599627370496.0;
+
+constexpr double kExpLimit = 708.0;
+/* log(x) comes with an absolute error near 1e-17, which pow() multiplies by the exponent */
+constexpr double kPowExponentLimit = 16.0;
+constexpr double kExpP1 = 1.66666666666666019037e-01;
+constexpr double kExpP2 = -2.77777777770155933842e-03;
+constexpr double kExpP3 = 6.61375632143793436117e-05;
+constexpr double kExpP4 = -1.65339022054652515390e-06;
+constexpr double kExpP5 = 4.13813679705723846039e-08;
+
+constexpr double kLogLg1 = 6.666666666666735130e-01;
+constexpr double kLogLg2 = 3.999999999940941908e-01;
+constexpr double kLogLg3 = 2.857142874366239149e-01;
+constexpr double kLogLg4 = 2.222219843214978396e-01;
+constexpr double kLogLg5 = 1.818357216161805012e-01;
+constexpr double kLogLg6 = 1.531383769920937332e-01;
+constexpr double kLogLg7 = 1.479819860511658591e-01;
+
+/* pi/2 = kPio2Part1 + kPio2Part2 + kPio2Part3 to about 2^-120: the first two parts hold 33
+ * bits each, so x - n * kPio2Part1 - n * kPio2Part2 is exact for |n| < 2^20, the last one is
+ * the rest of pi/2 rounded to a full double. Above kTrigLimit the truncation error, which
+ * grows with n, would no longer stay negligible next to the smallest reduced arguments. */
+constexpr double kTrigLimit = 1e5;
+constexpr double kTwoOverPi = 6.36619772367581382433e-01;
+constexpr double kPio2Part1 = 1.57079632673412561417e+00;
+constexpr double kPio2Part2 = 6.07710050630396597660e-11;
+constexpr double kPio2Part3 = 2.02226624879595063154e-21;
+
+constexpr double kSinS1 = -1.66666666666666324348e-01;
+constexpr double kSinS2 = 8.33333333332248946124e-03;
+constexpr double kSinS3 = -1.98412698298579493134e-04;
+constexpr double kSinS4 = 2.75573137070700676789e-06;
+constexpr double kSinS5 = -2.50507602534068634195e-08;
+constexpr double kSinS6 = 1.58969099521155010221e-10;
+
+constexpr double kCosC1 = 4.16666666666666019037e-02;
+constexpr double kCosC2 = -1.38888888888741095749e-03;
+constexpr double kCosC3 = 2.48015872894767294178e-05;
+constexpr double kCosC4 = -2.75573143513906633035e-07;
+constexpr double kCosC5 = 2.08757232129817482790e-09;
+constexpr double kCosC6 = -1.13596475577881948265e-11;
+
+template <class S>
+typename S::Vec Abs(typename S::Vec x) {
+    return S::ToVec(S::And(S::ToInt(x), S::SetInt(~kSignMask)));
+}
+
+/* Requires |x| <= kExpLimit, so that 2^k stays a normal number */
+template <class S>
+typename S::Vec ExpKernel(typename S::Vec x) {
+    using V = typename S::Vec;
+    V k = S::Round(S::Mul(x, S::Set(kInvLn2)));
+    V hi = S::Fma(k, S::Set(-kLn2Hi), x);
+    V lo = S::Mul(k, S::Set(kLn2Lo));
+    V r = S::Sub(hi, lo);
+    V t = S::Mul(r, r);
+    V p = S::Fma(t, S::Set(kExpP5), S::Set(kExpP4));
+    p = S::Fma(t, p, S::Set(kExpP3));
+    p = S::Fma(t, p, S::Set(kExpP2));
+    p = S::Fma(t, p, S::Set(kExpP1));
+    V c = S::Sub(r, S::Mul(t, p));
+    V y = S::Sub(S::Set(1), S::Sub(S::Sub(lo, S::Div(S::Mul(r, c), S::Sub(S::Set(2), c))), hi));
+
+    auto k_bits = S::ToInt(S::Add(k, S::Set(kRoundMagic)));
+    auto scale = S::template ShiftLeft<52>(S::AddInt(k_bits, S::SetInt(kExponentBias)));
+    return S::Mul(y, S::ToVec(scale));
+}
+
+/* Requires a positive normal finite x. Returns log(x) rounded and stores the part of the
+ * value below the rounding in `lo`, which pow() needs to stay accurate for large exponents. */
+template <class S>
+typename S::Vec LogKernel(typename S::Vec x, typename S::Vec* lo) {
+    using V = typename S::Vec;
+    auto bits = S::ToInt(x);
+    V m = S::ToVec(S::Or(S::And(bits, S::SetInt(kMantissaMask)), S::SetInt(kExponentOne)));
+    auto biased = S::template ShiftRight<52>(bits);
+    V k = S::Sub(S::ToVec(S::Or(biased, S::ToInt(S::Set(kTwoPow52)))), S::Set(kTwoPow52 + kExponentBias));
+
+    /* Keep the mantissa in [sqrt(2) / 2, sqrt(2)) */
+    auto big = S::Greater(m, S::Set(kSqrt2));
+    m = S::Select(big, S::Mul(m, S::Set(0.5)), m);
+    k = S::Select(big, S::Add(k, S::Set(1)), k);
+
+    V f = S::Sub(m, S::Set(1));
+    V s = S::Div(f, S::Add(S::Set(2), f));
+    V z = S::Mul(s, s);
+    V w = S::Mul(z, z);
+    V t1 = S::Fma(w, S::Set(kLogLg6), S::Set(kLogLg4));
+    t1 = S::Mul(w, S::Fma(w, t1, S::Set(kLogLg2)));
+    V t2 = S::Fma(w, S::Set(kLogLg7), S::Set(kLogLg5));
+    t2 = S::Fma(w, t2, S::Set(kLogLg3));
+    t2 = S::Mul(z, S::Fma(w, t2, S::Set(kLogLg1)));
+    V r = S::Add(t1, t2);
+    V half_f = S::Mul(S::Set(0.5), f);
+    V hfsq = S::Mul(half_f, f);
+    V hfsq_lo = S::Fma(half_f, f, S::Sub(S::Set(0), hfsq));
+
+    /* log(x) = k * ln2 + f - hfsq + s * (hfsq + r), summed so that the big terms add exactly:
+     * k * kLn2Hi is exact and f dominates hfsq */
+    V small = S::Sub(S::Fma(s, S::Add(hfsq, r), S::Mul(k, S::Set(kLn2Lo))), hfsq_lo);
+    V u = S::Sub(f, hfsq);
+    V u_err = S::Sub(S::Sub(f, u), hfsq);
+    V a = S::Mul(k, S::Set(kLn2Hi));
+    V v = S::Add(a, u);
+    V v_err = S::Add(S::Sub(a, v), u);
+    V rest = S::Add(S::Add(v_err, u_err), small);
+    V result = S::Add(v, rest);
+    *lo = S::Add(S::Sub(v, result), rest);
+    return result;
+}
+
+/* Requires |x| <= kTrigLimit. cos(x) is computed as sin(x + pi / 2) by shifting the quadrant.
+ * The reduced argument is kept as r + r_lo and both kernels take the tail into account. */
+template <class S, bool kCosine>
+typename S::Vec SinCosKernel(typename S::Vec x) {
+    using V = typename S::Vec;
+    V n = S::Round(S::Mul(x, S::Set(kTwoOverPi)));
+    V head = S::Fma(n, S::Set(-kPio2Part1), x);
+    V mid = S::Mul(n, S::Set(kPio2Part2));
+    V tail = S::Mul(n, S::Set(kPio2Part3));
+
+    /* head - mid is rounded, its rounding error joins the tail */
+    V diff = S::Sub(head, mid);
+    V diff_mid = S::Sub(diff, head);
+    V diff_err = S::Sub(S::Sub(head, S::Sub(diff, diff_mid)), S::Add(mid, diff_mid));
+    V lo = S::Sub(diff_err, tail);
+    V r = S::Add(diff, lo);
+    V r_lo = S::Add(S::Sub(diff, r), lo);
+
+    V z = S::Mul(r, r);
+    V v = S::Mul(z, r);
+    V ps = S::Fma(z, S::Set(kSinS6), S::Set(kSinS5));
+    ps = S::Fma(z, ps, S::Set(kSinS4));
+    ps = S::Fma(z, ps, S::Set(kSinS3));
+    ps = S::Fma(z, ps, S::Set(kSinS2));
+    /* r - ((z * (r_lo / 2 - v * ps) - r_lo) - v * S1) */
+    V sin_t = S::Sub(S::Mul(S::Set(0.5), r_lo), S::Mul(v, ps));
+    sin_t = S::Sub(S::Sub(S::Mul(z, sin_t), r_lo), S::Mul(v, S::Set(kSinS1)));
+    V sin_r = S::Sub(r, sin_t);
+
+    V pc = S::Fma(z, S::Set(kCosC6), S::Set(kCosC5));
+    pc = S::Fma(z, pc, S::Set(kCosC4));
+    pc = S::Fma(z, pc, S::Set(kCosC3));
+    pc = S::Fma(z, pc, S::Set(kCosC2));
+    pc = S::Mul(z, S::Fma(z, pc, S::Set(kCosC1)));
+    /* w + (((1 - w) - z / 2) + (z * pc - r * r_lo)) with w = 1 - z / 2 */
+    V hz = S::Mul(S::Set(0.5), z);
+    V w = S::Sub(S::Set(1), hz);
+    V cos_r = S::Add(S::Sub(S::Sub(S::Set(1), w), hz), S::Sub(S::Mul(z, pc), S::Mul(r, r_lo)));
+    cos_r = S::Add(w, cos_r);
+
+    auto quadrant = S::ToInt(S::Add(n, S::Set(kRoundMagic)));
+    if (kCosine) {
+        quadrant = S::AddInt(quadrant, S::SetInt(1));
+    }
+    V result = S::Select(S::LowBitMask(quadrant), cos_r, sin_r);
+    auto sign = S::template ShiftLeft<62>(S::And(quadrant, S::SetInt(2)));
+    return S::ToVec(S::Xor(S::ToInt(result), sign));
+}
+
+template <class S>
+struct ExpOp {
+    static typename S::Vec Apply(typename S::Vec x, typename S::Mask* fast) {
+        *fast = S::LessEqual(Abs<S>(x), S::Set(kExpLimit));
+        return ExpKernel<S>(x);
+    }
+
+    static double Fallback(double x) {
+        return std::exp(x);
+    }
+};
+
+template <class S>
+struct LogOp {
+    static typename S::Vec Apply(typename S::Vec x, typename S::Mask* fast) {
+        *fast = S::MaskAnd(S::GreaterEqual(x, S::Set(DBL_MIN)), S::Less(x, S::Set(HUGE_VAL)));
+        typename S::Vec lo;
+        return LogKernel<S>(x, &lo);
+    }
+
+    static double Fallback(double x) {
+        return std::log(x);
+    }
+};
+
+template <class S>
+struct SinOp {
+    static typename S::Vec Apply(typename S::Vec x, typename S::Mask* fast) {
+        *fast = S::LessEqual(Abs<S>(x), S::Set(kTrigLimit));
+        return SinCosKernel<S, false>(x);
+    }
+
+    static double Fallback(double x) {
+        return std::sin(x);
+    }
+};
+
+template <class S>
+struct CosOp {
+    static typename S::Vec Apply(typename S::Vec x, typename S::Mask* fast) {
+        *fast = S::LessEqual(Abs<S>(x), S::Set(kTrigLimit));
+        return SinCosKernel<S, true>(x);
+    }
+
+    static double Fallback(double x) {
+        return std::cos(x);
+    }
+};
+
+/* exp(y * log(x)) for positive x with the product y * log(x) carried to twice the precision,
+ * the low part entering as exp(hi + lo) = exp(hi) * (1 + lo) */
+template <class S>
+struct PowOp {
+    static typename S::Vec Apply(typename S::Vec x, typename S::Vec y, typename S::Mask* fast) {
+        typename S::Vec log_lo;
+        auto log_hi = LogKernel<S>(x, &log_lo);
+        auto hi = S::Mul(y, log_hi);
+        auto lo = S::Fma(y, log_lo, S::Fma(y, log_hi, S::Sub(S::Set(0), hi)));
+        auto base_ok = S::MaskAnd(S::GreaterEqual(x, S::Set(DBL_MIN)), S::Less(x, S::Set(HUGE_VAL)));
+        auto exp_ok = S::MaskAnd(S::LessEqual(Abs<S>(y), S::Set(kPowExponentLimit)),
+                                 S::LessEqual(Abs<S>(hi), S::Set(kExpLimit)));
+        *fast = S::MaskAnd(base_ok, exp_ok);
+        auto result = ExpKernel<S>(hi);
+        return S::Fma(result, lo, result);
+    }
+
+    static double Fallback(double x, double y) {
+        return std::pow(x, y);
+    }
+};
+
+constexpr unsigned LaneMask(size_t width) {
+    return (1u << width) - 1;
+}
+
+/* One vector of lanes through `Op`, lanes outside its range through the fallback. `dst` may
+ * alias `lhs`, so the inputs are saved before anything is written. */
+template <class S, class Op>
+void UnaryLanes(const double* lhs, double* dst) {
+    constexpr size_t kWidth = S::kWidth;
+    auto x = S::Load(lhs);
+    typename S::Mask fast;
+    auto y = Op::Apply(x, &fast);
+    unsigned slow = ~S::MaskBits(fast) & LaneMask(kWidth);
+    if (slow == 0) {
+        S::Store(dst, y);
+        return;
+    }
+    alignas(64) double xs[kWidth];
+    alignas(64) double ys[kWidth];
+    S::Store(xs, x);
+    S::Store(ys, y);
+    for (; slow != 0; slow &= slow - 1) {
+        int lane = __builtin_ctz(slow);
+        ys[lane] = Op::Fallback(xs[lane]);
+    }
+    S::Store(dst, S::Load(ys));
+}
+
+template <class S, class Op>
+void BinaryLanes(const double* lhs, const double* rhs, double* dst) {
+    constexpr size_t kWidth = S::kWidth;
+    auto x = S::Load(lhs);
+    auto y = S::Load(rhs);
+    typename S::Mask fast;
+    auto z = Op::Apply(x, y, &fast);
+    unsigned slow = ~S::MaskBits(fast) & LaneMask(kWidth);
+    if (slow == 0) {
+        S::Store(dst, z);
+        return;
+    }
+    alignas(64) double xs[kWidth];
+    alignas(64) double ys[kWidth];
+    alignas(64) double zs[kWidth];
+    S::Store(xs, x);
+    S::Store(ys, y);
+    S::Store(zs, z);
+    for (; slow != 0; slow &= slow - 1) {
+        int lane = __builtin_ctz(slow);
+        zs[lane] = Op::Fallback(xs[lane], ys[lane]);
+    }
+    S::Store(dst, S::Load(zs));
+}
+
+/* The first `count` values of `src` followed by ones up to `width` */
+void LoadPadded(const double* src, size_t count, double* dst, size_t width) {
+    for (size_t i = 0; i < width; ++i) {
+        dst[i] = i < count ? src[i] : 1.0;
+    }
+}
+
+/* The last rows short of a vector are padded with ones, which every kernel takes on its fast
+ * path, rather than left to libm: a row then gets the same value wherever it falls in a batch */
+template <class S, class Op>
+void UnaryKernel(const double* lhs, const double*, double* dst, size_t count) {
+    constexpr size_t kWidth = S::kWidth;
+    size_t i = 0;
+    for (; i + kWidth <= count; i += kWidth) {
+        UnaryLanes<S, Op>(lhs + i, dst + i);
+    }
+    if (i < count) {
+        alignas(64) double xs[kWidth];
+        LoadPadded(lhs + i, count - i, xs, kWidth);
+        UnaryLanes<S, Op>(xs, xs);
+        __builtin_memcpy(dst + i, xs, (count - i) * sizeof(double));
+    }
+}
+
+template <class S, class Op>
+void BinaryMathKernel(const double* lhs, const double* rhs, double* dst, size_t count) {
+    constexpr size_t kWidth = S::kWidth;
+    size_t i = 0;
+    for (; i + kWidth <= count; i += kWidth) {
+        BinaryLanes<S, Op>(lhs + i, rhs + i, dst + i);
+    }
+    if (i < count) {
+        alignas(64) double xs[kWidth];
+        alignas(64) double ys[kWidth];
+        LoadPadded(lhs + i, count - i, xs, kWidth);
+        LoadPadded(rhs + i, count - i, ys, kWidth);
+        BinaryLanes<S, Op>(xs, ys, xs);
+        __builtin_memcpy(dst + i, xs, (count - i) * sizeof(double));
+    }
+}
+
+#define SIMD_ARITHMETIC_KERNEL(name, vector_op, scalar_op)                                  \
+    template <class S>                                                                      \
+    void name(const double* lhs, const double* rhs, double* dst, size_t count) {           \
+        size_t i = 0;                                                                       \
+        for (; i + S::kWidth <= count; i += S::kWidth) {                                    \
+            S::Store(dst + i, S::vector_op(S::Load(lhs + i), S::Load(rhs + i)));            \
+        }                                                                                   \
+        for (; i < count; ++i) {                                                            \
+            dst[i] = lhs[i] scalar_op rhs[i];                                               \
+        }                                                                                   \
+    }
+
+SIMD_ARITHMETIC_KERNEL(AddKernel, Add, +)
+SIMD_ARITHMETIC_KERNEL(SubKernel, Sub, -)
+SIMD_ARITHMETIC_KERNEL(MulKernel, Mul, *)
+SIMD_ARITHMETIC_KERNEL(DivKernel, Div, /)
+
+#undef SIMD_ARITHMETIC_KERNEL
+
+template <class S>
+void NegKernel(const double* lhs, const double*, double* dst, size_t count) {
+    size_t i = 0;
+    for (; i + S::kWidth <= count; i += S::kWidth) {
+        S::Store(dst + i, S::ToVec(S::Xor(S::ToInt(S::Load(lhs + i)), S::SetInt(kSignMask))));
+    }
+    for (; i < count; ++i) {
+        dst[i] = -lhs[i];
+    }
+}
+
+template <class S>
+void SqrtKernel(const double* lhs, const double*, double* dst, size_t count) {
+    size_t i = 0;
+    for (; i + S::kWidth <= count; i += S::kWidth) {
+        S::Store(dst + i, S::Sqrt(S::Load(lhs + i)));
+    }
+    for (; i < count; ++i) {
+        dst[i] = std::sqrt(lhs[i]);
+    }
+}
+
+template <class S>
+BatchKernels MakeBatchKernels() {
+    BatchKernels result = {};
+    result.ops[static_cast<size_t>(OpCode::kAdd)] = AddKernel<S>;
+    result.ops[static_cast<size_t>(OpCode::kSub)] = SubKernel<S>;
+    result.ops[static_cast<size_t>(OpCode::kMul)] = MulKernel<S>;
+    result.ops[static_cast<size_t>(OpCode::kDiv)] = DivKernel<S>;
+    result.ops[static_cast<size_t>(OpCode::kNeg)] = NegKernel<S>;
+    result.ops[static_cast<size_t>(OpCode::kPow)] = BinaryMathKernel<S, PowOp<S>>;
+    result.ops[static_cast<size_t>(OpCode::kSqrt)] = SqrtKernel<S>;
+    result.ops[static_cast<size_t>(OpCode::kSin)] = UnaryKernel<S, SinOp<S>>;
+    result.ops[static_cast<size_t>(OpCode::kCos)] = UnaryKernel<S, CosOp<S>>;
+    result.ops[static_cast<size_t>(OpCode::kLog)] = UnaryKernel<S, LogOp<S>>;
+    result.ops[static_cast<size_t>(OpCode::kExp)] = UnaryKernel<S, ExpOp<S>>;
+    return result;
+}
+
+}  /* namespace */
+}  /* namespace calculus */
@@ -0,0 +1,19 @@
+#include <simplify_cache.h>
+
+namespace calculus {
+
+static thread_local SimplifyCache* current_simplify_cache = nullptr;
+
+SimplifyCacheScope::SimplifyCacheScope(SimplifyCache* cache) : previous_(current_simplify_cache) {
+    current_simplify_cache = cache;
+}
+
+SimplifyCacheScope::~SimplifyCacheScope() {
+    current_simplify_cache = previous_;
+}
+
+SimplifyCache* GetCurrentSimplifyCache() {
+    return current_simplify_cache;
+}
+
+}  /* namespace calculus */
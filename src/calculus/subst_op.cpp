@@ -3,11 +3,49 @@
 
 namespace calculus {
 
-ExpressionPtr SubstOp::Simplify() {
-    return target_->Simplify()->Substitute(var_name_, value_->Simplify());
+/* target[inner][outer] is target[inner'] where inner' binds every variable of `inner` to its
+ * value with `outer` applied, and the variables only `outer` binds to their values as they are.
+ * Outer bindings of variables that do not occur in the target are dropped. */
+static Bindings Compose(const ExpressionPtr& target, const Bindings& inner, const Bindings& outer) {
+    Bindings result;
+    for (const auto& entry : inner.GetEntries()) {
+        result.Bind(entry.var_name, entry.value->Substitute(outer));
+    }
+    uint32_t target_variables = target->GetFreeVariables();
+    for (const auto& entry : outer.GetEntries()) {
+        uint32_t mask = VariableMask(entry.var_name);
+        if ((inner.GetMask() & mask) == 0 && (target_variables & mask) != 0) {
+            result.Bind(entry.var_name, entry.value);
+        }
+    }
+    return result;
+}
+
+ExpressionPtr SubstOp::DoSimplify() {
+    // Nested substitutions are merged, so that the target is rewritten once for all of them
+    ExpressionPtr target = target_;
+    Bindings bindings = bindings_;
+    while (Is<SubstOp>(target)) {
+        auto inner = As<SubstOp>(target);
+        bindings = Compose(inner->target_, inner->bindings_, bindings);
+        target = inner->target_;
+    }
+
+    Bindings simplified;
+    for (const auto& entry : bindings.GetEntries()) {
+        simplified.Bind(entry.var_name, entry.value->Simplify());
+    }
+    target = target->Simplify();
+    auto substituted = target->Substitute(simplified);
+    if (target->IsNormalForm()) {
+        /* Substitute() kept the subtrees without bound variables, and they are still flagged
+         * as normal, so this only simplifies the nodes rebuilt on the way to the replaced leaves */
+        return substituted->Simplify();
+    }
+    return substituted;
 }
 
-ExpressionPtr SubstOp::TakeDerivative(char var_name) {
+ExpressionPtr SubstOp::DoTakeDerivative(char var_name) {
     return Simplify()->TakeDerivative(var_name);
 }
 
@@ -15,8 +53,24 @@ ExpressionPtr SubstOp::Call(const std::vector<ExpressionPtr>& args) {
     return Simplify()->Call(args);
 }
 
-ExpressionPtr SubstOp::Substitute(char var_name, const ExpressionPtr& value) {
-    return Simplify()->Substitute(var_name, value);
+ExpressionPtr SubstOp::DoSubstitute(const Bindings& bindings) {
+    return Make<SubstOp>(target_, Compose(target_, bindings_, bindings));
+}
+
+static void PrintBindings(std::ostream& out, const Bindings& bindings, bool tex) {
+    bool first = true;
+    for (const auto& entry : bindings.GetEntries()) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+        out << entry.var_name << " = ";
+        if (tex) {
+            entry.value->TexDump(out, kSumPriorityLevel);
+        } else {
+            entry.value->Print(out, kSumPriorityLevel);
+        }
+    }
 }
 
 void SubstOp::Print(std::ostream& out, int cur_priority_level) const {
@@ -24,8 +78,8 @@ void SubstOp::Print(std::ostream& out, int cur_priority_level) const {
         out << '(';
     }
     target_->Print(out, kPostfixOpPriorityLevel);
-    out << '[' << var_name_ << " = ";
-    value_->Print(out, kSumPriorityLevel);
+    out << '[';
+    PrintBindings(out, bindings_, false);
     out << ']';
     if (cur_priority_level > kPostfixOpPriorityLevel) {
         out << ')';
@@ -38,17 +92,35 @@ void SubstOp::TexDump(std::ostream& out, int cur_priority_level) const {
     }
     out << "\\left.";
     target_->TexDump(out, kPostfixOpPriorityLevel);
-    out << "\\right|_{" << var_name_ << " = ";
-    value_->TexDump(out, kSumPriorityLevel);
+    out << "\\right|_{";
+    PrintBindings(out, bindings_, true);
     out << "}";
     if (cur_priority_level > kPostfixOpPriorityLevel) {
         out << "\\right)";
     }
 }
 
+size_t SubstOp::ComputeHash() const {
+    size_t hash = HashCombine(HashSeed(kKind), target_->GetHash());
+    for (const auto& entry : bindings_.GetEntries()) {
+        hash = HashCombine(HashCombine(hash, entry.var_name), entry.value->GetHash());
+    }
+    return hash;
+}
+
 bool SubstOp::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
-    return var_name_ == ptr->var_name_ && target_->DeepCompare(ptr->target_) && value_->DeepCompare(ptr->value_);
+    const auto& entries = bindings_.GetEntries();
+    const auto& other_entries = ptr->bindings_.GetEntries();
+    if (entries.size() != other_entries.size() || !target_->DeepCompare(ptr->target_)) {
+        return false;
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].var_name != other_entries[i].var_name || !entries[i].value->DeepCompare(other_entries[i].value)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 
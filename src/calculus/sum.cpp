@@ -3,13 +3,40 @@
 #include <product.h>
 #include "calculus_internal.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 namespace calculus {
 
+/* |coefficient| * monomial, with the constant last as in a simplified product */
+static ExpressionPtr BuildTerm(const Term& term) {
+    Number coefficient = term.coefficient.Abs();
+    bool unit = IsZero(coefficient - 1);
+    if (unit && term.GetSize() == 1 && !term.IsInverse(0)) {
+        return term.GetFactor(0);
+    }
+    std::vector<AssociativeOperand> multipliers;
+    multipliers.reserve(term.GetSize() + 1);
+    for (size_t i = 0; i < term.GetSize(); ++i) {
+        multipliers.emplace_back(term.GetFactor(i), term.IsInverse(i));
+    }
+    if (!unit) {
+        multipliers.emplace_back(BuildConstant(coefficient), false);
+    }
+    return Make<Product>(std::move(multipliers));
+}
 
-ExpressionPtr Sum::Simplify() {
+ExpressionPtr Sum::DoSimplify() {
+    if (IsPolynomial()) {
+        if (auto expanded = SimplifyPolynomial(shared_from_this())) {
+            return expanded;
+        }
+    } else if (auto combined = CombineRationalFunctions(shared_from_this())) {
+        return combined;
+    }
     if (summands_.size() == 1) {
         if (summands_[0].inverse) {
-            return std::make_shared<NegateOp>(summands_[0].expr)->Simplify();
+            return Make<NegateOp>(summands_[0].expr)->Simplify();
         } else {
             return summands_[0].expr->Simplify();
         }
@@ -19,84 +46,64 @@ ExpressionPtr Sum::Simplify() {
 
     AssociativeOpAlign<Sum>(summands_, false, &summands_copy);
 
-    for (size_t i = 0; i < summands_copy.size(); ++i) {
+    ForEachOperand(summands_copy.size(), weight_, [&summands_copy](size_t i) {
         summands_copy[i].expr = summands_copy[i].expr->Simplify();
         if (Is<NegateOp>(summands_copy[i].expr)) {
             summands_copy[i].inverse ^= true;
             summands_copy[i].expr = As<NegateOp>(summands_copy[i].expr)->GetInnerExpr();
         }
-    }
-
-    // Constant folding
-    int last_nonconstant = 0;
-    MoveConstantsToEnd(&summands_copy, &last_nonconstant);
-
-    double value = 0;
-    for (size_t i = last_nonconstant + 1; i < summands_copy.size(); ++i) {
-        double summand = As<Constant>(summands_copy[i].expr)->GetValue();
-        if (summands_copy[i].inverse) {
-            value -= summand;
+    });
+
+    /* Like terms are collected by monomial with one hash lookup per summand, and the
+     * coefficients are folded in right away, constants being the empty monomial */
+    std::vector<Term> terms;
+    std::unordered_map<Term, size_t, MonomialHash, MonomialEqual> positions;
+    Number value = 0;
+    for (const auto& summand : summands_copy) {
+        Term term = SplitTerm(summand);
+        if (term.GetSize() == 0) {
+            value += term.coefficient;
+            continue;
+        }
+        auto iter = positions.emplace(term, terms.size()).first;
+        if (iter->second == terms.size()) {
+            terms.push_back(term);
         } else {
-            value += summand;
+            terms[iter->second].coefficient += term.coefficient;
         }
     }
 
-    if (!IsZero(value) || last_nonconstant < 0) {
-        summands_copy.resize(last_nonconstant + 2);
-        summands_copy.back().expr = BuildConstant(std::abs(value));
-        summands_copy.back().inverse = value < 0;
-    } else {
-        summands_copy.resize(last_nonconstant + 1);
-    }
-
-
-    if (summands_copy.size() == 1) {
-        if (summands_copy[0].inverse) {
-            return std::make_shared<NegateOp>(summands_copy[0].expr)->Simplify();
-        } else {
-            return summands_copy[0].expr->Simplify();
+    std::vector<AssociativeOperand> summands;
+    summands.reserve(terms.size() + 1);
+    for (const auto& term : terms) {
+        if (!IsZero(term.coefficient)) {
+            summands.emplace_back(BuildTerm(term), term.coefficient.Sign() < 0);
         }
     }
+    if (!IsZero(value) || summands.empty()) {
+        summands.emplace_back(BuildConstant(value.Abs()), value.Sign() < 0);
+    }
 
-    for (size_t i = 0; i < summands_copy.size(); ++i) {
-        if (Is<Constant>(summands_copy[i].expr)) {
-            continue;
-        }
-        double final_ratio = 1;
-        bool changed = false;
-        for (size_t j = i + 1; j < summands_copy.size(); ++j) {
-            if (Is<Constant>(summands_copy[j].expr)) {
-                continue;
-            }
-            double ratio = Ratio(summands_copy[j].expr, summands_copy[i].expr);
-            if (summands_copy[i].inverse ^ summands_copy[j].inverse) {
-                ratio *= -1;
-            }
-            if (!std::isnan(ratio)) {
-                summands_copy[j].expr = kConstantZero;
-                changed = true;
-                final_ratio += ratio;
-            }
-        }
-        if (changed) {
-            auto prod = std::make_shared<Product>();
-            *prod *= summands_copy[i].expr;
-            *prod *= BuildConstant(final_ratio);
-            summands_copy[i].expr = prod;
+    if (summands.size() == 1) {
+        if (summands[0].inverse) {
+            return Make<NegateOp>(summands[0].expr)->Simplify();
+        } else {
+            return summands[0].expr->Simplify();
         }
     }
 
-    return std::make_shared<Sum>(std::move(summands_copy));
+    std::sort(summands.begin(), summands.end(), CanonicalOperandLess);
+    return Make<Sum>(std::move(summands));
 }
 
-ExpressionPtr Sum::TakeDerivative(char var_name) {
+ExpressionPtr Sum::DoTakeDerivative(char var_name) {
     decltype(summands_) summands;
     summands.reserve(summands_.size());
     for (const auto& summand : summands_) {
         summands.emplace_back(summand.expr->TakeDerivative(var_name), summand.inverse);
     }
 
-    return std::make_shared<Sum>(std::move(summands))->Simplify();
+    return Make<Sum>(std::move(summands))->Simplify();
 }
 
 ExpressionPtr Sum::Call(const std::vector<ExpressionPtr>& args) {
@@ -106,17 +113,17 @@ ExpressionPtr Sum::Call(const std::vector<ExpressionPtr>& args) {
         summands.emplace_back(summand.expr->Call(args), summand.inverse);
     }
 
-    return std::make_shared<Sum>(std::move(summands));
+    return Make<Sum>(std::move(summands));
 }
 
-ExpressionPtr Sum::Substitute(char var_name, const ExpressionPtr& expr) {
+ExpressionPtr Sum::DoSubstitute(const Bindings& bindings) {
     decltype(summands_) summands;
     summands.reserve(summands_.size());
     for (const auto& summand : summands_) {
-        summands.emplace_back(summand.expr->Substitute(var_name, expr), summand.inverse);
+        summands.emplace_back(summand.expr->Substitute(bindings), summand.inverse);
     }
 
-    return std::make_shared<Sum>(std::move(summands));
+    return Make<Sum>(std::move(summands));
 }
 
 void Sum::Print(std::ostream& out, int cur_priority_level) const {
@@ -159,6 +166,14 @@ void Sum::TexDump(std::ostream& out, int cur_priority_level) const {
     }
 }
 
+size_t Sum::ComputeHash() const {
+    size_t hash = HashSeed(kKind);
+    for (const auto& summand : summands_) {
+        hash = HashCombine(hash, HashOperand(summand));
+    }
+    return hash;
+}
+
 bool Sum::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     if (summands_.size() != ptr->summands_.size()) {
@@ -174,11 +189,15 @@ bool Sum::DeepCompare(const ExpressionPtr& other) const {
 
 Sum& Sum::operator+=(const ExpressionPtr& expr) {
     summands_.emplace_back(expr, false);
+    hash_ = HashCombine(hash_, HashOperand(summands_.back()));
+    AddChild(expr);
     return *this;
 }
 
 Sum& Sum::operator-=(const ExpressionPtr& expr) {
     summands_.emplace_back(expr, true);
+    hash_ = HashCombine(hash_, HashOperand(summands_.back()));
+    AddChild(expr);
     return *this;
 }
 
@@ -0,0 +1,187 @@
+#include <thread_pool.h>
+#include <arena.h>
+#include <simplify_cache.h>
+#include <derivative_cache.h>
+
+#include <algorithm>
+#include <exception>
+
+namespace calculus {
+
+static constexpr size_t kTasksPerThread = 4;
+
+static thread_local ThreadPool* current_thread_pool = nullptr;
+static thread_local const ThreadPool* worker_pool = nullptr;
+static thread_local size_t worker_index = 0;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    /* One deque per worker plus the shared one at index `thread_count` */
+    for (size_t i = 0; i <= thread_count; ++i) {
+        queues_.emplace_back(new TaskQueue());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::GetDefaultThreadCount() {
+    size_t cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || threads_.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    size_t task_count = std::min(count, (threads_.size() + 1) * kTasksPerThread);
+    size_t remaining = task_count;
+    std::mutex done_mutex;
+    std::condition_variable done;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    /* Nodes and cache entries made by the tasks go where the caller's would */
+    Arena* arena = GetCurrentArena();
+    SimplifyCache* simplify_cache = GetCurrentSimplifyCache();
+    DerivativeCache* derivative_cache = GetCurrentDerivativeCache();
+
+    auto run_range = [&](size_t task) {
+        size_t begin = count * task / task_count;
+        size_t end = count * (task + 1) / task_count;
+        try {
+            ArenaScope arena_scope(arena);
+            SimplifyCacheScope simplify_scope(simplify_cache);
+            DerivativeCacheScope derivative_scope(derivative_cache);
+            for (size_t i = begin; i < end; ++i) {
+                body(i);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        /* Notified under the lock: the caller may return and destroy `done` as soon as it sees zero */
+        std::lock_guard<std::mutex> lock(done_mutex);
+        if (--remaining == 0) {
+            done.notify_all();
+        }
+    };
+
+    size_t home = GetHomeQueue();
+    for (size_t task = 1; task < task_count; ++task) {
+        Push(home, [&run_range, task] { run_range(task); });
+    }
+    run_range(0);
+
+    /* Help with queued tasks, then sleep until the ones other threads took are done */
+    std::unique_lock<std::mutex> lock(done_mutex);
+    while (remaining != 0) {
+        lock.unlock();
+        bool ran = RunOne(home);
+        lock.lock();
+        if (!ran) {
+            done.wait(lock, [&remaining] { return remaining == 0; });
+        }
+    }
+    lock.unlock();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+    current_thread_pool = this;
+    worker_pool = this;
+    worker_index = index;
+
+    while (true) {
+        if (RunOne(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return stopping_ || pending_tasks_.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping_ && pending_tasks_.load(std::memory_order_acquire) <= 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::GetHomeQueue() const {
+    return worker_pool == this ? worker_index : threads_.size();
+}
+
+void ThreadPool::Push(size_t home, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(queues_[home]->mutex);
+        queues_[home]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        pending_tasks_.fetch_add(1, std::memory_order_release);
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::RunOne(size_t home) {
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(queues_[home]->mutex);
+        if (!queues_[home]->tasks.empty()) {
+            task = std::move(queues_[home]->tasks.back());
+            queues_[home]->tasks.pop_back();
+        }
+    }
+
+    for (size_t i = 1; !task && i < queues_.size(); ++i) {
+        auto& victim = *queues_[(home + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+    pending_tasks_.fetch_sub(1, std::memory_order_acq_rel);
+    task();
+    return true;
+}
+
+ThreadPoolScope::ThreadPoolScope(ThreadPool* pool) : previous_(current_thread_pool) {
+    current_thread_pool = pool;
+}
+
+ThreadPoolScope::~ThreadPoolScope() {
+    current_thread_pool = previous_;
+}
+
+ThreadPool* GetCurrentThreadPool() {
+    return current_thread_pool;
+}
+
+}  /* namespace calculus */
@@ -3,11 +3,11 @@
 
 namespace calculus {
 
-ExpressionPtr Variable::Simplify() {
+ExpressionPtr Variable::DoSimplify() {
     return shared_from_this();
 }
 
-ExpressionPtr Variable::TakeDerivative(char var_name) {
+ExpressionPtr Variable::DoTakeDerivative(char var_name) {
     return (var_name == name_) ? kConstantOne : kConstantZero;
 }
 
@@ -15,8 +15,9 @@ ExpressionPtr Variable::Call(const std::vector<ExpressionPtr>&) {
     return shared_from_this();
 }
 
-ExpressionPtr Variable::Substitute(char var_name, const ExpressionPtr& other) {
-    return var_name == name_ ? other : shared_from_this();
+ExpressionPtr Variable::DoSubstitute(const Bindings& bindings) {
+    const ExpressionPtr* value = bindings.Find(name_);
+    return value != nullptr ? *value : shared_from_this();
 }
 
 void Variable::Print(std::ostream& out, int) const {
@@ -27,6 +28,10 @@ void Variable::TexDump(std::ostream& out, int) const {
     out << name_;
 }
 
+size_t Variable::ComputeHash() const {
+    return HashCombine(HashSeed(kKind), name_);
+}
+
 bool Variable::DeepCompare(const ExpressionPtr& other) const {
     COMPARE_CHECK_TRIVIAL
     return name_ == ptr->name_;
@@ -1,7 +1,15 @@
 #include <calculus_grammar.h>
+#include <simplify_cache.h>
+#include <derivative_cache.h>
+#include <normalize.h>
+#include <thread_pool.h>
+#include <cstring>
 #include <iostream>
 
-int main() {
+int main(int argc, char* argv[]) {
+    /* --stats prints the arena and cache counters of every line to stderr */
+    bool print_stats = argc > 1 && std::strcmp(argv[1], "--stats") == 0;
+
     std::string input;
     CalculusGrammar::Parser parser;
     std::cout << "Very clever Vova calculator\n";
@@ -9,32 +17,56 @@ int main() {
     std::cout.precision(20);
     std::cerr.precision(20);
 
-    while (std::cout << ">> ", std::getline(std::cin, input)) {
-        try {
-            auto ast = parser.Parse(input);
-            std::cerr << "AST: ";
-            ast->Print(std::cerr);
-            std::cerr << std::endl;
+    calculus::Arena arena;
+    calculus::SimplifyCache simplify_cache;
+    calculus::DerivativeCache derivative_cache;
+    calculus::ThreadPool thread_pool;
+    calculus::ThreadPoolScope thread_pool_scope(&thread_pool);
 
-            int simplify_counter = 0;
-            auto expr = ast->BuildExpression();
-            while (true) {
-                std::cerr << "Expression, try #" << simplify_counter << ": ";
-                ++simplify_counter;
-                expr->Print(std::cerr);
+    while (std::cout << ">> ", std::getline(std::cin, input)) {
+        {
+            calculus::ArenaScope arena_scope(&arena);
+            calculus::SimplifyCacheScope simplify_cache_scope(&simplify_cache);
+            calculus::DerivativeCacheScope derivative_cache_scope(&derivative_cache);
+            try {
+                auto ast = parser.Parse(input);
+                std::cerr << "AST: ";
+                ast->Print(std::cerr);
                 std::cerr << std::endl;
 
-                auto new_expr = expr->Simplify();
-                if (expr->DeepCompare(new_expr)) {
-                    break;
+                auto result = calculus::Normalize(
+                    ast->BuildExpression(), calculus::kDefaultMaxNormalizePasses,
+                    [](const calculus::ExpressionPtr& expr, int pass) {
+                        std::cerr << "Expression, try #" << pass << ": ";
+                        expr->Print(std::cerr);
+                        std::cerr << std::endl;
+                    });
+                if (result.oscillating) {
+                    std::cerr << "Simplification oscillates, stopped after " << result.passes << " passes" << std::endl;
+                } else if (!result.converged) {
+                    throw std::runtime_error("The maximum iterations number has been exceeded.");
                 }
-                expr = new_expr;
-            }
-            expr->Print(std::cout);
-            std::cout << std::endl;
+                result.expr->Print(std::cout);
+                std::cout << std::endl;
 
+            } catch (const std::exception& e) {
+                std::cout << e.what() << std::endl;
+            }
+        }
+        if (print_stats) {
+            std::cerr << "Arena: " << arena.GetNodesAllocated() << " nodes, " << arena.GetBytesAllocated() << " bytes"
+                      << std::endl;
+            std::cerr << "Simplify cache: " << simplify_cache.GetHits() << " hits, " << simplify_cache.GetMisses()
+                      << " misses" << std::endl;
+            std::cerr << "Derivative cache: " << derivative_cache.GetHits() << " hits, "
+                      << derivative_cache.GetMisses() << " misses" << std::endl;
+        }
+        try {
+            simplify_cache.Clear();
+            derivative_cache.Clear();
+            arena.Reset();
         } catch (const std::exception& e) {
-            std::cout << e.what() << std::endl;
+            std::cerr << e.what() << std::endl;
         }
     }
     return 0;
@@ -1,8 +1,13 @@
 #include <calculus_grammar.h>
 #include <iostream>
+#include <cstring>
 #include <errno.h>
 #include <error.h>
 #include <tex_phrases.h>
+#include <simplify_cache.h>
+#include <derivative_cache.h>
+#include <normalize.h>
+#include <thread_pool.h>
 
 static constexpr int kMaxSteps = 100;
 
@@ -31,6 +36,11 @@ int main(int argc, char* argv[]) {
     std::string line;
     std::cout.precision(20);
     CalculusGrammar::Parser parser;
+    calculus::Arena arena;
+    calculus::SimplifyCache simplify_cache;
+    calculus::DerivativeCache derivative_cache;
+    calculus::ThreadPool thread_pool;
+    calculus::ThreadPoolScope thread_pool_scope(&thread_pool);
 
     while (std::getline(std::cin, line)) {
         std::cout << "\\section{}\n";
@@ -43,31 +53,42 @@ int main(int argc, char* argv[]) {
 \end{minipage}
 \end{tcolorbox}
 )";
-        try {
-            auto expr = parser.Parse(line)->BuildExpression();
-            int step_counter = 0;
-            while (true) {
-                if (++step_counter > kMaxSteps) {
+        {
+            calculus::ArenaScope arena_scope(&arena);
+            calculus::SimplifyCacheScope simplify_cache_scope(&simplify_cache);
+            calculus::DerivativeCacheScope derivative_cache_scope(&derivative_cache);
+            try {
+                auto result = calculus::Normalize(
+                    parser.Parse(line)->BuildExpression(), kMaxSteps,
+                    [](const calculus::ExpressionPtr& expr, int pass) {
+                        std::cout << "\n\nStep \\#" << pass + 1;
+                        std::cout << kTexMathBegin;
+                        expr->TexDump(std::cout);
+                        std::cout << kTexMathEnd;
+                    });
+                if (!result.converged && !result.oscillating) {
                     throw std::runtime_error("The maximum iterations number has been exceeded.");
                 }
-                std::cout << "\n\nStep \\#" << step_counter;
-                std::cout << kTexMathBegin;
-                expr->TexDump(std::cout);
-                std::cout << kTexMathEnd;
-
-                auto new_expr = expr->Simplify();
-                if (new_expr->DeepCompare(expr)) {
+                if (result.oscillating) {
+                    std::cout << R"(\textbf{Result:} \begin{tcolorbox}[colback=orange!40])";
+                    std::cout << kTexOscillating << result.passes << kTexMathBegin;
+                } else {
                     std::cout << R"(\textbf{Result:} \begin{tcolorbox}[colback=green!40])" << kTexMathBegin;
-                    new_expr->TexDump(std::cout);
-                    std::cout << kTexMathEnd << "\\end{tcolorbox}\n";
-                    break;
                 }
-                expr = new_expr;
+                result.expr->TexDump(std::cout);
+                std::cout << kTexMathEnd << "\\end{tcolorbox}\n";
+            } catch (const std::exception& e) {
+                std::cout << R"(\textbf{Result:} \begin{tcolorbox}[colback=red!40])";
+                std::cout << kTexError << "\\texttt{" << e.what() << "}";
+                std::cout << "\\end{tcolorbox}\n";
             }
+        }
+        try {
+            simplify_cache.Clear();
+            derivative_cache.Clear();
+            arena.Reset();
         } catch (const std::exception& e) {
-            std::cout << R"(\textbf{Result:} \begin{tcolorbox}[colback=red!40])";
-            std::cout << kTexError << "\\texttt{" << e.what() << "}";
-            std::cout << "\\end{tcolorbox}\n";
+            std::cerr << e.what() << std::endl;
         }
     }
 
@@ -0,0 +1,175 @@
+/* EvaluateBatch at every instruction set the CPU supports: rows must match the interpreter,
+ * the vector kernels must stay within the error bounds stated in bytecode.h, and the vector
+ * levels should beat the scalar loop. */
+
+#include "test_util.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace calculus;
+
+using PointGenerator = std::function<void(std::mt19937_64*, double*, double*)>;
+
+static std::vector<SimdLevel> GetSupportedLevels() {
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::kScalar, SimdLevel::kAvx2, SimdLevel::kAvx512}) {
+        if (level <= GetSimdLevel()) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+static std::string GetLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::kAvx512:
+            return "avx512";
+        case SimdLevel::kAvx2:
+            return "avx2";
+        case SimdLevel::kScalar:
+            break;
+    }
+    return "scalar";
+}
+
+/* Distance from `want` in units in the last place of `want` */
+static double GetUlpError(double got, double want) {
+    if (got == want || (std::isnan(got) && std::isnan(want))) {
+        return 0;
+    }
+    if (!std::isfinite(got) || !std::isfinite(want)) {
+        return HUGE_VAL;
+    }
+    double ulp = std::nextafter(std::fabs(want), HUGE_VAL) - std::fabs(want);
+    return std::fabs(got - want) / ulp;
+}
+
+static double Uniform(std::mt19937_64* random, double from, double to) {
+    return std::uniform_real_distribution<double>(from, to)(*random);
+}
+
+static void CheckAgainstInterpreter(const std::string& text) {
+    auto expr = ParseExpression(text);
+    auto derivative = Differentiate(expr, 'x');
+    TestTable table(1000, 4);
+
+    for (const auto& [what, program] : {std::make_pair(text, BytecodeProgram::Compile(expr)),
+                                        std::make_pair(text + " d/dx", BytecodeProgram::Compile(derivative))}) {
+        std::vector<double> result(table.GetCount());
+        for (SimdLevel level : GetSupportedLevels()) {
+            program.EvaluateBatch(table.GetColumns(), table.GetCount(), result.data(), level);
+            for (size_t row = 0; row < table.GetCount(); ++row) {
+                double point[kVariableCount];
+                table.GetRow(row, point);
+                CheckNear(what + " " + GetLevelName(level), result[row], program.Evaluate(point), 1e-13);
+            }
+
+            // Every row keeps its value when the batch starts elsewhere and ends short of a vector
+            const double* shifted[kVariableCount];
+            for (size_t c = 0; c < kVariableCount; ++c) {
+                shifted[c] = table.GetColumns()[c] + 3;
+            }
+            std::vector<double> shifted_result(table.GetCount() - 6);
+            program.EvaluateBatch(shifted, shifted_result.size(), shifted_result.data(), level);
+            CHECK(std::equal(shifted_result.begin(), shifted_result.end(), result.begin() + 3));
+        }
+    }
+}
+
+/* A single kernel over x (and y) drawn by `generate`, against libm */
+static void CheckKernel(const std::string& text, const PointGenerator& generate,
+                        const std::function<double(double, double)>& reference, double max_ulps) {
+    auto program = BytecodeProgram::Compile(ParseExpression(text));
+    const size_t count = 100000;
+    std::mt19937_64 random(5);
+    std::vector<double> xs(count), ys(count, 0), result(count);
+    for (size_t i = 0; i < count; ++i) {
+        generate(&random, &xs[i], &ys[i]);
+    }
+    const double* variables[kVariableCount] = {};
+    variables['x' - 'a'] = xs.data();
+    variables['y' - 'a'] = ys.data();
+
+    for (SimdLevel level : GetSupportedLevels()) {
+        program.EvaluateBatch(variables, count, result.data(), level);
+        double worst = 0;
+        size_t worst_row = 0;
+        for (size_t i = 0; i < count; ++i) {
+            double error = GetUlpError(result[i], reference(xs[i], ys[i]));
+            if (error > worst) {
+                worst = error;
+                worst_row = i;
+            }
+        }
+        if (worst > max_ulps) {
+            std::fprintf(stderr, "%s %s: %.2f ulp at x = %.17g, y = %.17g, bound %.0f\n", text.c_str(),
+                         GetLevelName(level).c_str(), worst, xs[worst_row], ys[worst_row], max_ulps);
+            ++GetFailureCount();
+        }
+    }
+}
+
+static void CheckKernels() {
+    auto sin_cos_range = [](std::mt19937_64* random, double* x, double*) { *x = Uniform(random, -1e5, 1e5); };
+    // Close to multiples of pi / 2, where the argument reduction loses the most
+    auto near_multiples = [](std::mt19937_64* random, double* x, double*) {
+        *x = std::floor(Uniform(random, 0, 60000)) * M_PI_2 * (1 + Uniform(random, -5e-15, 5e-15));
+    };
+    auto exp_range = [](std::mt19937_64* random, double* x, double*) { *x = Uniform(random, -708, 708); };
+    auto positive = [](std::mt19937_64* random, double* x, double*) { *x = std::exp(Uniform(random, -700, 700)); };
+    auto pow_range = [](std::mt19937_64* random, double* x, double* y) {
+        *x = std::exp(Uniform(random, -700, 700));
+        *y = Uniform(random, -16, 16);
+    };
+    auto small_pow_range = [](std::mt19937_64* random, double* x, double* y) {
+        *x = Uniform(random, 0, 4);
+        *y = Uniform(random, -10, 10);
+    };
+    auto signed_range = [](std::mt19937_64* random, double* x, double*) { *x = Uniform(random, -1e15, 1e15); };
+
+    auto sin = [](double x, double) { return std::sin(x); };
+    auto cos = [](double x, double) { return std::cos(x); };
+    CheckKernel("sin(x)", sin_cos_range, sin, 1);
+    CheckKernel("cos(x)", sin_cos_range, cos, 1);
+    CheckKernel("sin(x)", near_multiples, sin, 1);
+    CheckKernel("cos(x)", near_multiples, cos, 1);
+    CheckKernel("exp(x)", exp_range, [](double x, double) { return std::exp(x); }, 1);
+    CheckKernel("log(x)", positive, [](double x, double) { return std::log(x); }, 1);
+    auto pow = [](double x, double y) { return std::pow(x, y); };
+    CheckKernel("x ^ y", pow_range, pow, 2);
+    CheckKernel("x ^ y", small_pow_range, pow, 2);
+    for (int n : {2, 3, -1, -2, -3}) {
+        CheckKernel("x ^ (" + std::to_string(n) + ")", signed_range,
+                    [n](double x, double) { return std::pow(x, n); }, 2);
+    }
+    CheckKernel("x ^ 0.5", positive, [](double x, double) { return std::sqrt(x); }, 1);
+}
+
+static void CompareSpeed(const std::string& text) {
+    auto program = BytecodeProgram::Compile(ParseExpression(text));
+    TestTable table(1 << 16, 6);
+    std::vector<double> result(table.GetCount());
+    std::vector<double> scratch(program.GetBatchScratchSize());
+
+    std::printf("%s:", text.c_str());
+    double scalar_seconds = 0;
+    for (SimdLevel level : GetSupportedLevels()) {
+        double seconds = TimePerCall(20, [&](int) {
+            program.EvaluateBatch(table.GetColumns(), table.GetCount(), result.data(), level, scratch.data());
+        }) / table.GetCount();
+        if (level == SimdLevel::kScalar) {
+            scalar_seconds = seconds;
+        }
+        std::printf(" %s %.2f ns/row (%.1fx)", GetLevelName(level).c_str(), 1e9 * seconds, scalar_seconds / seconds);
+    }
+    std::printf("\n");
+}
+
+int main() {
+    ForEachTestExpression(CheckAgainstInterpreter);
+    CheckKernels();
+    CompareSpeed(GetTestExpressions()[1]);
+    CompareSpeed("sin(x) * cos(y) + exp(z) * log(x + y)");
+    return FinishTest();
+}
@@ -0,0 +1,99 @@
+/* BatchEvaluator on a thread pool against the single-threaded engines it splits work for:
+ * the same rows must come out, whatever thread ran their chunk, and the derivatives must
+ * match the symbolic ones. Also times a large table on one thread and on the pool. */
+
+#include "test_util.h"
+
+#include <batch_evaluator.h>
+
+#include <thread>
+
+using namespace calculus;
+
+static void CheckExpression(const std::string& text, ThreadPool* pool) {
+    auto expr = ParseExpression(text);
+    // Chunks that do not end on a block boundary, so rows of one block land on several threads
+    BatchEvaluator evaluator(expr, pool, kBatchBlockSize + 44);
+    const auto& program = evaluator.GetProgram();
+    TestTable table(5000, 9);
+    size_t count = table.GetCount();
+
+    std::vector<double> got(count), want(count);
+    evaluator.Evaluate(table.GetColumns(), count, got.data());
+    program.EvaluateBatch(table.GetColumns(), count, want.data());
+    CHECK(got == want);
+
+    double direction[kVariableCount] = {};
+    direction['x' - 'a'] = 1;
+    std::vector<double> derivatives(count);
+    evaluator.EvaluateDual(table.GetColumns(), direction, count, got.data(), derivatives.data());
+
+    std::vector<std::vector<double>> gradient(kVariableCount, std::vector<double>(count));
+    std::vector<double*> gradient_columns;
+    for (auto& column : gradient) {
+        gradient_columns.push_back(column.data());
+    }
+    std::vector<double> values(count);
+    evaluator.EvaluateGradient(table.GetColumns(), count, values.data(), gradient_columns.data());
+
+    std::vector<BytecodeProgram> partials;
+    for (char var_name : {'x', 'y', 'z'}) {
+        partials.push_back(BytecodeProgram::Compile(Differentiate(expr, var_name)));
+    }
+    for (size_t row = 0; row < count; ++row) {
+        double variables[kVariableCount];
+        table.GetRow(row, variables);
+        Dual dual = program.EvaluateDual(variables, direction);
+        CHECK(got[row] == dual.value && derivatives[row] == dual.derivative);
+        CheckNear(text + " d/dx dual", derivatives[row], partials[0].Evaluate(variables), 1e-12);
+
+        CheckNear(text + " gradient value", values[row], want[row], 1e-13);
+        for (size_t i = 0; i < partials.size(); ++i) {
+            CheckNear(text + " gradient", gradient['x' - 'a' + i][row], partials[i].Evaluate(variables), 1e-12);
+        }
+    }
+}
+
+static void CheckMissingColumn(ThreadPool* pool) {
+    BatchEvaluator evaluator(ParseExpression("x * y"), pool);
+    const double xs[] = {1, 2};
+    const double* variables[kVariableCount] = {};
+    variables['x' - 'a'] = xs;
+    double direction[kVariableCount] = {};
+    double values[2], derivatives[2];
+    CHECK_THROWS(evaluator.EvaluateDual(variables, direction, 2, values, derivatives));
+}
+
+static void CompareSpeed(ThreadPool* pool) {
+    const auto& text = GetTestExpressions()[1];
+    auto expr = ParseExpression(text);
+    TestTable table(1 << 18, 10);
+    std::vector<double> result(table.GetCount());
+
+    double single_seconds = 0;
+    std::printf("%s, %zu rows:", text.c_str(), table.GetCount());
+    for (ThreadPool* evaluator_pool : {static_cast<ThreadPool*>(nullptr), pool}) {
+        BatchEvaluator evaluator(expr, evaluator_pool);
+        evaluator.Evaluate(table.GetColumns(), table.GetCount(), result.data());
+        double seconds = TimePerCall(10, [&](int) {
+            evaluator.Evaluate(table.GetColumns(), table.GetCount(), result.data());
+        });
+        if (evaluator_pool == nullptr) {
+            single_seconds = seconds;
+            std::printf(" 1 thread %.2f ms", 1e3 * seconds);
+        } else {
+            std::printf(", %zu threads %.2f ms (%.1fx, %u cores)", pool->GetThreadCount() + 1, 1e3 * seconds,
+                        single_seconds / seconds, std::thread::hardware_concurrency());
+        }
+    }
+    std::printf("\n");
+}
+
+int main() {
+    ThreadPool pool(3);
+    ForEachTestExpression([&pool](const std::string& text) { CheckExpression(text, &pool); });
+    CheckExpression(GetTestExpressions()[1], nullptr);
+    CheckMissingColumn(&pool);
+    CompareSpeed(&pool);
+    return FinishTest();
+}
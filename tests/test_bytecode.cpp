@@ -0,0 +1,75 @@
+/* The bytecode interpreter against substitution into the expression tree, which was the only
+ * way to get a value before, and the speedup of evaluating many points. */
+
+#include "test_util.h"
+
+using namespace calculus;
+
+static void CheckExpression(const std::string& text) {
+    auto expr = ParseExpression(text);
+    auto program = BytecodeProgram::Compile(expr);
+    auto derivative = Differentiate(expr, 'x');
+    auto derivative_program = BytecodeProgram::Compile(derivative);
+
+    std::mt19937_64 random(2);
+    double variables[kVariableCount];
+    for (int i = 0; i < 10; ++i) {
+        FillTestPoint(&random, variables);
+        CheckNear(text, program.Evaluate(variables), EvaluateBySubstitution(expr, variables), 1e-12);
+        CheckNear(text + " d/dx", derivative_program.Evaluate(variables), EvaluateBySubstitution(derivative, variables),
+                  1e-12);
+    }
+}
+
+static void CheckProgramShape() {
+    // The common subexpression sin(x * y) is computed once
+    auto program = BytecodeProgram::Compile(ParseExpression("sin(x * y) ^ 2 + cos(sin(x * y)) + x * y"));
+    size_t sines = 0;
+    for (const auto& instruction : program.GetInstructions()) {
+        sines += instruction.op == OpCode::kSin;
+    }
+    CHECK(sines == 1);
+    CHECK(program.GetRegisterCount() < program.GetInstructions().size());
+
+    // Small constant powers need no pow()
+    for (const char* text : {"x ^ 2", "x ^ 3 / y", "x ^ (-2)", "x ^ 0.5"}) {
+        auto power_program = BytecodeProgram::Compile(ParseExpression(text));
+        for (const auto& instruction : power_program.GetInstructions()) {
+            CHECK(instruction.op != OpCode::kPow);
+        }
+    }
+
+    // Unknown functions and unsimplified derivatives have no value
+    for (const char* text : {"foo(x)", "(x ^ 2)'"}) {
+        CHECK_THROWS(BytecodeProgram::Compile(ParseRaw(text)));
+    }
+}
+
+static void CompareSpeed() {
+    auto expr = ParseExpression(GetTestExpressions()[1]);
+    auto program = BytecodeProgram::Compile(expr);
+    std::mt19937_64 random(3);
+    double variables[kVariableCount];
+    FillTestPoint(&random, variables);
+
+    double sum = 0;
+    double substitution_seconds = TimePerCall(200, [&](int i) {
+        variables[0] = 0.5 + i * 1e-3;
+        sum += EvaluateBySubstitution(expr, variables);
+    });
+    double bytecode_seconds = TimePerCall(1000000, [&](int i) {
+        variables[0] = 0.5 + i * 1e-6;
+        sum += program.Evaluate(variables);
+    });
+
+    std::printf("%s: substitution %.2f us/point, bytecode %.1f ns/point, %.0fx faster (checksum %g)\n",
+                GetTestExpressions()[1].c_str(), 1e6 * substitution_seconds, 1e9 * bytecode_seconds,
+                substitution_seconds / bytecode_seconds, sum);
+}
+
+int main() {
+    ForEachTestExpression(CheckExpression);
+    CheckProgramShape();
+    CompareSpeed();
+    return FinishTest();
+}
@@ -0,0 +1,117 @@
+/* Forward mode, both the walk over the expression tree and the bytecode interpreter on dual
+ * numbers, against the symbolic derivative, and the time saved by not building it. */
+
+#include "test_util.h"
+
+#include <dual.h>
+
+using namespace calculus;
+
+/* Sum of direction[c] times the partial derivative by variable 'a' + c, from the symbolic engine */
+static double GetSymbolicDerivative(const ExpressionPtr& expr, const double* variables, const double* direction) {
+    double result = 0;
+    for (char var_name : {'x', 'y', 'z'}) {
+        result += direction[var_name - 'a'] * EvaluateBySubstitution(Differentiate(expr, var_name), variables);
+    }
+    return result;
+}
+
+static void CheckExpression(const std::string& text) {
+    auto raw = ParseRaw(text);
+    auto expr = ParseExpression(text);
+    auto program = BytecodeProgram::Compile(expr);
+    std::mt19937_64 random(11);
+    double variables[kVariableCount];
+    double direction[kVariableCount];
+
+    for (int i = 0; i < 5; ++i) {
+        FillTestPoint(&random, variables);
+        FillTestPoint(&random, direction);
+        double value = EvaluateBySubstitution(expr, variables);
+        double derivative = GetSymbolicDerivative(expr, variables, direction);
+
+        // The tree walk also takes the unsimplified parse
+        Dual raw_dual = EvaluateDual(raw, variables, direction);
+        Dual tree_dual = EvaluateDual(expr, variables, direction);
+        Dual bytecode_dual = program.EvaluateDual(variables, direction);
+        for (const auto& [what, dual] : {std::make_pair(text + " raw tree", raw_dual),
+                                         std::make_pair(text + " tree", tree_dual),
+                                         std::make_pair(text + " bytecode", bytecode_dual)}) {
+            CheckNear(what, dual.value, value, 1e-12);
+            CheckNear(what + " derivative", dual.derivative, derivative, 1e-12);
+        }
+    }
+}
+
+static void CheckSpecialNodes() {
+    double variables[kVariableCount] = {};
+    double direction[kVariableCount] = {};
+    variables['x' - 'a'] = 0.7;
+    variables['y' - 'a'] = 1.3;
+    direction['y' - 'a'] = 1;
+
+    // Derivatives and substitutions left in the tree are evaluated in place
+    Dual dual = EvaluateDual(ParseRaw("(sin(x) * y ^ 2)'_x"), variables, direction);
+    CheckNear("derivative node", dual.value, std::cos(0.7) * 1.3 * 1.3, 1e-15);
+    CheckNear("derivative node d/dy", dual.derivative, std::cos(0.7) * 2 * 1.3, 1e-15);
+    dual = EvaluateDual(ParseRaw("(x ^ 2)[x = y + 1]"), variables, direction);
+    CheckNear("substitution node", dual.value, 2.3 * 2.3, 1e-15);
+    CheckNear("substitution node d/dy", dual.derivative, 2 * 2.3, 1e-15);
+
+    // A constant exponent keeps the derivative defined for a negative base
+    variables['x' - 'a'] = -1.5;
+    direction['x' - 'a'] = 1;
+    direction['y' - 'a'] = 0;
+    dual = EvaluateDual(ParseRaw("x ^ 3"), variables, direction);
+    CheckNear("negative base", dual.derivative, 3 * 1.5 * 1.5, 1e-15);
+
+    CHECK_THROWS(EvaluateDual(ParseRaw("foo(x)"), variables, direction));
+}
+
+static void CompareSpeed() {
+    const auto& text = GetTestExpressions()[1];
+    auto expr = ParseExpression(text);
+    std::mt19937_64 random(12);
+    double variables[kVariableCount];
+    double direction[kVariableCount] = {};
+    FillTestPoint(&random, variables);
+    direction['x' - 'a'] = 1;
+
+    // One derivative at one point: building the derivative tree against a single walk
+    double sum = 0;
+    double symbolic_seconds = TimePerCall(200, [&](int i) {
+        variables[0] = 0.5 + i * 1e-3;
+        sum += BytecodeProgram::Compile(Differentiate(expr, 'x')).Evaluate(variables);
+    });
+    double tree_seconds = TimePerCall(20000, [&](int i) {
+        variables[0] = 0.5 + i * 1e-5;
+        sum += EvaluateDual(expr, variables, direction).derivative;
+    });
+
+    // Many points: the compiled derivative against the program run on duals
+    auto derivative_program = BytecodeProgram::Compile(Differentiate(expr, 'x'));
+    auto program = BytecodeProgram::Compile(expr);
+    std::vector<double> registers(derivative_program.GetRegisterCount());
+    std::vector<Dual> dual_registers(program.GetRegisterCount());
+    const int evaluations = 1000000;
+    double compiled_seconds = TimePerCall(evaluations, [&](int i) {
+        variables[0] = 0.5 + i * 1e-6;
+        sum += derivative_program.Evaluate(variables, registers.data());
+    });
+    double dual_seconds = TimePerCall(evaluations, [&](int i) {
+        variables[0] = 0.5 + i * 1e-6;
+        sum += program.EvaluateDual(variables, direction, dual_registers.data()).derivative;
+    });
+
+    std::printf("%s d/dx once: symbolic %.1f us, dual tree walk %.2f us (%.0fx faster)\n", text.c_str(),
+                1e6 * symbolic_seconds, 1e6 * tree_seconds, symbolic_seconds / tree_seconds);
+    std::printf("%s d/dx per point: compiled derivative %.1f ns, bytecode on duals %.1f ns (checksum %g)\n",
+                text.c_str(), 1e9 * compiled_seconds, 1e9 * dual_seconds, sum);
+}
+
+int main() {
+    ForEachTestExpression(CheckExpression);
+    CheckSpecialNodes();
+    CompareSpeed();
+    return FinishTest();
+}
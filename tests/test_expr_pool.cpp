@@ -0,0 +1,85 @@
+/* ExprPool against the tree engine: simplified forms and derivatives built in the pool must
+ * evaluate to the same numbers, and the pool should hold a derivative in less memory. */
+
+#include "test_util.h"
+
+#include <arena.h>
+#include <expr_pool.h>
+
+using namespace calculus;
+
+static constexpr uint64_t kSeed = 1;
+static constexpr int kPoints = 20;
+static constexpr double kTolerance = 1e-10;
+
+static void CheckExpression(const std::string& text) {
+    auto raw = ParseRaw(text);
+    auto simplified = ParseExpression(text);
+
+    ExprPool pool;
+    NodeIndex root = pool.Simplify(pool.FromExpression(raw));
+    CheckSameValues(text, pool.ToExpression(root), simplified, kSeed, kPoints, kTolerance);
+
+    for (char var_name : {'x', 'y', 'z'}) {
+        NodeIndex derivative = pool.Simplify(pool.TakeDerivative(root, var_name));
+        CheckSameValues(text + " d/d" + var_name, pool.ToExpression(derivative), Differentiate(simplified, var_name),
+                        kSeed, kPoints, kTolerance);
+    }
+
+    // A round trip through the pool keeps the value
+    CheckSameValues(text + " round trip", pool.ToExpression(pool.FromExpression(simplified)), simplified, kSeed,
+                    kPoints, kTolerance);
+}
+
+/* The third derivative of a product of five factors, with the tree engine allocating from an
+ * arena to count its bytes */
+static void CompareMemory() {
+    const std::string text = "sin(x) * cos(x) * exp(x) * log(x + 2) * (x ^ 2 + 1)";
+    const int order = 3;
+
+    Arena arena;
+    ExpressionPtr tree;
+    double tree_seconds;
+    {
+        ArenaScope arena_scope(&arena);
+        Stopwatch stopwatch;
+        tree = ParseExpression(text);
+        for (int i = 0; i < order; ++i) {
+            tree = Differentiate(tree, 'x');
+        }
+        tree_seconds = stopwatch.GetSeconds();
+    }
+
+    Stopwatch stopwatch;
+    ExprPool pool;
+    NodeIndex root = pool.Simplify(pool.FromExpression(ParseRaw(text)));
+    for (int i = 0; i < order; ++i) {
+        root = pool.Simplify(pool.TakeDerivative(root, 'x'));
+    }
+    double pool_seconds = stopwatch.GetSeconds();
+
+    CheckSameValues("third derivative", pool.ToExpression(root), tree, kSeed, kPoints, kTolerance);
+    std::printf("third derivative: tree %zu bytes in %zu arena nodes, %.2f ms; pool %zu bytes in %zu nodes, %.2f ms\n",
+                arena.GetBytesAllocated(), arena.GetNodesAllocated(), 1e3 * tree_seconds, pool.GetMemoryUsage(),
+                pool.GetNodeCount(), 1e3 * pool_seconds);
+    CHECK(pool.GetMemoryUsage() < arena.GetBytesAllocated());
+}
+
+static void CheckSpecialValues() {
+    ExprPool pool;
+    NodeIndex nan = pool.AddConstant(std::nan(""));
+    CHECK(pool.AddConstant(-std::nan("")) == nan);
+    CHECK(pool.AddConstant(-0.0) == pool.AddConstant(0.0));
+
+    // 0 * log(-2) stays NaN, as in the tree engine
+    NodeIndex root = pool.Simplify(pool.FromExpression(ParseRaw("0 * log(0 - 2)")));
+    CHECK(std::isnan(pool.GetConstant(root)));
+    CHECK(pool.Simplify(root) == root);
+}
+
+int main() {
+    ForEachTestExpression(CheckExpression);
+    CheckSpecialValues();
+    CompareMemory();
+    return FinishTest();
+}
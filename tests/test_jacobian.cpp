@@ -0,0 +1,108 @@
+/* Gradient, Jacobian, Hessian and Hessian-vector products against partial derivatives taken
+ * one entry at a time, and the time saved by sharing the work between entries. */
+
+#include "test_util.h"
+
+#include <jacobian.h>
+
+using namespace calculus;
+
+static bool IsZero(const ExpressionPtr& expr) {
+    return expr->GetKind() == ExpressionKind::kConstant && static_cast<const Constant&>(*expr).GetValue() == 0;
+}
+
+static void CheckExpression(const std::string& text) {
+    auto expr = ParseExpression(text);
+    const std::string variables = "xyzw";
+
+    auto gradient = Gradient(expr, variables);
+    CHECK(gradient.size() == variables.size());
+    for (size_t i = 0; i < variables.size(); ++i) {
+        CheckSameValues(text + " d/d" + variables[i], gradient[i], Differentiate(expr, variables[i]), 16);
+    }
+    CHECK(IsZero(gradient[3]));
+
+    auto hessian = Hessian(expr, "xyz");
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            // Mixed partials are derived once and shared by both entries
+            CHECK(hessian.At(i, j) == hessian.At(j, i));
+            CheckSameValues(text + " d2/d" + variables[i] + "d" + variables[j], hessian.At(i, j),
+                            Differentiate(Differentiate(expr, variables[i]), variables[j]), 16);
+        }
+    }
+
+    // H * v, with v = (1, 2, -1)
+    const double direction_values[] = {1, 2, -1};
+    std::vector<ExpressionPtr> direction;
+    for (double value : direction_values) {
+        direction.push_back(Make<Constant>(Number::Real(value)));
+    }
+    auto product = HessianVectorProduct(expr, "xyz", direction);
+    std::mt19937_64 random(17);
+    double point[kVariableCount];
+    FillTestPoint(&random, point);
+    for (size_t i = 0; i < 3; ++i) {
+        double want = 0;
+        for (size_t j = 0; j < 3; ++j) {
+            want += BytecodeProgram::Compile(hessian.At(i, j)).Evaluate(point) * direction_values[j];
+        }
+        CheckNear(text + " Hv", BytecodeProgram::Compile(product[i]).Evaluate(point), want, 1e-12);
+    }
+}
+
+static void CheckJacobian() {
+    std::vector<ExpressionPtr> exprs = {ParseExpression("sin(x) * y"), ParseExpression("exp(z) + x ^ 2"),
+                                        ParseExpression("log(y + z)")};
+    const std::string variables = "xyz";
+    auto jacobian = Jacobian(exprs, variables);
+    CHECK(jacobian.GetRows() == 3 && jacobian.GetColumns() == 3);
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        for (size_t j = 0; j < variables.size(); ++j) {
+            bool reads = (exprs[i]->GetFreeVariables() & VariableMask(variables[j])) != 0;
+            CHECK(jacobian.IsStructuralZero(i, j) == !reads);
+            CheckSameValues("jacobian", jacobian.At(i, j), Differentiate(exprs[i], variables[j]), 16);
+        }
+    }
+
+    for (const char* bad_variables : {"xY", "x1"}) {
+        CHECK_THROWS(Gradient(exprs[0], bad_variables));
+    }
+    CHECK_THROWS(HessianVectorProduct(exprs[0], variables, {exprs[0]}));
+}
+
+/* The Hessian by five variables, against deriving every entry on its own */
+static void CompareSpeed() {
+    const std::string text = "sin(a * b) * exp(c + d) / (1 + e ^ 2) + log(a + b + c) * cos(d * e) + (a * e) ^ 3";
+    const std::string variables = "abcde";
+
+    auto expr = ParseExpression(text);
+    Stopwatch naive_stopwatch;
+    std::vector<ExpressionPtr> entries;
+    for (char first : variables) {
+        auto partial = Differentiate(expr, first);
+        for (char second : variables) {
+            entries.push_back(Differentiate(partial, second));
+        }
+    }
+    double naive_seconds = naive_stopwatch.GetSeconds();
+
+    Stopwatch shared_stopwatch;
+    auto hessian = Hessian(expr, variables);
+    double shared_seconds = shared_stopwatch.GetSeconds();
+
+    for (size_t i = 0; i < variables.size(); ++i) {
+        for (size_t j = 0; j < variables.size(); ++j) {
+            CheckSameValues("5x5 Hessian", hessian.At(i, j), entries[i * variables.size() + j], 16);
+        }
+    }
+    std::printf("5x5 Hessian: entry by entry %.2f ms, Hessian() %.2f ms, %.1fx faster\n", 1e3 * naive_seconds,
+                1e3 * shared_seconds, naive_seconds / shared_seconds);
+}
+
+int main() {
+    ForEachTestExpression(CheckExpression);
+    CheckJacobian();
+    CompareSpeed();
+    return FinishTest();
+}
@@ -0,0 +1,86 @@
+/* Native code against the bytecode interpreter it is generated from, which it must match
+ * bit for bit, the cache of compiled functions, and the speedup over the interpreter. */
+
+#include "test_util.h"
+
+#include <jit.h>
+
+using namespace calculus;
+
+static void CheckExpression(const std::string& text) {
+    auto expr = ParseExpression(text);
+    auto derivative = Differentiate(expr, 'x');
+    std::mt19937_64 random(7);
+    double variables[kVariableCount];
+
+    for (const auto& [what, function] : {std::make_pair(text, JitFunction::Compile(expr)),
+                                         std::make_pair(text + " d/dx", JitFunction::Compile(derivative))}) {
+        for (int i = 0; i < 20; ++i) {
+            FillTestPoint(&random, variables);
+            double got = function->Evaluate(variables);
+            double want = function->GetProgram().Evaluate(variables);
+            if (got != want) {
+                std::fprintf(stderr, "%s: native %.17g, bytecode %.17g\n", what.c_str(), got, want);
+                ++GetFailureCount();
+            }
+        }
+    }
+
+    // The derivative itself, against substitution into the symbolic derivative
+    auto function = JitFunction::Compile(derivative);
+    FillTestPoint(&random, variables);
+    CheckNear(text + " d/dx", function->Evaluate(variables), EvaluateBySubstitution(derivative, variables), 1e-12);
+}
+
+static void CheckCache() {
+    JitCache cache(2);
+    auto first = cache.GetOrCompile(ParseExpression("sin(x) + y"));
+    // Equal expressions parsed separately share one function
+    CHECK(cache.GetOrCompile(ParseExpression("sin(x) + y")) == first);
+    CHECK(cache.GetHits() == 1);
+    CHECK(cache.GetMisses() == 1);
+
+    // The least recently used entry is evicted
+    cache.GetOrCompile(ParseExpression("x * y"));
+    cache.GetOrCompile(ParseExpression("x / y"));
+    CHECK(cache.GetOrCompile(ParseExpression("sin(x) + y")) != first);
+    CHECK(cache.GetMisses() == 4);
+
+    cache.Clear();
+    cache.GetOrCompile(ParseExpression("x / y"));
+    CHECK(cache.GetMisses() == 5);
+}
+
+static void CompareSpeed() {
+    const auto& text = GetTestExpressions()[1];
+    auto function = JitFunction::Compile(ParseExpression(text));
+    std::mt19937_64 random(8);
+    double variables[kVariableCount];
+    FillTestPoint(&random, variables);
+    std::vector<double> registers(function->GetProgram().GetRegisterCount());
+
+    const int evaluations = 1000000;
+    double sum = 0;
+    double bytecode_seconds = TimePerCall(evaluations, [&](int i) {
+        variables[0] = 0.5 + i * 1e-6;
+        sum += function->GetProgram().Evaluate(variables, registers.data());
+    });
+    double native_seconds = TimePerCall(evaluations, [&](int i) {
+        variables[0] = 0.5 + i * 1e-6;
+        sum += function->Evaluate(variables);
+    });
+
+    std::printf("%s: bytecode %.1f ns/point, %s %.1f ns/point, %.1fx faster (%zu bytes of code, checksum %g)\n",
+                text.c_str(), 1e9 * bytecode_seconds, function->IsNative() ? "native" : "fallback",
+                1e9 * native_seconds, bytecode_seconds / native_seconds, function->GetCodeSize(), sum);
+}
+
+int main() {
+    ForEachTestExpression(CheckExpression);
+#if defined(__x86_64__)
+    CHECK(JitFunction::Compile(ParseExpression("x + 1"))->IsNative());
+#endif
+    CheckCache();
+    CompareSpeed();
+    return FinishTest();
+}
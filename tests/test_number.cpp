@@ -0,0 +1,18 @@
+/* Printing of exact constants: every fraction with an exact decimal form comes out as that
+ * decimal, however many places it needs, and only the others as "p / q". */
+
+#include "test_util.h"
+
+using namespace calculus;
+
+int main() {
+    CheckPrinted("3.14159265358979", "3.14159265358979");
+    CheckPrinted("0.1234567891", "0.1234567891");
+    CheckPrinted("1 / 1024", "0.0009765625");
+    CheckPrinted("-7 / 40", "-0.175");
+    CheckPrinted("2 ^ (-70)", "0.0000000000000000000008470329472543003390683225006796419620513916015625");
+    CheckPrinted("10 ^ 30 + 0.5", "1000000000000000000000000000000.5");
+    CheckPrinted("1 / 3", "1 / 3");
+    CheckPrinted("7 / 30", "7 / 30");
+    return FinishTest();
+}
@@ -0,0 +1,38 @@
+/* Sums of polynomial fractions are put over one common denominator and cancelled, which is
+ * what leaves quotient-rule derivatives in lowest terms. */
+
+#include "test_util.h"
+
+#include <dual.h>
+
+using namespace calculus;
+
+int main() {
+    // The quotient rule over one denominator
+    CheckPrinted("((x + 1) / (x - 1))'_x", "-(2 / (x - 1) ^ 2)");
+    CheckPrinted("(x / (x + 1))'_x", "1 / (x + 1) ^ 2");
+    CheckPrinted("1 / (x - 1) - 1 / (x + 1)", "2 / (x + 1) / (x - 1)");
+    CheckPrinted("x / (x ^ 2 - 1) + 1 / (x + 1)", "(x * 2 - 1) / (x ^ 2 - 1)");
+    CheckPrinted("x / (x + 1) + 1 / (x + 1)", "1");
+
+    // Sums that do not get lighter, or are no rational functions, stay apart
+    CheckPrinted("x + 1 / x", "x + 1 / x");
+    CheckPrinted("sin(x) / (x + 1) + 1 / (x + 1)", "sin(x) / (x + 1) + 1 / (x + 1)");
+
+    // Every combined form keeps the value of the sum it came from, evaluated unsimplified
+    std::mt19937_64 random(18);
+    double variables[kVariableCount];
+    const double direction[kVariableCount] = {};
+    for (const char* text : {"((x + 1) / (x - 1))'_x", "(x ^ 2 / (x + y))'_x + y / (x + y) ^ 2",
+                             "1 / x + 1 / y - (x + y) / (x * y) + 1 / (x * y - 1)"}) {
+        auto raw = ParseRaw(text);
+        auto expr = ParseExpression(text);
+        for (int i = 0; i < 5; ++i) {
+            FillTestPoint(&random, variables);
+            variables['x' - 'a'] += 1.5;
+            CheckNear(text, EvaluateDual(expr, variables, direction).value,
+                      EvaluateDual(raw, variables, direction).value, 1e-12);
+        }
+    }
+    return FinishTest();
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+/* Helpers shared by the test programs. Every failed check is reported on stderr and counts
+ * towards the exit code, so ctest marks the program failed; timings are printed for reading
+ * only and never fail a test. */
+
+#include <calculus_grammar.h>
+#include <bytecode.h>
+#include <normalize.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace calculus {
+
+inline int& GetFailureCount() {
+    static int count = 0;
+    return count;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++calculus::GetFailureCount();                                                  \
+        }                                                                                   \
+    } while (false)
+
+/* The statement throws RuntimeError */
+#define CHECK_THROWS(...)                                                                   \
+    do {                                                                                    \
+        bool thrown = false;                                                                \
+        try {                                                                               \
+            __VA_ARGS__;                                                                    \
+        } catch (const calculus::RuntimeError&) {                                           \
+            thrown = true;                                                                  \
+        }                                                                                   \
+        if (!thrown) {                                                                      \
+            std::fprintf(stderr, "%s:%d: did not throw: %s\n", __FILE__, __LINE__, #__VA_ARGS__); \
+            ++calculus::GetFailureCount();                                                  \
+        }                                                                                   \
+    } while (false)
+
+/* |got - want| <= tolerance * max(1, |want|), NaNs only match NaNs */
+inline bool CheckNear(const std::string& what, double got, double want, double tolerance) {
+    bool ok = std::isnan(want) ? std::isnan(got) : std::fabs(got - want) <= tolerance * std::max(1.0, std::fabs(want));
+    if (!ok) {
+        std::fprintf(stderr, "%s: got %.17g, expected %.17g\n", what.c_str(), got, want);
+        ++GetFailureCount();
+    }
+    return ok;
+}
+
+inline int FinishTest() {
+    if (GetFailureCount() != 0) {
+        std::fprintf(stderr, "%d checks failed\n", GetFailureCount());
+    }
+    return GetFailureCount() == 0 ? 0 : 1;
+}
+
+/* Parsed and simplified until it stops changing, as the repl does */
+inline ExpressionPtr ParseExpression(const std::string& text) {
+    static CalculusGrammar::Parser parser;
+    auto result = Normalize(parser.Parse(text)->BuildExpression());
+    if (!result.converged) {
+        throw RuntimeError("Simplification of " + text + " did not converge");
+    }
+    return result.expr;
+}
+
+inline ExpressionPtr ParseRaw(const std::string& text) {
+    static CalculusGrammar::Parser parser;
+    return parser.Parse(text)->BuildExpression();
+}
+
+inline ExpressionPtr Differentiate(const ExpressionPtr& expr, char var_name) {
+    return Normalize(expr->TakeDerivative(var_name)).expr;
+}
+
+/* `text` parsed and simplified prints as `want` */
+inline bool CheckPrinted(const std::string& text, const std::string& want) {
+    std::ostringstream out;
+    ParseExpression(text)->Print(out);
+    if (out.str() != want) {
+        std::fprintf(stderr, "%s: printed %s, expected %s\n", text.c_str(), out.str().c_str(), want.c_str());
+        ++GetFailureCount();
+        return false;
+    }
+    return true;
+}
+
+/* The value from the symbolic engine: every free variable is substituted by its value and
+ * the result is simplified down to a constant */
+inline double EvaluateBySubstitution(const ExpressionPtr& expr, const double* variables) {
+    Bindings bindings;
+    for (char name = 'a'; name <= 'z'; ++name) {
+        if (expr->GetFreeVariables() & VariableMask(name)) {
+            bindings.Bind(name, Make<Constant>(Number::Real(variables[name - 'a'])));
+        }
+    }
+    auto result = Normalize(expr->Substitute(bindings)).expr;
+    if (result->GetKind() != ExpressionKind::kConstant) {
+        throw RuntimeError("Substitution did not reduce the expression to a constant");
+    }
+    return static_cast<const Constant&>(*result).GetValue();
+}
+
+/* Expressions over x, y and z that stay finite for variables in [0.5, 2] */
+inline const std::vector<std::string>& GetTestExpressions() {
+    static const std::vector<std::string> expressions = {
+        "x * y + z",
+        "sin(x) * y ^ 2 + exp(x * y) / (1 + x ^ 2)",
+        "log(x ^ 2 + y ^ 2 + 1) * cos(z) - x / y",
+        "x ^ y + (x + y + z) ^ 3",
+        "(x + 1) ^ 0.5 * sin(y) ^ 3 - z / (x ^ 2 + 1) ^ 2",
+        "exp(sin(x * z)) * log(y) + x ^ (-3) - y ^ (-0.5)",
+        "cos(x + y) * cos(x - y) * z ^ 1.5",
+    };
+    return expressions;
+}
+
+inline void FillTestPoint(std::mt19937_64* random, double* variables) {
+    std::uniform_real_distribution<double> distribution(0.5, 2);
+    for (size_t i = 0; i < kVariableCount; ++i) {
+        variables[i] = distribution(*random);
+    }
+}
+
+/* `got` and `want` compiled to bytecode agree within `tolerance` at `points` test points drawn from `seed` */
+inline void CheckSameValues(const std::string& what, const ExpressionPtr& got, const ExpressionPtr& want,
+                            uint64_t seed, int points = 5, double tolerance = 1e-12) {
+    auto got_program = BytecodeProgram::Compile(got);
+    auto want_program = BytecodeProgram::Compile(want);
+    std::mt19937_64 random(seed);
+    double variables[kVariableCount];
+    for (int i = 0; i < points; ++i) {
+        FillTestPoint(&random, variables);
+        CheckNear(what, got_program.Evaluate(variables), want_program.Evaluate(variables), tolerance);
+    }
+}
+
+template <class Check>
+void ForEachTestExpression(Check&& check) {
+    for (const auto& text : GetTestExpressions()) {
+        check(text);
+    }
+}
+
+/* `count` test points stored as columns, the layout EvaluateBatch() reads */
+class TestTable {
+public:
+    TestTable(size_t count, uint64_t seed) : count_(count), columns_(kVariableCount, std::vector<double>(count)) {
+        std::mt19937_64 random(seed);
+        double variables[kVariableCount];
+        for (size_t row = 0; row < count; ++row) {
+            FillTestPoint(&random, variables);
+            for (size_t c = 0; c < kVariableCount; ++c) {
+                columns_[c][row] = variables[c];
+            }
+        }
+        for (const auto& column : columns_) {
+            pointers_.push_back(column.data());
+        }
+    }
+
+    const double* const* GetColumns() const {
+        return pointers_.data();
+    }
+
+    void GetRow(size_t row, double* variables) const {
+        for (size_t c = 0; c < kVariableCount; ++c) {
+            variables[c] = columns_[c][row];
+        }
+    }
+
+    size_t GetCount() const {
+        return count_;
+    }
+
+private:
+    size_t count_;
+    std::vector<std::vector<double>> columns_;
+    std::vector<const double*> pointers_;
+};
+
+class Stopwatch {
+public:
+    double GetSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+/* Average seconds of step(i) over i in [0, calls) */
+template <class Step>
+double TimePerCall(int calls, Step&& step) {
+    Stopwatch stopwatch;
+    for (int i = 0; i < calls; ++i) {
+        step(i);
+    }
+    return stopwatch.GetSeconds() / calls;
+}
+
+}  /* namespace calculus */